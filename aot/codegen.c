@@ -0,0 +1,681 @@
+#include <bytecode.h>
+#include <codegen.h>
+#include <core/error.h>
+#include <function_table.h>
+#include <module.h>
+#include <optimizer.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+typedef struct {
+  FILE *out;
+  Deserialized des;
+  Analysis analysis;
+
+  // Entry pc of the only lambda ever stored in each global, or -1
+  int32_t *known_globals;
+
+  // Per instruction, reset for every function
+  int32_t *depths;
+  bool *labels;
+} Codegen;
+
+// Function `fn` of the table, -1 being the top-level code
+typedef struct {
+  int32_t fn;
+  size_t start;
+  size_t end;
+  int32_t num_locals;
+} Body;
+
+static Body body_of(Codegen *cg, int32_t fn) {
+  if (fn < 0) return (Body) { -1, 0, cg->analysis.instr_count, 0 };
+
+  FunctionRange range = cg->analysis.functions.ranges[fn];
+  int32_t *maker = &cg->des.instrs[range.start - 4];
+  int32_t num_locals = maker[0] == OP_MakeAndStoreLambda ? maker[3] : maker[2];
+
+  return (Body) { fn, range.start / 4, range.end / 4, num_locals };
+}
+
+// A native callee is pushed by `LoadNative` right before its `Call`
+static bool is_native_call(Codegen *cg, size_t idx) {
+  Analysis *a = &cg->analysis;
+  return idx > 0 && a->owners[idx - 1] == a->owners[idx] && !a->targets[idx] &&
+         INSTR(a, idx - 1)[0] == OP_LoadNative;
+}
+
+// Instruction index after the body of the lambda created at `idx`
+static size_t after_body(int32_t *ins, size_t idx) {
+  return idx + (ins[0] == OP_MakeAndStoreLambda ? ins[2] : ins[1]) + 1;
+}
+
+// Instructions whose successors are always reached through a `goto`
+static bool explicit_goto(int32_t opcode) {
+  switch (opcode) {
+    case OP_JumpRel:
+    case OP_Switch:
+    case OP_MakeLambda:
+    case OP_MakeAndStoreLambda:
+    case OP_MakeClosure:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Stack depth after `idx` and the instructions control can reach from it.
+// Returns the number of successors.
+static int successors(Codegen *cg, size_t idx, int32_t depth, int32_t *out_depth,
+                      size_t *succ) {
+  int32_t *ins = INSTR(&cg->analysis, idx);
+  int32_t effect = 0;
+  int count = 1;
+  succ[0] = idx + 1;
+
+  switch (ins[0]) {
+    case OP_LoadLocal: case OP_LoadConstant: case OP_LoadGlobal:
+    case OP_Special: case OP_LoadCapture: case OP_MapNew: case OP_BuilderNew:
+    case OP_PushInt:
+      effect = 1;
+      break;
+    case OP_StoreLocal: case OP_StoreGlobal: case OP_Compare: case OP_And:
+    case OP_Or: case OP_GetIndex: case OP_Add: case OP_Sub: case OP_Mul:
+    case OP_MapGet: case OP_MapContains: case OP_MapRemove: case OP_Concat:
+    case OP_BuilderAppend:
+      effect = -1;
+      break;
+    case OP_ListGet: case OP_TypeOf: case OP_ConstructorName: case OP_Slice:
+    case OP_ListLength: case OP_MakeMutable: case OP_UnMut: case OP_AddConst:
+    case OP_SubConst: case OP_MulConst: case OP_MapSize: case OP_MapEntries:
+    case OP_BuilderFinish: case OP_Nop:
+      break;
+    case OP_Update: case OP_MapInsert:
+      effect = -2;
+      break;
+    case OP_LoadNative:
+      effect = 3;
+      break;
+    case OP_MakeList: case OP_MakeConstructor: case OP_ListPick:
+      effect = 1 - ins[1];
+      break;
+    case OP_Call:
+      effect = -ins[1] - (is_native_call(cg, idx) ? 2 : 0);
+      break;
+    case OP_CallGlobal:
+      effect = 1 - ins[2];
+      break;
+    case OP_CallLocal:
+      effect = 1 - ins[1];
+      break;
+    case OP_MakeLambda:
+      effect = 1;
+      succ[0] = after_body(ins, idx);
+      break;
+    case OP_MakeAndStoreLambda:
+      succ[0] = after_body(ins, idx);
+      break;
+    case OP_MakeClosure:
+      effect = 1 - ins[3];
+      succ[0] = after_body(ins, idx);
+      break;
+    case OP_JumpRel:
+      succ[0] = idx + ins[1];
+      break;
+    case OP_JumpElseRel:
+      effect = -1;
+      succ[count++] = idx + ins[1];
+      break;
+    case OP_JumpElseRelCmp:
+      effect = -2;
+      succ[count++] = idx + ins[1];
+      break;
+    case OP_IJumpElseRelCmpConst:
+      effect = -1;
+      succ[count++] = idx + ins[1];
+      break;
+    case OP_Switch:
+      effect = -1;
+      count = 0;
+      for (int32_t k = 0; k <= ins[1]; k++) {
+        size_t entry = idx + k + 1;
+        succ[count++] = entry + INSTR(&cg->analysis, entry)[1];
+      }
+      break;
+    case OP_Return: case OP_ReturnConst: case OP_Halt:
+      count = 0;
+      break;
+    default:
+      THROW_FMT("plume-aot: unsupported instruction %s at pc %zu",
+                opcode_name(ins[0]), idx * 4);
+  }
+
+  *out_depth = depth + effect;
+  if (*out_depth < 0) THROW_FMT("plume-aot: stack underflow at pc %zu", idx * 4);
+
+  return count;
+}
+
+// Propagates stack depths from the entry of `body`, every instruction
+// reached must be seen at a single depth. Returns the deepest stack.
+static int32_t compute_depths(Codegen *cg, Body body) {
+  Analysis *a = &cg->analysis;
+  size_t *work = malloc(a->instr_count * sizeof(size_t));
+  size_t *succ = malloc((a->instr_count + 1) * sizeof(size_t));
+  size_t pending = 0;
+  int32_t max_depth = 0;
+
+  for (size_t idx = body.start; idx < body.end; idx++) {
+    cg->depths[idx] = -1;
+    cg->labels[idx] = false;
+  }
+
+  cg->depths[body.start] = 0;
+  work[pending++] = body.start;
+
+  while (pending > 0) {
+    size_t idx = work[--pending];
+    int32_t depth;
+    int count = successors(cg, idx, cg->depths[idx], &depth, succ);
+    if (depth > max_depth) max_depth = depth;
+
+    for (int i = 0; i < count; i++) {
+      size_t next = succ[i];
+      if (next < body.start || next >= body.end || a->owners[next] != body.fn)
+        THROW_FMT("plume-aot: jump out of function at pc %zu", idx * 4);
+
+      // Anything but a plain fallthrough needs a label to jump to
+      if (next != idx + 1 || explicit_goto(INSTR(a, idx)[0])) cg->labels[next] = true;
+
+      if (cg->depths[next] == -1) {
+        cg->depths[next] = depth;
+        work[pending++] = next;
+      } else if (cg->depths[next] != depth) {
+        THROW_FMT("plume-aot: inconsistent stack depth at pc %zu", next * 4);
+      }
+    }
+  }
+
+  free(work);
+  free(succ);
+  return max_depth;
+}
+
+static void emit_string(FILE *out, const char *data, uint32_t length) {
+  fputc('"', out);
+  for (uint32_t i = 0; i < length; i++) {
+    unsigned char c = data[i];
+    if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+    else if (c >= 0x20 && c < 0x7f && c != '?') fputc(c, out);
+    else fprintf(out, "\\%03o", c);
+  }
+  fputc('"', out);
+}
+
+// `Value a[] = { s<from>, ..., s<from + count - 1> };`
+static void emit_array(FILE *out, int32_t from, int32_t count) {
+  fprintf(out, "Value a[] = {");
+  for (int32_t k = 0; k < count; k++) fprintf(out, "%s s%d", k ? "," : "", from + k);
+  fprintf(out, " };");
+}
+
+static void emit_call(Codegen *cg, const char *callee, int32_t args, int32_t argc,
+                      int32_t result) {
+  if (argc == 0) {
+    fprintf(cg->out, "s%d = aot_call(m, %s, NULL, 0);\n", result, callee);
+    return;
+  }
+
+  fprintf(cg->out, "{ ");
+  emit_array(cg->out, args, argc);
+  fprintf(cg->out, " s%d = aot_call(m, %s, a, %d); }\n", result, callee, argc);
+}
+
+static void emit_instruction(Codegen *cg, Body body, size_t idx) {
+  FILE *out = cg->out;
+  int32_t *ins = INSTR(&cg->analysis, idx);
+  int32_t d = cg->depths[idx];
+  int32_t pc = idx * 4;
+
+  switch (ins[0]) {
+    case OP_LoadLocal:
+      fprintf(out, "s%d = l%d;\n", d, ins[1]);
+      break;
+    case OP_StoreLocal:
+      fprintf(out, "l%d = s%d;\n", ins[1], d - 1);
+      break;
+    case OP_LoadConstant:
+      fprintf(out, "s%d = constants[%d];\n", d, ins[1]);
+      break;
+    case OP_PushInt:
+      fprintf(out, "s%d = MAKE_INTEGER(%d);\n", d, ins[1]);
+      break;
+    case OP_LoadGlobal:
+      fprintf(out, "s%d = m->stack->values[%d];\n", d, ins[1]);
+      break;
+    case OP_StoreGlobal:
+      fprintf(out, "m->stack->values[%d] = s%d;\n", ins[1], d - 1);
+      break;
+    case OP_Return:
+    case OP_ReturnConst:
+      // Returning from the top-level code ends the program like `Halt`
+      if (body.fn < 0) fprintf(out, "aot_halt(m);\n");
+      else if (ins[0] == OP_Return) fprintf(out, "return s%d;\n", d - 1);
+      else fprintf(out, "return constants[%d];\n", ins[1]);
+      break;
+    case OP_Compare:
+      if (!known_comparison(ins[1])) THROW_FMT("plume-aot: unknown comparison %d at pc %d", ins[1], pc);
+      fprintf(out, "s%d = comparison_table[%d](s%d, s%d);\n", d - 2, ins[1], d - 1, d - 2);
+      break;
+    case OP_And:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d && s%d);\n", d - 2, d - 1, d - 2);
+      break;
+    case OP_Or:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d || s%d);\n", d - 2, d - 1, d - 2);
+      break;
+    case OP_LoadNative:
+      // Consumed by the following `Call`, which resolves the native itself
+      if (!(idx + 1 < body.end && INSTR(&cg->analysis, idx + 1)[0] == OP_Call &&
+            is_native_call(cg, idx + 1)))
+        THROW_FMT("plume-aot: native at pc %d is not called directly", pc);
+      fprintf(out, ";\n");
+      break;
+    case OP_MakeList:
+    case OP_MakeConstructor: {
+      int32_t n = ins[1];
+      if (n == 0) {
+        fprintf(out, "s%d = MAKE_LIST(NULL, 0);", d);
+      } else {
+        fprintf(out, "{ ");
+        emit_array(out, d - n, n);
+        fprintf(out, " s%d = MAKE_LIST(a, %d); }", d - n, n);
+      }
+      if (ins[0] == OP_MakeConstructor) fprintf(out, " SET_CONSTRUCTOR_TAG(s%d, %d);", d - n, ins[2]);
+      fprintf(out, "\n");
+      break;
+    }
+    case OP_ListGet:
+      fprintf(out, "s%d = GET_LIST(s%d)[%d];\n", d - 1, d - 1, ins[1]);
+      break;
+    case OP_Call: {
+      int32_t argc = ins[1];
+
+      if (is_native_call(cg, idx)) {
+        int32_t *native = INSTR(&cg->analysis, idx - 1);
+        int32_t args = d - 3 - argc;
+        fprintf(out, "{ ");
+        if (argc > 0) emit_array(out, args, argc);
+        fprintf(out, " s%d = aot_native(m, %d, %d, constants[%d], %s, %d); }\n", args,
+                native[2], native[3], native[1], argc > 0 ? "a" : "NULL", argc);
+        break;
+      }
+
+      char callee[16];
+      snprintf(callee, sizeof(callee), "s%d", d - 1);
+      emit_call(cg, callee, d - 1 - argc, argc, d - 1 - argc);
+      break;
+    }
+    case OP_CallGlobal: {
+      int32_t argc = ins[2];
+      int32_t entry = cg->known_globals[ins[1]];
+
+      if (entry >= 0) {
+        if (argc == 0) {
+          fprintf(out, "s%d = fn_%d(m, 0, NULL, 0);\n", d, entry);
+        } else {
+          fprintf(out, "{ ");
+          emit_array(out, d - argc, argc);
+          fprintf(out, " s%d = fn_%d(m, 0, a, %d); }\n", d - argc, entry, argc);
+        }
+        break;
+      }
+
+      char callee[32];
+      snprintf(callee, sizeof(callee), "m->stack->values[%d]", ins[1]);
+      emit_call(cg, callee, d - argc, argc, d - argc);
+      break;
+    }
+    case OP_CallLocal: {
+      // The argument count is the local index, as in the interpreter
+      int32_t argc = ins[1];
+      char callee[16];
+      snprintf(callee, sizeof(callee), "l%d", ins[1]);
+      emit_call(cg, callee, d - argc, argc, d - argc);
+      break;
+    }
+    case OP_JumpRel:
+      fprintf(out, "goto L%zu;\n", (idx + ins[1]) * 4);
+      return;
+    case OP_JumpElseRel:
+      fprintf(out, "if (GET_INT(s%d) == 0) goto L%zu;\n", d - 1, (idx + ins[1]) * 4);
+      break;
+    case OP_JumpElseRelCmp:
+      if (!known_comparison(ins[2])) THROW_FMT("plume-aot: unknown comparison %d at pc %d", ins[2], pc);
+      fprintf(out, "if (GET_INT(comparison_table[%d](s%d, s%d)) == 0) goto L%zu;\n", ins[2],
+              d - 1, d - 2, (idx + ins[1]) * 4);
+      break;
+    case OP_IJumpElseRelCmpConst: {
+      const char *op = ins[2] == CompareEqual ? "==" : ins[2] == CompareAnd ? "&"
+                       : ins[2] == CompareOr ? "|" : NULL;
+      if (op == NULL) THROW_FMT("plume-aot: unknown comparison %d at pc %d", ins[2], pc);
+      fprintf(out, "if ((uint32_t) (GET_INT(s%d) %s GET_INT(constants[%d])) == 0) goto L%zu;\n",
+              d - 1, op, ins[3], (idx + ins[1]) * 4);
+      break;
+    }
+    case OP_TypeOf:
+      fprintf(out, "s%d = aot_type_of(s%d);\n", d - 1, d - 1);
+      break;
+    case OP_ConstructorName:
+      fprintf(out, "s%d = GET_LIST(s%d)[1];\n", d - 1, d - 1);
+      break;
+    case OP_MakeLambda:
+      fprintf(out, "s%d = MAKE_FUNCTION(%d, %d);\n", d, pc + 4, ins[2]);
+      break;
+    case OP_MakeAndStoreLambda:
+      fprintf(out, "m->stack->values[%d] = MAKE_FUNCTION(%d, %d);\n", ins[1], pc + 4, ins[3]);
+      break;
+    case OP_MakeClosure: {
+      int32_t n = ins[3];
+      fprintf(out, "{ ");
+      if (n > 0) emit_array(out, d - n, n);
+      fprintf(out, " s%d = MAKE_CLOSURE(MAKE_FUNCTION(%d, %d), %s, %d); }\n", d - n, pc + 4,
+              ins[2], n > 0 ? "a" : "NULL", n);
+      break;
+    }
+    case OP_LoadCapture:
+      fprintf(out, "s%d = GET_CAPTURE(env, %d);\n", d, ins[1]);
+      break;
+    case OP_GetIndex:
+      fprintf(out, "s%d = GET_PTR(s%d)->type == TYPE_LIST ? GET_LIST(s%d)[GET_INT(s%d)] : "
+              "array_get(s%d, GET_INT(s%d));\n", d - 2, d - 2, d - 2, d - 1, d - 2, d - 1);
+      break;
+    case OP_Special:
+      fprintf(out, "s%d = MAKE_SPECIAL();\n", d);
+      break;
+    case OP_Slice:
+      fprintf(out, "s%d = GET_PTR(s%d)->type == TYPE_LIST ? "
+              "MAKE_LIST(&GET_LIST(s%d)[%d], GET_PTR(s%d)->length - %d) : array_slice(s%d, %d);\n",
+              d - 1, d - 1, d - 1, ins[1], d - 1, ins[1], d - 1, ins[1]);
+      break;
+    case OP_ListLength:
+    case OP_MapSize:
+      fprintf(out, "s%d = MAKE_INTEGER(GET_PTR(s%d)->length);\n", d - 1, d - 1);
+      break;
+    case OP_Halt:
+      fprintf(out, "aot_halt(m);\n");
+      break;
+    case OP_Update:
+      fprintf(out, "GET_MUTABLE(s%d) = s%d;\n", d - 1, d - 2);
+      break;
+    case OP_MakeMutable:
+      fprintf(out, "s%d = MAKE_MUTABLE(s%d);\n", d - 1, d - 1);
+      break;
+    case OP_UnMut:
+      fprintf(out, "s%d = GET_MUTABLE(s%d);\n", d - 1, d - 1);
+      break;
+    case OP_Add:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d + s%d);\n", d - 2, d - 1, d - 2);
+      break;
+    case OP_Sub:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d - s%d);\n", d - 2, d - 2, d - 1);
+      break;
+    case OP_Mul:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d * s%d);\n", d - 2, d - 1, d - 2);
+      break;
+    case OP_AddConst:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d + constants[%d]);\n", d - 1, d - 1, ins[1]);
+      break;
+    case OP_SubConst:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d - constants[%d]);\n", d - 1, d - 1, ins[1]);
+      break;
+    case OP_MulConst:
+      fprintf(out, "s%d = MAKE_INTEGER(s%d * constants[%d]);\n", d - 1, d - 1, ins[1]);
+      break;
+    case OP_Switch: {
+      if (ins[2] == SwitchTag) {
+        fprintf(out, "switch (GET_CONSTRUCTOR_TAG(s%d)) {\n", d - 1);
+      } else {
+        fprintf(out, "switch ((uint32_t) GET_INT(s%d)) {\n", d - 1);
+      }
+
+      for (int32_t k = 0; k <= ins[1]; k++) {
+        size_t entry = idx + k + 1;
+        size_t target = entry + INSTR(&cg->analysis, entry)[1];
+        if (k < ins[1]) fprintf(out, "    case %d: goto L%zu;\n", k, target * 4);
+        else fprintf(out, "    default: goto L%zu;\n", target * 4);
+      }
+
+      fprintf(out, "  }\n");
+      return;
+    }
+    case OP_MapNew:
+      fprintf(out, "s%d = map_new(%d);\n", d, ins[1]);
+      break;
+    case OP_MapGet:
+      fprintf(out, "if (!map_get(s%d, s%d, &s%d)) s%d = MAKE_SPECIAL();\n", d - 2, d - 1,
+              d - 2, d - 2);
+      break;
+    case OP_MapContains:
+      fprintf(out, "{ Value v; s%d = MAKE_INTEGER(map_get(s%d, s%d, &v)); }\n", d - 2, d - 2,
+              d - 1);
+      break;
+    case OP_MapInsert:
+      fprintf(out, "s%d = map_insert(s%d, s%d, s%d);\n", d - 3, d - 3, d - 2, d - 1);
+      break;
+    case OP_MapRemove:
+      fprintf(out, "s%d = map_remove(s%d, s%d);\n", d - 2, d - 2, d - 1);
+      break;
+    case OP_MapEntries:
+      fprintf(out, "s%d = map_entries(s%d);\n", d - 1, d - 1);
+      break;
+    case OP_Concat:
+      fprintf(out, "s%d = string_concat(s%d, s%d);\n", d - 2, d - 2, d - 1);
+      break;
+    case OP_BuilderNew:
+      fprintf(out, "s%d = builder_new(%d);\n", d, ins[1]);
+      break;
+    case OP_BuilderAppend:
+      fprintf(out, "builder_append(s%d, s%d);\n", d - 2, d - 1);
+      break;
+    case OP_BuilderFinish:
+      fprintf(out, "s%d = builder_finish(s%d);\n", d - 1, d - 1);
+      break;
+    case OP_Nop:
+      fprintf(out, ";\n");
+      break;
+    case OP_ListPick:
+      fprintf(out, "s%d = s%d;\n", d - ins[1], d - ins[1] + ins[2]);
+      break;
+  }
+
+  // Lambda bodies sit between the instruction and its fallthrough
+  if (ins[0] == OP_MakeLambda || ins[0] == OP_MakeAndStoreLambda || ins[0] == OP_MakeClosure)
+    fprintf(out, "  goto L%zu;\n", after_body(ins, idx) * 4);
+}
+
+static void emit_signature(Codegen *cg, Body body) {
+  if (body.fn < 0) {
+    fprintf(cg->out, "static void plume_main(Module* m)");
+  } else {
+    fprintf(cg->out, "static Value fn_%zu(Module* m, Value env, Value* args, size_t argc)",
+            body.start * 4);
+  }
+}
+
+static void emit_body(Codegen *cg, Body body) {
+  FILE *out = cg->out;
+  int32_t max_depth = compute_depths(cg, body);
+
+  // Locals may be stored past the frame's slots, they start out as special values
+  int32_t num_locals = body.num_locals;
+  for (size_t idx = body.start; idx < body.end; idx++) {
+    int32_t *ins = INSTR(&cg->analysis, idx);
+    bool local = ins[0] == OP_LoadLocal || ins[0] == OP_StoreLocal || ins[0] == OP_CallLocal;
+    if (cg->depths[idx] >= 0 && local && ins[1] >= num_locals) num_locals = ins[1] + 1;
+  }
+
+  if (body.fn >= 0) fprintf(out, "// %s\n", cg->analysis.functions.ranges[body.fn].name);
+  emit_signature(cg, body);
+  fprintf(out, " {\n");
+
+  // A frame's `num_locals` slots end with its arguments, the interpreter
+  // addressing them back from the frame header
+  if (body.num_locals > 0) {
+    fprintf(out, "  int32_t first = (int32_t) argc - %d;\n", body.num_locals);
+  }
+
+  for (int32_t i = 0; i < num_locals; i++) {
+    if (i < body.num_locals) {
+      fprintf(out, "  Value l%d = first + %d >= 0 ? args[first + %d] : MAKE_SPECIAL();\n", i, i, i);
+    } else {
+      fprintf(out, "  Value l%d = MAKE_SPECIAL();\n", i);
+    }
+  }
+
+  for (int32_t i = 0; i < max_depth; i++) fprintf(out, "  Value s%d = 0;\n", i);
+  if (body.fn < 0) fprintf(out, "  Value env = 0;\n");
+  fprintf(out, "\n");
+
+  for (size_t idx = body.start; idx < body.end; idx++) {
+    if (cg->analysis.owners[idx] != body.fn || cg->depths[idx] < 0) continue;
+
+    if (cg->labels[idx]) fprintf(out, "L%zu:\n", idx * 4);
+    fprintf(out, "  ");
+    emit_instruction(cg, body, idx);
+  }
+
+  // Falling off the top-level code ends the program like `Halt`
+  if (body.fn < 0) fprintf(out, "  aot_halt(m);\n");
+  fprintf(out, "}\n\n");
+}
+
+static void emit_constants(Codegen *cg) {
+  FILE *out = cg->out;
+  Deserialized des = cg->des;
+
+  fprintf(out, "static Value constants[%zu];\n\n", des.constant_count + 1);
+  fprintf(out, "static void init_constants(void) {\n");
+
+  for (size_t i = 0; i < des.constant_count; i++) {
+    Value value = des.module->constants[i];
+
+    if (get_type(value) == TYPE_STRING) {
+      HeapValue *string = GET_PTR(value);
+      fprintf(out, "  constants[%zu] = MAKE_STRING(", i);
+      emit_string(out, (char *) string->as_ptr, string->length);
+      fprintf(out, ", %u);\n", string->length);
+    } else {
+      fprintf(out, "  constants[%zu] = 0x%016llxull;\n", i, (unsigned long long) value);
+    }
+  }
+
+  fprintf(out, "}\n\n");
+}
+
+static void emit_libraries(Codegen *cg) {
+  FILE *out = cg->out;
+  Libraries libs = cg->des.libraries;
+
+  fprintf(out, "static Library libraries[] = {\n");
+  for (int i = 0; i < libs.num_libraries; i++) {
+    Library lib = libs.libraries[i];
+    fprintf(out, "  { ");
+    emit_string(out, lib.name, strlen(lib.name));
+    fprintf(out, ", %zu, %d },\n", lib.num_functions, lib.is_standard);
+  }
+  fprintf(out, "  { NULL, 0, 0 },\n};\n\n");
+}
+
+// Function values keep their interpreter encoding, calls through them
+// switch on the entry pc
+static void emit_dispatch(Codegen *cg) {
+  FILE *out = cg->out;
+  FunctionTable table = cg->analysis.functions;
+
+  fprintf(out, "static Value aot_call(Module* m, Value callee, Value* args, size_t argc) {\n");
+  fprintf(out, "  Value env = 0, result;\n");
+  fprintf(out, "  bool memoized = IS_PTR(callee) && GET_PTR(callee)->tag == CLOSURE_MEMOIZED;\n");
+  fprintf(out, "  if (memoized && memo_lookup(callee, args, argc, &result)) return result;\n\n");
+  fprintf(out, "  if (IS_PTR(callee)) {\n");
+  fprintf(out, "    env = callee;\n");
+  fprintf(out, "    callee = GET_CLOSURE_CODE(callee);\n");
+  fprintf(out, "  }\n\n");
+  fprintf(out, "  switch ((int16_t) (callee & MASK_PAYLOAD_INT)) {\n");
+  for (size_t i = 0; i < table.num_ranges; i++) {
+    fprintf(out, "    case %d: result = fn_%d(m, env, args, argc); break;\n",
+            table.ranges[i].start, table.ranges[i].start);
+  }
+  fprintf(out, "    default: THROW_FMT(\"Unknown function at pc %%d\", (int16_t) callee);\n");
+  fprintf(out, "  }\n\n");
+  // A memoized callee is its own environment
+  fprintf(out, "  if (memoized) memo_store(env, args, argc, result);\n");
+  fprintf(out, "  return result;\n}\n\n");
+}
+
+static void find_known_globals(Codegen *cg) {
+  Analysis *a = &cg->analysis;
+  int32_t *stores = calloc(GLOBALS_SIZE, sizeof(int32_t));
+  cg->known_globals = malloc(GLOBALS_SIZE * sizeof(int32_t));
+
+  for (size_t i = 0; i < GLOBALS_SIZE; i++) cg->known_globals[i] = -1;
+
+  for (size_t idx = 0; idx < a->instr_count; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    if (ins[0] != OP_StoreGlobal && ins[0] != OP_MakeAndStoreLambda) continue;
+    if (ins[1] < 0 || ins[1] >= GLOBALS_SIZE) continue;
+
+    stores[ins[1]]++;
+    if (ins[0] == OP_MakeAndStoreLambda) cg->known_globals[ins[1]] = (idx + 1) * 4;
+  }
+
+  for (size_t i = 0; i < GLOBALS_SIZE; i++) {
+    if (stores[i] != 1) cg->known_globals[i] = -1;
+  }
+
+  free(stores);
+}
+
+void codegen(Deserialized des, FILE *out) {
+  Codegen cg;
+  cg.out = out;
+  cg.des = des;
+  cg.analysis = analysis_new(des);
+  cg.depths = malloc(des.instr_count * sizeof(int32_t));
+  cg.labels = malloc(des.instr_count * sizeof(bool));
+  find_known_globals(&cg);
+
+  FunctionTable table = cg.analysis.functions;
+
+  fprintf(out, "// Generated by plume-aot, do not edit\n\n");
+  fprintf(out, "#include <aot.h>\n");
+  fprintf(out, "#include <core/error.h>\n\n");
+
+  emit_constants(&cg);
+  emit_libraries(&cg);
+
+  fprintf(out, "static Value aot_call(Module* m, Value callee, Value* args, size_t argc);\n");
+  for (size_t i = 0; i < table.num_ranges; i++) {
+    emit_signature(&cg, body_of(&cg, i));
+    fprintf(out, ";\n");
+  }
+  fprintf(out, "\n");
+
+  for (size_t i = 0; i < table.num_ranges; i++) emit_body(&cg, body_of(&cg, i));
+  emit_body(&cg, body_of(&cg, -1));
+  emit_dispatch(&cg);
+
+  fprintf(out, "int main(int argc, char** argv) {\n");
+  fprintf(out, "  init_constants();\n");
+  fprintf(out, "  Libraries libs = { libraries, %zu };\n", des.libraries.num_libraries);
+  fprintf(out, "  plume_main(aot_start(argc, argv, constants, libs));\n");
+  fprintf(out, "  return 0;\n");
+  fprintf(out, "}\n");
+
+  analysis_free(&cg.analysis);
+  free(cg.depths);
+  free(cg.labels);
+  free(cg.known_globals);
+}
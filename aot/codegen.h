@@ -0,0 +1,13 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <module.h>
+#include <stdio.h>
+
+// Translates a deserialized program into a C translation unit that links
+// against the Plume runtime. Every Plume function becomes one C function
+// whose instructions are labelled by pc, operand stack slots and locals
+// become C variables.
+void codegen(Deserialized des, FILE *out);
+
+#endif  // CODEGEN_H
@@ -0,0 +1,48 @@
+#include <codegen.h>
+#include <core/error.h>
+#include <deserializer.h>
+#include <optimizer.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// plume-aot [--no-optimize] <file> [-o <output.c>]
+//
+// The output is compiled against the runtime, for instance:
+//   clang -O2 -Iinclude out.c -Lbin -lplume-runtime -ldl -o program
+int main(int argc, char** argv) {
+  char* input = NULL;
+  char* output = NULL;
+  bool optimized = true;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "--no-optimize") == 0) {
+      optimized = false;
+    } else if (input == NULL) {
+      input = argv[i];
+    } else {
+      THROW_FMT("Unknown argument: %s", argv[i]);
+    }
+  }
+
+  if (input == NULL) THROW_FMT("Usage: %s [--no-optimize] <file> [-o <output.c>]", argv[0]);
+
+  FILE* file = fopen(input, "rb");
+  if (file == NULL) THROW_FMT("Could not open file: %s", input);
+
+  Deserialized des = deserialize(file);
+  fclose(file);
+
+  if (optimized) optimize(des);
+
+  FILE* out = output == NULL ? stdout : fopen(output, "w");
+  if (out == NULL) THROW_FMT("Could not open file: %s", output);
+
+  codegen(des, out);
+
+  if (out != stdout) fclose(out);
+
+  return 0;
+}
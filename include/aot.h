@@ -0,0 +1,24 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <array.h>
+#include <interpreter.h>
+#include <map.h>
+#include <memo.h>
+#include <module.h>
+#include <rope.h>
+#include <stack.h>
+#include <value.h>
+
+// Runtime side of programs translated by plume-aot. Generated code keeps
+// the interpreter's Value representation and uses the same heap, natives
+// and comparison functions, only the dispatch loop is compiled away.
+
+Module *aot_start(int argc, char **argv, Constants constants, Libraries libraries);
+
+Value aot_native(Module *module, int32_t lib, int32_t index, Value name,
+                 Value *args, size_t argc);
+Value aot_type_of(Value value);
+_Noreturn void aot_halt(Module *module);
+
+#endif  // AOT_H
@@ -0,0 +1,51 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include <module.h>
+#include <stdint.h>
+#include <value.h>
+
+// Typed arrays hold unboxed elements of a single kind, given by the tag,
+// inline after the header. GetIndex, ListLength and Slice take them as
+// they take lists, elements being boxed as they are read: int64 elements
+// that do not fit an integer are read as floats.
+
+#define ARRAY_INT32 0
+#define ARRAY_INT64 1
+#define ARRAY_FLOAT64 2
+#define ARRAY_BYTE 3
+
+// Independent accumulators of the bulk natives, which compilers keep in
+// vector registers
+#define ARRAY_LANES 8
+
+static inline size_t array_element_size(uint16_t kind) {
+  return kind == ARRAY_BYTE ? 1 : kind == ARRAY_INT32 ? 4 : 8;
+}
+
+#define GET_ARRAY(x) ((void*) GET_PTR(x)->as_ptr)
+
+Value array_new(uint16_t kind, uint32_t length);
+Value array_get(Value array, uint32_t index);
+Value array_slice(Value array, uint32_t from);
+
+// array_from(kind, list): kind is "int32", "int64", "float64" or "byte",
+// numbers are converted as C casts do
+Value array_from(int argc, Module *module, Value *args);
+Value array_to_list(int argc, Module *module, Value *args);
+
+// Integer sums that do not fit an integer are returned as floats
+Value array_sum(int argc, Module *module, Value *args);
+Value array_min(int argc, Module *module, Value *args);
+Value array_max(int argc, Module *module, Value *args);
+
+// array_add(a, b): element-wise, b being an array of the same kind and
+// length or a number applied to every element. Integers wrap around.
+Value array_add(int argc, Module *module, Value *args);
+Value array_sub(int argc, Module *module, Value *args);
+Value array_mul(int argc, Module *module, Value *args);
+
+// array_find(array, x): index of the first element equal to x, -1 if none
+Value array_find(int argc, Module *module, Value *args);
+
+#endif  // ARRAY_H
@@ -43,21 +43,85 @@ typedef enum {
   OP_JumpElseRelCmpConst,
   OP_IJumpElseRelCmpConst,
   OP_CallGlobal,
-  OP_CallNative,
+  OP_CallLocal,
   OP_MakeAndStoreLambda,
+  OP_Mul,
+  OP_MulConst,
+  OP_MakeClosure,
+  OP_LoadCapture,
+  OP_MakeConstructor,
+  OP_Switch,
+  OP_MapNew,
+  OP_MapGet,
+  OP_MapContains,
+  OP_MapInsert,
+  OP_MapRemove,
+  OP_MapSize,
+  OP_MapEntries,
+  OP_Concat,
+  OP_BuilderNew,
+  OP_BuilderAppend,
+  OP_BuilderFinish,
+
+  // Emitted by load-time passes only, never by the compiler
+  OP_Nop,
+  OP_ListPick,
+  // Last use of a local, which takes its reference along
+  OP_MoveLocal,
+
+  // Compact encoding only, integer constants inlined as 16-bit immediates.
+  // Constant folding emits `PushInt` too.
+  OP_PushInt,
+  OP_AddInt,
+  OP_SubInt,
+  OP_MulInt,
+  OP_ReturnInt,
+  OP_IJumpElseRelCmpInt,
+
+  // `LoadLocal` counting the new reference, with reference counting on
+  OP_DupLocal,
+
+  // Stub of a function encoded on its first call
+  OP_Decode,
+
+  // Call to an inlinable global, replaced by the callee's body when encoded
+  OP_Inline,
+
+  // Where memoized calls return, caching their result, see `op_memo_call`
+  OP_MemoReturn,
 } Opcode;
 
-typedef struct {
-  Opcode opcode;
-  int32_t operand1;
-  int32_t operand2;
-  int32_t operand3;
-} Instruction;
+#define OPCODE_COUNT (OP_MemoReturn + 1)
 
-typedef struct {
-  Instruction *instructions;
-  int32_t instruction_count;
-} Bytecode;
+// The interpreter runs a compact encoding of the instruction stream: a
+// one-byte opcode followed by its operands as little-endian int16, so
+// `Add` takes one byte and `LoadLocal` three. Jump offsets and lambda
+// lengths are in bytes there.
+static const uint8_t operand_counts[OPCODE_COUNT] = {
+  [OP_LoadLocal] = 1, [OP_StoreLocal] = 1, [OP_LoadConstant] = 1,
+  [OP_LoadGlobal] = 1, [OP_StoreGlobal] = 1, [OP_Compare] = 1,
+  [OP_LoadNative] = 3, [OP_MakeList] = 1, [OP_ListGet] = 1, [OP_Call] = 1,
+  [OP_JumpElseRel] = 1, [OP_MakeLambda] = 2, [OP_JumpRel] = 1, [OP_Slice] = 1,
+  [OP_ReturnConst] = 1, [OP_AddConst] = 1, [OP_SubConst] = 1,
+  [OP_JumpElseRelCmp] = 2, [OP_IJumpElseRelCmp] = 2,
+  [OP_JumpElseRelCmpConst] = 3, [OP_IJumpElseRelCmpConst] = 3,
+  [OP_CallGlobal] = 2, [OP_CallLocal] = 1, [OP_MakeAndStoreLambda] = 3,
+  [OP_MulConst] = 1, [OP_MakeClosure] = 3, [OP_LoadCapture] = 1,
+  [OP_MakeConstructor] = 2, [OP_Switch] = 2, [OP_MapNew] = 1,
+  [OP_BuilderNew] = 1, [OP_ListPick] = 2, [OP_PushInt] = 1, [OP_AddInt] = 1,
+  [OP_SubInt] = 1, [OP_MulInt] = 1, [OP_ReturnInt] = 1,
+  [OP_IJumpElseRelCmpInt] = 3, [OP_Decode] = 1, [OP_MoveLocal] = 1,
+  [OP_DupLocal] = 1,
+};
+
+// Constant for a constant opcode, so handlers advance by an immediate
+#define ENCODED_SIZE(opcode) (1 + 2 * operand_counts[opcode])
+
+// What OP_Switch dispatches on
+typedef enum {
+  SwitchInteger = 0,
+  SwitchTag = 1,
+} SwitchMode;
 
 typedef struct {
   char *name;
@@ -70,6 +134,17 @@ typedef struct {
   size_t num_libraries;
 } Libraries;
 
+// Optional debug section mapping function entry pcs to source names
+typedef struct {
+  int32_t pc;
+  char *name;
+} FunctionName;
+
+typedef struct {
+  FunctionName *names;
+  size_t num_names;
+} FunctionNames;
+
 typedef enum {
   LessThan = 0,
   GreaterThan = 1,
@@ -81,4 +156,19 @@ typedef enum {
   Or = 7,
 } Comparison;
 
+// Comparison operands as the interpreter reads them, which index
+// `comparison_table` and do not follow `Comparison`. Other codes have no
+// handler.
+typedef enum {
+  CompareEqual = 2,
+  CompareAnd = 5,
+  CompareOr = 6,
+} VMComparison;
+
+static inline bool known_comparison(int32_t comparison) {
+  return comparison == CompareEqual || comparison == CompareAnd || comparison == CompareOr;
+}
+
+const char *opcode_name(int32_t opcode);
+
 #endif  // BYTECODE_H
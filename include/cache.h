@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <encoding.h>
+#include <module.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Processed programs are cached as a single image per bytecode file, VM
+// build and encoding options, which a later start maps instead of
+// deserializing and encoding again. Images hold every function encoded
+// when they all fit, see `encode_all`. The directory is $PLUME_CACHE_DIR,
+// $XDG_CACHE_HOME/plume or ~/.cache/plume, holding at most CACHE_MAX_SIZE
+// bytes of images, least recently used evicted first. One-off runs can
+// skip it with --no-cache.
+
+#define CACHE_MAGIC 0x434d4c50  // "PLMC"
+#define CACHE_VERSION 2
+#define CACHE_MAX_SIZE (64 << 20)
+
+// Natives referenced by the program, resolved eagerly when loading
+typedef struct {
+  int32_t lib;
+  int32_t index;
+  int32_t constant;
+} NativeBinding;
+
+typedef struct {
+  void *base;
+  size_t size;
+
+  NativeBinding *bindings;
+  uint32_t num_bindings;
+} CacheImage;
+
+// Hashes the content of `file` along with the build ID and the options
+// encoding depends on, then rewinds it. `layout` is the path of a layout
+// profile, hashed by content, or NULL.
+uint64_t cache_key(FILE *file, bool optimized, bool refcounting, const char *layout);
+
+// Fills `des` with its code encoded as in `encoding`, to be resumed with
+// `encode_resume`
+bool cache_load(uint64_t key, Deserialized *des, CacheImage *image, Encoding *encoding);
+void cache_store(uint64_t key, Deserialized des, Encoding encoding);
+
+void cache_bind_natives(CacheImage image, Module *module);
+
+#endif  // CACHE_H
@@ -6,6 +6,7 @@
 #include <module.h>
 #include <core/error.h>
 #include <core/debug.h>
+#include <core/probes.h>
 
 #define MAX_FRAMES 1024
 
@@ -49,6 +50,8 @@ static inline Frame pop_frame(Module* mod) {
   mod->locals_count--;
   mod->callstack--;
 
+  PLUME_PROBE2(function__return, pc, mod->callstack);
+
   return (Frame) { pc, old_sp, base_ptr };
 }
 
@@ -0,0 +1,32 @@
+#ifndef PLUME_PROBES_H
+#define PLUME_PROBES_H
+
+// USDT tracepoints under the "plume" provider. Each probe compiles to a
+// single nop plus an ELF note, so they are free until perf or bpftrace
+// attaches to them.
+//
+//   function__entry(pc, depth)         after create_frame, callee entry pc
+//   function__return(pc, depth)        pop_frame, return target pc
+//   native__entry(name, argc)          before a native call
+//   native__return(name, argc)         after a native call
+//   alloc(type, bytes)                 every heap allocation
+//   halt()                             OP_Halt
+
+#if !defined(PLUME_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PLUME_HAS_PROBES 1
+#endif
+#endif
+
+#ifdef PLUME_HAS_PROBES
+#define PLUME_PROBE0(name) STAP_PROBE(plume, name)
+#define PLUME_PROBE1(name, a) STAP_PROBE1(plume, name, a)
+#define PLUME_PROBE2(name, a, b) STAP_PROBE2(plume, name, a, b)
+#else
+#define PLUME_PROBE0(name)
+#define PLUME_PROBE1(name, a)
+#define PLUME_PROBE2(name, a, b)
+#endif
+
+#endif  // PLUME_PROBES_H
\ No newline at end of file
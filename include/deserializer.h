@@ -2,8 +2,56 @@
 #define DESERIALIZER_H
 
 #include <module.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// Sectioned format, told apart from the flat one by its magic. A header
+// and a table of sections found by offset, so that the code section can
+// be mapped and only the functions a run calls are ever read.
+#define BYTECODE_MAGIC 0x424d4c50  // "PLMB"
+#define BYTECODE_VERSION 2
+
+// Set by compilers that type checked the program, which then runs in the
+// unchecked loop. Files in the flat format are never trusted.
+#define BYTECODE_TRUSTED 1
+
+typedef enum {
+  // Same encodings as in the flat format
+  SECTION_CONSTANTS = 1,
+  SECTION_LIBRARIES = 2,
+
+  SECTION_FUNCTIONS = 3,
+
+  // Instructions of four int32 words each, 8-byte aligned
+  SECTION_CODE = 4,
+} SectionKind;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t section_count;
+  uint32_t flags;
+} BytecodeHeader;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+} Section;
+
+// The function section is a count followed by entries, then their names.
+// `entry` and `length` are in instructions, `name` is an offset into the
+// section and `arity` is -1 when unknown.
+typedef struct {
+  int32_t entry;
+  int32_t length;
+  int32_t locals;
+  int32_t arity;
+  uint32_t name;
+  uint32_t name_length;
+} FunctionEntry;
+
 Deserialized deserialize(FILE *file);
 
-#endif  // DESERIALIZER_H
\ No newline at end of file
+#endif  // DESERIALIZER_H
@@ -0,0 +1,74 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <module.h>
+#include <optimizer.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Pcs are stored in 16 bits in function values and frames
+#define ENCODED_CAPACITY (INT16_MAX + 1)
+
+// Function defined by top-level code, encoded on its first call
+typedef struct {
+  int32_t definer;
+  int32_t length;
+
+  // Compact pcs of the stub and of the body, -1 until encoded
+  int32_t stub;
+  int32_t pc;
+
+  // Whether the load-time passes ran over the body
+  bool passed;
+
+  // Instructions of the body executed in the layout profile
+  uint64_t executed;
+} LazyFunction;
+
+// What `encode` keeps besides `code`, `offsets` and `memo_pc` of the
+// program, for saving it, see `cache.h`
+typedef struct {
+  int32_t size;
+
+  // Instruction each byte of the compact code belongs to
+  int32_t *instructions;
+
+  LazyFunction *functions;
+  size_t num_functions;
+
+  // By global, NULL when not optimizing
+  InlineBody *inlinables;
+} Encoding;
+
+// Fills `code` and `offsets` of `des` with its top-level code. Functions
+// defined there are only optimized and encoded on their first call, their
+// stubs being `OP_Decode`. Offsets are -1 for code not encoded yet. With
+// a `profile` of executions by instruction, see `layout.h`, functions that
+// ran are encoded right away and blocks that did not moved out of the way.
+// The code ends with `Halt` then `MemoReturn`.
+void encode(Deserialized *des, bool optimized, const uint64_t *profile);
+
+// Encodes the functions not encoded yet, for saving the program. When
+// they do not all fit, returns false having encoded none of them.
+bool encode_all();
+
+Encoding encoding_state();
+
+// Carries on from `state`, saved along with the `code`, `offsets` and
+// `memo_pc` of `des`, instead of encoding the program again
+void encode_resume(Deserialized *des, Encoding state, bool optimized, const uint64_t *profile);
+
+// Encodes the body of lazy function `function` if needed, returning its pc
+int32_t encoding_decode(Module *module, int32_t function);
+
+// Index of the instruction a compact pc belongs to, -1 if none
+int32_t encoded_instruction(int32_t pc);
+
+static inline int16_t read_operand(const uint8_t *code) {
+  int16_t operand;
+  memcpy(&operand, code, sizeof(operand));
+  return operand;
+}
+
+#endif  // ENCODING_H
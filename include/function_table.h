@@ -0,0 +1,22 @@
+#ifndef FUNCTION_TABLE_H
+#define FUNCTION_TABLE_H
+
+#include <module.h>
+
+// A function body as found in the instruction stream, in words
+typedef struct {
+  int32_t start;
+  int32_t end;
+  char *name;
+} FunctionRange;
+
+typedef struct {
+  FunctionRange *ranges;
+  size_t num_ranges;
+} FunctionTable;
+
+FunctionTable function_table_new(Deserialized des);
+int32_t function_table_lookup(FunctionTable table, int32_t pc);
+void function_table_free(FunctionTable table);
+
+#endif  // FUNCTION_TABLE_H
@@ -0,0 +1,122 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define HEAP_TOP_SITES 10
+
+// Blocks freed by reference counting are kept per size for the next
+// allocation of the same size, up to HEAP_REUSE_DEPTH blocks of at most
+// HEAP_REUSE_SIZE bytes each
+#define HEAP_REUSE_SIZE 128
+#define HEAP_REUSE_DEPTH 64
+
+// Arena chunks, allocations above HEAP_ARENA_LARGE get one of their own
+#define HEAP_ARENA_CHUNK (1 << 20)
+#define HEAP_ARENA_LARGE (HEAP_ARENA_CHUNK / 4)
+
+// Every heap value allocation goes through heap_alloc so that it can be
+// accounted for. `type` is the ValueType of the value being built.
+
+extern bool heap_tracking;
+
+// Whether values allocated from now on are reference counted, see
+// `value_drop`
+extern bool heap_refcounting;
+
+// Whether allocations are bumped out of per-thread arenas, which are only
+// released as a whole. Frees are then no-ops.
+extern bool heap_arena;
+
+// Pc of the instruction currently allocating on this thread, -1 while
+// loading and after native calls
+extern _Thread_local int32_t heap_site;
+
+#define HEAP_SITE(pc) (heap_site = (pc))
+
+void heap_track_alloc(size_t size, int type);
+void heap_track_free(size_t size, int type);
+
+typedef struct {
+  void *blocks[HEAP_REUSE_DEPTH];
+  uint32_t count;
+} HeapReuse;
+
+// Indexed by size in words, per thread
+extern _Thread_local HeapReuse heap_reuse[HEAP_REUSE_SIZE / 8 + 1];
+
+typedef struct HeapChunk {
+  struct HeapChunk *previous;
+  size_t size;
+  size_t used;
+  _Alignas(16) char data[];
+} HeapChunk;
+
+// Chunk being bumped into by this thread, the most recent of its chain
+extern _Thread_local HeapChunk *heap_chunk;
+
+// Chunks of single large blocks, chained apart so that the current chunk
+// keeps its free space
+extern _Thread_local HeapChunk *heap_large;
+
+void *heap_arena_grow(size_t size);
+
+static inline void *heap_arena_alloc(size_t size) {
+  size = (size + 15) & ~(size_t) 15;
+
+  HeapChunk *chunk = heap_chunk;
+  if (chunk != NULL && chunk->size - chunk->used >= size) {
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+  }
+
+  return heap_arena_grow(size);
+}
+
+static inline void *heap_alloc(size_t size, int type) {
+  if (heap_tracking) heap_track_alloc(size, type);
+  if (heap_arena) return heap_arena_alloc(size);
+
+  if (heap_refcounting && size <= HEAP_REUSE_SIZE && size % 8 == 0) {
+    HeapReuse *reuse = &heap_reuse[size / 8];
+    if (reuse->count > 0) return reuse->blocks[--reuse->count];
+  }
+
+  return malloc(size);
+}
+
+static inline void heap_free(void *ptr, size_t size, int type) {
+  if (heap_tracking) heap_track_free(size, type);
+  if (!heap_arena) free(ptr);
+}
+
+// Frees a block of exactly `size` bytes or keeps it for reuse
+void heap_recycle(void *ptr, size_t size, int type);
+
+// Regions let embedders release what was allocated in between, on the
+// calling thread. Values allocated inside must not be used once it closes.
+// Chunks are per thread, so what parallel workers allocate meanwhile is
+// left alone.
+typedef struct {
+  HeapChunk *chunk;
+  size_t used;
+  HeapChunk *large;
+} HeapRegion;
+
+HeapRegion heap_region_open();
+void heap_region_close(HeapRegion region);
+
+// Releases every chunk of the calling thread
+void heap_arena_release();
+
+void heap_stats_start();
+// Sites are reported against the four-word instructions `offsets` maps into
+// the compact code
+void heap_stats_attach(int32_t *instrs, int32_t *offsets, size_t instr_count,
+                       size_t code_size);
+void heap_stats_report();
+
+#endif  // HEAP_H
\ No newline at end of file
@@ -3,6 +3,26 @@
 
 #include <module.h>
 
+typedef Value (*ComparisonFun)(Value, Value);
+
+// Indexed by the comparison operand of OP_Compare and OP_JumpElseRelCmp
+extern ComparisonFun comparison_table[];
+
+// Counts dispatched instructions when set before `run_interpreter`. The
+// computed goto loop counts in a register as it dispatches, the
+// tail-calling one has to go through an instrumented dispatch table.
+extern bool interpreter_counting;
+extern const bool interpreter_counting_instrumented;
+uint64_t interpreter_dispatched();
+
+// Runs the loop with type and bounds checks when set before
+// `run_interpreter`, the unchecked loop is for trusted bytecode
+extern bool interpreter_checked;
+
 void run_interpreter(Deserialized deserialized);
 
+// Calls a function value or closure from native code, on the stack of
+// `module`. Only valid once `run_interpreter` has started.
+Value interpreter_call(Module *module, Value callee, Value *args, size_t argc);
+
 #endif  // INTERPRETER_H
\ No newline at end of file
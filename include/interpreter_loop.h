@@ -0,0 +1,1326 @@
+// Opcode handlers of the interpreter loops, included by interpreter.c once
+// per loop. `CHECKED` compiles the type and bounds checks in and `LOOP`
+// names the instantiation, so there is no include guard.
+
+#if PLUME_TAIL_CALLS
+
+HANDLER(load_local) {
+  PUSH(locals[i1]);
+  NEXT(OP_LoadLocal);
+}
+
+HANDLER(store_local) {
+  POP(value);
+  locals[i1] = value;
+  NEXT(OP_StoreLocal);
+}
+
+HANDLER(load_constant) {
+  PUSH(module->constants[i1]);
+  NEXT(OP_LoadConstant);
+}
+
+HANDLER(load_global) {
+  DUP(module->stack->values[i1]);
+  PUSH(module->stack->values[i1]);
+  NEXT(OP_LoadGlobal);
+}
+
+HANDLER(store_global) {
+  POP(value);
+  DROP(module->stack->values[i1]);
+  module->stack->values[i1] = value;
+  NEXT(OP_StoreGlobal);
+}
+
+HANDLER(return) {
+  RETURN(tos);
+}
+
+HANDLER(compare) {
+  CHECK_FMT(known_comparison(i1), "Unknown comparison: %d", i1);
+  POP2(a, b);
+  tos = comparison_table[i1](a, b);
+  DROP(a);
+  DROP(b);
+  NEXT(OP_Compare);
+}
+
+HANDLER(and) {
+  POP2(a, b);
+  CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  tos = MAKE_INTEGER(a && b);
+  NEXT(OP_And);
+}
+
+HANDLER(or) {
+  POP2(a, b);
+  CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  tos = MAKE_INTEGER(a || b);
+  NEXT(OP_Or);
+}
+
+HANDLER(load_native) {
+  Value name = module->constants[i1];
+  CHECK(get_type(name) == TYPE_STRING, "Invalid native function name type");
+  PUSH(MAKE_INTEGER(i2));
+  PUSH(MAKE_INTEGER(i3));
+  PUSH(name);
+  NEXT(OP_LoadNative);
+}
+
+HANDLER(make_list) {
+  HEAP_SITE(PC());
+  Value list = MAKE_LIST(POP_N(i1), i1);
+  PUSH(list);
+  NEXT(OP_MakeList);
+}
+
+HANDLER(list_get) {
+  CHECK(get_type(tos) == TYPE_LIST, "Invalid list type");
+  HeapValue* l = GET_PTR(tos);
+  CHECK(i1 < l->length, "Index out of bounds");
+  tos = take_element(tos, l->as_ptr[i1]);
+  NEXT(OP_ListGet);
+}
+
+HANDLER(call) {
+  POP(callee);
+  CHECK(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
+
+  int32_t argc = i1;
+  ip += ENCODED_SIZE(OP_Call);
+  CALL(callee, argc);
+  DISPATCH();
+}
+
+HANDLER(jump_else_rel) {
+  POP(value);
+  CHECK(get_type(value) == TYPE_INTEGER, "Invalid value type");
+  ip += GET_INT(value) == 0 ? i1 : ENCODED_SIZE(OP_JumpElseRel);
+  DISPATCH();
+}
+
+HANDLER(type_of) {
+  Value value = tos;
+  tos = type_names[get_type(value)];
+  DROP(value);
+  NEXT(OP_TypeOf);
+}
+
+HANDLER(constructor_name) {
+  CHECK(get_type(tos) == TYPE_LIST, "Invalid constructor type");
+  tos = take_element(tos, GET_LIST(tos)[1]);
+  NEXT(OP_ConstructorName);
+}
+
+HANDLER(make_lambda) {
+  int32_t new_pc = PC() + ENCODED_SIZE(OP_MakeLambda);
+  PUSH(MAKE_FUNCTION(new_pc, i2));
+  ip += ENCODED_SIZE(OP_MakeLambda) + i1;
+  DISPATCH();
+}
+
+HANDLER(get_index) {
+  POP2(index, list);
+  CHECK(indexable(list), "Invalid list type");
+  CHECK(get_type(index) == TYPE_INTEGER, "Invalid index type");
+
+  HeapValue* l = GET_PTR(list);
+  CHECK(GET_INT(index) < l->length, "Index out of bounds");
+  tos = get_element(list, GET_INT(index));
+  NEXT(OP_GetIndex);
+}
+
+HANDLER(special) {
+  PUSH(MAKE_SPECIAL());
+  NEXT(OP_Special);
+}
+
+HANDLER(jump_rel) {
+  ip += i1;
+  DISPATCH();
+}
+
+HANDLER(slice) {
+  CHECK(indexable(tos), "Invalid list type");
+  HEAP_SITE(PC());
+  tos = list_slice(tos, i1);
+  NEXT(OP_Slice);
+}
+
+HANDLER(list_length) {
+  CHECK(indexable(tos), "Invalid list type");
+  Value list = tos;
+  tos = MAKE_INTEGER(GET_PTR(list)->length);
+  DROP(list);
+  NEXT(OP_ListLength);
+}
+
+HANDLER(halt) {
+  PLUME_PROBE0(halt);
+  halt = 1;
+  SPILL();
+  if (interpreter_counting) {
+    atomic_fetch_add_explicit(&dispatched, counted, memory_order_relaxed);
+    counted = 0;
+  }
+  return tos;
+}
+
+HANDLER(update) {
+  POP(var);
+  CHECK(get_type(var) == TYPE_MUTABLE, "Invalid mutable type");
+  POP(value);
+  mutable_update(var, value);
+  NEXT(OP_Update);
+}
+
+HANDLER(make_mutable) {
+  HEAP_SITE(PC());
+  tos = MAKE_MUTABLE(tos);
+  NEXT(OP_MakeMutable);
+}
+
+HANDLER(unmut) {
+  CHECK(get_type(tos) == TYPE_MUTABLE, "Invalid mutable type");
+  tos = take_element(tos, GET_MUTABLE(tos));
+  NEXT(OP_UnMut);
+}
+
+HANDLER(add) {
+  POP2(a, b);
+  CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  tos = MAKE_INTEGER(a + b);
+  NEXT(OP_Add);
+}
+
+HANDLER(sub) {
+  POP2(a, b);
+  CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  tos = MAKE_INTEGER(b - a);
+  NEXT(OP_Sub);
+}
+
+HANDLER(return_const) {
+  RETURN(module->constants[i1]);
+}
+
+HANDLER(add_const) {
+  Value b = module->constants[i1];
+  CHECK_FMT(get_type(tos) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(tos), type_of(b));
+  tos = MAKE_INTEGER(tos + b);
+  NEXT(OP_AddConst);
+}
+
+HANDLER(sub_const) {
+  Value b = module->constants[i1];
+  CHECK_FMT(get_type(tos) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(tos), type_of(b));
+  tos = MAKE_INTEGER(tos - b);
+  NEXT(OP_SubConst);
+}
+
+HANDLER(jump_else_rel_cmp) {
+  CHECK_FMT(known_comparison(i2), "Unknown comparison: %d", i2);
+  POP(a);
+  POP(b);
+
+  Value cmp = comparison_table[i2](a, b);
+  CHECK(get_type(cmp) == TYPE_INTEGER, "Expected integer");
+  DROP(a);
+  DROP(b);
+
+  ip += GET_INT(cmp) == 0 ? i1 : ENCODED_SIZE(OP_JumpElseRelCmp);
+  DISPATCH();
+}
+
+HANDLER(ijump_else_rel_cmp_constant) {
+  POP(a);
+  Value b = module->constants[i3];
+  uint32_t res;
+
+  CHECK(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers");
+
+  CHECK_FMT(known_comparison(i2), "Unknown comparison: %d", i2);
+  switch (i2) {
+    case CompareEqual: res = GET_INT(a) == GET_INT(b); break;
+    case CompareAnd: res = GET_INT(a) & GET_INT(b); break;
+    default: res = GET_INT(a) | GET_INT(b); break;
+  }
+
+  ip += res == 0 ? i1 : ENCODED_SIZE(OP_IJumpElseRelCmpConst);
+  DISPATCH();
+}
+
+HANDLER(call_global) {
+  Value callee = module->stack->values[i1];
+  CHECK(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
+  DUP(callee);
+
+  int32_t argc = i2;
+  ip += ENCODED_SIZE(OP_CallGlobal);
+  CALL(callee, argc);
+  DISPATCH();
+}
+
+HANDLER(call_local) {
+  Value callee = locals[i1];
+  CHECK(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
+  DUP(callee);
+
+  int32_t argc = i1;
+  ip += ENCODED_SIZE(OP_CallLocal);
+  CALL(callee, argc);
+  DISPATCH();
+}
+
+HANDLER(make_and_store_lambda) {
+  int32_t new_pc = PC() + ENCODED_SIZE(OP_MakeAndStoreLambda);
+  module->stack->values[i1] = MAKE_FUNCTION(new_pc, i3);
+  ip += ENCODED_SIZE(OP_MakeAndStoreLambda) + i2;
+  DISPATCH();
+}
+
+HANDLER(mul) {
+  POP2(a, b);
+  CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  tos = MAKE_INTEGER(a * b);
+  NEXT(OP_Mul);
+}
+
+HANDLER(mul_const) {
+  Value b = module->constants[i1];
+  CHECK_FMT(get_type(tos) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(tos), type_of(b));
+  tos = MAKE_INTEGER(tos * b);
+  NEXT(OP_MulConst);
+}
+
+HANDLER(make_closure) {
+  int32_t new_pc = PC() + ENCODED_SIZE(OP_MakeClosure);
+  Value code = MAKE_FUNCTION(new_pc, i2);
+
+  HEAP_SITE(PC());
+  Value closure = MAKE_CLOSURE(code, POP_N(i3), i3);
+  PUSH(closure);
+  ip += ENCODED_SIZE(OP_MakeClosure) + i1;
+  DISPATCH();
+}
+
+HANDLER(load_capture) {
+  Value closure = module->envs[module->locals_count - 1];
+  CHECK(get_type(closure) == TYPE_CLOSURE, "Invalid closure environment");
+  DUP(GET_CAPTURE(closure, i1));
+  PUSH(GET_CAPTURE(closure, i1));
+  NEXT(OP_LoadCapture);
+}
+
+HANDLER(make_constructor) {
+  HEAP_SITE(PC());
+  Value list = MAKE_LIST(POP_N(i1), i1);
+  SET_CONSTRUCTOR_TAG(list, i2);
+  PUSH(list);
+  NEXT(OP_MakeConstructor);
+}
+
+// See `case_switch`
+HANDLER(switch) {
+  POP(value);
+  uint32_t index;
+
+  if (i2 == SwitchTag) {
+    CHECK(IS_PTR(value), "Invalid constructor type");
+    index = GET_CONSTRUCTOR_TAG(value);
+  } else {
+    CHECK(get_type(value) == TYPE_INTEGER, "Invalid switch value type");
+    index = GET_INT(value);
+  }
+
+  DROP(value);
+  if (index >= (uint32_t) i1) index = i1;
+
+  const uint8_t* entry = ip + ENCODED_SIZE(OP_Switch) + index * ENCODED_SIZE(OP_JumpRel);
+  ip = entry + read_operand(entry + 1);
+  DISPATCH();
+}
+
+HANDLER(map_new) {
+  HEAP_SITE(PC());
+  PUSH(map_new(i1));
+  NEXT(OP_MapNew);
+}
+
+HANDLER(map_get) {
+  POP2(key, map);
+  CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+  Value value;
+  tos = map_get(map, key, &value) ? value : MAKE_SPECIAL();
+  DROP(key);
+  NEXT(OP_MapGet);
+}
+
+HANDLER(map_contains) {
+  POP2(key, map);
+  CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+  Value value;
+  tos = MAKE_INTEGER(map_get(map, key, &value));
+  DROP(key);
+  NEXT(OP_MapContains);
+}
+
+HANDLER(map_insert) {
+  POP(value);
+  POP2(key, map);
+  CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+  HEAP_SITE(PC());
+  tos = map_insert_owned(map, key, value);
+  NEXT(OP_MapInsert);
+}
+
+HANDLER(map_remove) {
+  POP2(key, map);
+  CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+  HEAP_SITE(PC());
+  tos = map_remove(map, key);
+  NEXT(OP_MapRemove);
+}
+
+HANDLER(map_size) {
+  CHECK(get_type(tos) == TYPE_MAP || get_type(tos) == TYPE_PMAP, "Invalid map type");
+  tos = MAKE_INTEGER(GET_PTR(tos)->length);
+  NEXT(OP_MapSize);
+}
+
+HANDLER(map_entries) {
+  CHECK(get_type(tos) == TYPE_MAP || get_type(tos) == TYPE_PMAP, "Invalid map type");
+  HEAP_SITE(PC());
+  tos = map_entries(tos);
+  NEXT(OP_MapEntries);
+}
+
+HANDLER(concat) {
+  POP2(b, a);
+  CHECK(get_type(a) == TYPE_STRING && get_type(b) == TYPE_STRING, "Expected strings");
+
+  HEAP_SITE(PC());
+  tos = concat_strings(a, b);
+  NEXT(OP_Concat);
+}
+
+HANDLER(builder_new) {
+  HEAP_SITE(PC());
+  PUSH(builder_new(i1));
+  NEXT(OP_BuilderNew);
+}
+
+HANDLER(builder_append) {
+  POP(string);
+  CHECK(get_type(tos) == TYPE_BUILDER, "Invalid string builder type");
+  CHECK(get_type(string) == TYPE_STRING, "Expected string");
+
+  HEAP_SITE(PC());
+  builder_append(tos, string);
+  DROP(string);
+  NEXT(OP_BuilderAppend);
+}
+
+HANDLER(builder_finish) {
+  CHECK(get_type(tos) == TYPE_BUILDER, "Invalid string builder type");
+  HEAP_SITE(PC());
+  Value builder = tos;
+  tos = builder_finish(builder);
+  DROP(builder);
+  NEXT(OP_BuilderFinish);
+}
+
+HANDLER(nop) {
+  NEXT(OP_Nop);
+}
+
+HANDLER(list_pick) {
+  Value value = list_pick(POP_N(i1), i1, i2);
+  PUSH(value);
+  NEXT(OP_ListPick);
+}
+
+HANDLER(move_local) {
+  PUSH(locals[i1]);
+  locals[i1] = MAKE_SPECIAL();
+  NEXT(OP_MoveLocal);
+}
+
+HANDLER(push_int) {
+  PUSH(MAKE_INTEGER((int32_t) i1));
+  NEXT(OP_PushInt);
+}
+
+HANDLER(add_int) {
+  CHECK_FMT(get_type(tos) == TYPE_INTEGER, "Expected integer, got %s", type_of(tos));
+  tos = MAKE_INTEGER(tos + (int32_t) i1);
+  NEXT(OP_AddInt);
+}
+
+HANDLER(sub_int) {
+  CHECK_FMT(get_type(tos) == TYPE_INTEGER, "Expected integer, got %s", type_of(tos));
+  tos = MAKE_INTEGER(tos - (int32_t) i1);
+  NEXT(OP_SubInt);
+}
+
+HANDLER(mul_int) {
+  CHECK_FMT(get_type(tos) == TYPE_INTEGER, "Expected integer, got %s", type_of(tos));
+  tos = MAKE_INTEGER(tos * (int32_t) i1);
+  NEXT(OP_MulInt);
+}
+
+HANDLER(return_int) {
+  RETURN(MAKE_INTEGER((int32_t) i1));
+}
+
+HANDLER(ijump_else_rel_cmp_int) {
+  POP(a);
+  uint32_t b = (uint32_t) (int32_t) i3;
+  uint32_t res;
+
+  CHECK(get_type(a) == TYPE_INTEGER, "Expected integer");
+
+  CHECK_FMT(known_comparison(i2), "Unknown comparison: %d", i2);
+  switch (i2) {
+    case CompareEqual: res = GET_INT(a) == b; break;
+    case CompareAnd: res = GET_INT(a) & b; break;
+    default: res = GET_INT(a) | b; break;
+  }
+
+  ip += res == 0 ? i1 : ENCODED_SIZE(OP_IJumpElseRelCmpInt);
+  DISPATCH();
+}
+
+HANDLER(dup_local) {
+  value_dup(locals[i1]);
+  PUSH(locals[i1]);
+  NEXT(OP_DupLocal);
+}
+
+// Stub of a function encoded on its first call, see `encode`
+HANDLER(decode) {
+  ip = module->code + encoding_decode(module, i1);
+  DISPATCH();
+}
+
+// Return of a memoized call, see `op_memo_call`
+HANDLER(memo_return) {
+  ip = module->code + memo_return(module, tos);
+  DISPATCH();
+}
+
+HANDLER(unknown) {
+  THROW_FMT("Unknown opcode: %d", op);
+  return MAKE_SPECIAL();
+}
+
+static const Dispatch LOOP(tail_handlers) = { {
+  TAIL(load_local), TAIL(store_local), TAIL(load_constant),
+  TAIL(load_global), TAIL(store_global), TAIL(return),
+  TAIL(compare), TAIL(and), TAIL(or), TAIL(load_native),
+  TAIL(make_list), TAIL(list_get), TAIL(call),
+  TAIL(jump_else_rel), TAIL(type_of), TAIL(constructor_name), TAIL(unknown),
+  TAIL(make_lambda), TAIL(get_index),
+  TAIL(special), TAIL(jump_rel), TAIL(slice), TAIL(list_length),
+  TAIL(halt), TAIL(update), TAIL(make_mutable), TAIL(unmut),
+  TAIL(add), TAIL(sub), TAIL(return_const), TAIL(add_const),
+  TAIL(sub_const), TAIL(jump_else_rel_cmp), TAIL(unknown), TAIL(unknown),
+  TAIL(ijump_else_rel_cmp_constant), TAIL(call_global),
+  TAIL(call_local), TAIL(make_and_store_lambda), TAIL(mul),
+  TAIL(mul_const), TAIL(make_closure), TAIL(load_capture),
+  TAIL(make_constructor), TAIL(switch), TAIL(map_new), TAIL(map_get),
+  TAIL(map_contains), TAIL(map_insert), TAIL(map_remove),
+  TAIL(map_size), TAIL(map_entries), TAIL(concat), TAIL(builder_new),
+  TAIL(builder_append), TAIL(builder_finish), TAIL(nop),
+  TAIL(list_pick), TAIL(move_local), TAIL(push_int), TAIL(add_int),
+  TAIL(sub_int), TAIL(mul_int), TAIL(return_int), TAIL(ijump_else_rel_cmp_int),
+  TAIL(dup_local), TAIL(decode), TAIL(unknown), TAIL(memo_return),
+} };
+
+HANDLER(profile) {
+  layout_count(PC());
+  MUSTTAIL return LOOP(tail_handlers).handlers[*ip](TAIL_ARGS);
+}
+
+// The layout profiler sends every opcode through `profile` first
+static const Dispatch LOOP(tail_profiling) = { { [0 ... OPCODE_COUNT - 1] = TAIL(profile) } };
+
+// Handlers have no register left to count in, so counting goes through
+// `count` before every opcode, then through `profile` when profiling the
+// layout too
+HANDLER(count) {
+  counted++;
+  const Dispatch* next = layout_counts != NULL ? &LOOP(tail_profiling) : &LOOP(tail_handlers);
+  MUSTTAIL return next->handlers[*ip](TAIL_ARGS);
+}
+
+static const Dispatch LOOP(tail_counting) = { { [0 ... OPCODE_COUNT - 1] = TAIL(count) } };
+
+static Value LOOP(interpret)(Module* module, uint8_t* bytecode, int32_t pc) {
+  // On an empty stack the cached top would alias the last global
+  if (module->stack->stack_pointer == BASE_POINTER) stack_push(module->stack, MAKE_SPECIAL());
+
+  Value* sp = module->stack->values + module->stack->stack_pointer;
+  const Dispatch* table = interpreter_counting ? &LOOP(tail_counting)
+                         : layout_counts != NULL ? &LOOP(tail_profiling) : &LOOP(tail_handlers);
+
+  return table->handlers[bytecode[pc]](module, bytecode + pc, sp, frame_locals(module), sp[-1], table);
+}
+
+#else
+
+static Value LOOP(interpret)(Module* module, uint8_t* bytecode, int32_t pc) {
+  uint64_t counter = 0;
+
+  // Jump offsets are in bytes of compact code
+  #define INCREASE_IP_BY(pc, x) (pc += (x))
+  #define NEXT(opcode) INCREASE_IP_BY(pc, ENCODED_SIZE(opcode))
+
+  // Dispatches are counted in a register, published on `Halt`
+  #define DISPATCH() do { counter++; goto *jmp_table[op]; } while (0)
+
+  #define op bytecode[pc]
+  #define i1 read_operand(&bytecode[pc + 1])
+  #define i2 read_operand(&bytecode[pc + 3])
+  #define i3 read_operand(&bytecode[pc + 5])
+
+  #define UNKNOWN &&case_unknown
+
+  void* handlers[] = { 
+    &&case_load_local, &&case_store_local, &&case_load_constant, 
+    &&case_load_global, &&case_store_global, &&case_return, 
+    &&case_compare, &&case_and, &&case_or, &&case_load_native, 
+    &&case_make_list, &&case_list_get, &&case_call, 
+    &&case_jump_else_rel, &&case_type_of, &&case_constructor_name, UNKNOWN,
+    &&case_make_lambda, &&case_get_index, 
+    &&case_special, &&case_jump_rel, &&case_slice, &&case_list_length,
+    &&case_halt, &&case_update, &&case_make_mutable, &&case_unmut, 
+    &&case_add, &&case_sub, &&case_return_const, &&case_add_const, 
+    &&case_sub_const, &&case_jump_else_rel_cmp, UNKNOWN, UNKNOWN, 
+    &&case_ijump_else_rel_cmp_constant, &&case_call_global,
+    &&case_call_local, &&case_make_and_store_lambda, &&case_mul,
+    &&case_mul_const, &&case_make_closure, &&case_load_capture,
+    &&case_make_constructor, &&case_switch, &&case_map_new, &&case_map_get,
+    &&case_map_contains, &&case_map_insert, &&case_map_remove,
+    &&case_map_size, &&case_map_entries, &&case_concat, &&case_builder_new,
+    &&case_builder_append, &&case_builder_finish, &&case_nop,
+    &&case_list_pick, &&case_move_local, &&case_push_int, &&case_add_int,
+    &&case_sub_int, &&case_mul_int, &&case_return_int,
+    &&case_ijump_else_rel_cmp_int, &&case_dup_local, &&case_decode, UNKNOWN,
+    &&case_memo_return };
+
+  // The layout profiler sends every opcode through `case_profile` first,
+  // leaving the plain dispatch untouched
+  void* profiling[OPCODE_COUNT];
+  for (int i = 0; i < OPCODE_COUNT; i++) profiling[i] = &&case_profile;
+
+  void** jmp_table = layout_counts != NULL ? profiling : handlers;
+
+  DISPATCH();
+
+  case_load_local: {
+    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
+
+    Value value = module->stack->values[locals + i1];
+    stack_push(module->stack, value);
+    NEXT(OP_LoadLocal);
+    DISPATCH();
+  }
+
+  case_store_local: {
+    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
+    module->stack->values[locals + i1] = stack_pop(module->stack);
+    NEXT(OP_StoreLocal);
+    DISPATCH();
+  }
+
+  case_load_constant: {
+    Value value = module->constants[i1];
+    stack_push(module->stack, value);
+    NEXT(OP_LoadConstant);
+    DISPATCH();
+  }
+
+  case_load_global: {
+    Value value = module->stack->values[i1];
+    DUP(value);
+    stack_push(module->stack, value);
+    NEXT(OP_LoadGlobal);
+    DISPATCH();
+  }
+  
+  case_store_global: {
+    DROP(module->stack->values[i1]);
+    module->stack->values[i1] = stack_pop(module->stack);
+    NEXT(OP_StoreGlobal);
+    DISPATCH();
+  }
+  
+  case_return: {
+    Frame fr = pop_frame(module);
+    Value ret = stack_pop(module->stack);
+    if (heap_refcounting) {
+      drop_frame(module, &module->stack->values[fr.stack_pointer],
+                 &module->stack->values[module->stack->stack_pointer]);
+    }
+
+    module->stack->stack_pointer = fr.stack_pointer;
+    module->base_pointer = fr.base_ptr;
+    stack_push(module->stack, ret);
+
+    pc = fr.instruction_pointer;
+    module->current_pc = pc;
+    DISPATCH();
+  }
+  
+  case_compare: {
+    CHECK_FMT(known_comparison(i1), "Unknown comparison: %d", i1);
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    stack_push(module->stack, comparison_table[i1](a, b));
+    DROP(a);
+    DROP(b);
+    NEXT(OP_Compare);
+    DISPATCH();
+  }
+  
+  case_and: {
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(a && b));
+    NEXT(OP_And);
+    DISPATCH();
+  }
+
+  case_or: {
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(a || b));
+    NEXT(OP_Or);
+    DISPATCH();
+  }
+
+  case_load_native: {
+    Value name = module->constants[i1];
+    CHECK(get_type(name) == TYPE_STRING, "Invalid native function name type");
+    stack_push(module->stack, MAKE_INTEGER(i2));
+    stack_push(module->stack, MAKE_INTEGER(i3));
+    stack_push(module->stack, name);
+    NEXT(OP_LoadNative);
+    DISPATCH();
+  }
+  
+  case_make_list: {
+    HEAP_SITE(pc);
+    Value list = MAKE_LIST(stack_pop_n(module->stack, i1), i1);
+    stack_push(module->stack, list);
+    NEXT(OP_MakeList);
+    DISPATCH();
+  }
+  
+  case_list_get: {
+    Value list = stack_pop(module->stack);
+    CHECK(get_type(list) == TYPE_LIST, "Invalid list type");
+    HeapValue* l = GET_PTR(list);
+    CHECK(i1 < l->length, "Index out of bounds");
+    stack_push(module->stack, take_element(list, l->as_ptr[i1]));
+    NEXT(OP_ListGet);
+    DISPATCH();
+  }
+  
+  case_call: {
+    Value callee = stack_pop(module->stack);
+
+    CHECK(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
+  
+    int32_t argc = i1;
+    NEXT(OP_Call);
+    CHECK_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack);
+    // The frame takes over the callee's reference
+    interpreter_table[(callee & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, argc);
+
+    DISPATCH();
+  }
+  
+  case_jump_else_rel: {
+    Value value = stack_pop(module->stack);
+    CHECK(get_type(value) == TYPE_INTEGER, "Invalid value type")
+    if (GET_INT(value) == 0) {
+      INCREASE_IP_BY(pc, i1);
+    } else {
+      NEXT(OP_JumpElseRel);
+    }
+    DISPATCH();
+  }
+  
+  case_type_of: {
+    Value value = stack_pop(module->stack);
+    stack_push(module->stack, type_names[get_type(value)]);
+    DROP(value);
+    NEXT(OP_TypeOf);
+    DISPATCH();
+  }
+
+  case_constructor_name: {
+    Value value = stack_pop(module->stack);
+    CHECK(get_type(value) == TYPE_LIST, "Invalid constructor type");
+    stack_push(module->stack, take_element(value, GET_LIST(value)[1]));
+    NEXT(OP_ConstructorName);
+    DISPATCH();
+  }
+
+  case_make_lambda: {
+    int32_t new_pc = pc + ENCODED_SIZE(OP_MakeLambda);
+    Value lambda = MAKE_FUNCTION(new_pc, i2);
+
+    stack_push(module->stack, lambda);
+    INCREASE_IP_BY(pc, ENCODED_SIZE(OP_MakeLambda) + i1);
+
+    DISPATCH();
+  }
+  
+  case_get_index: {
+    Value index = stack_pop(module->stack);
+    Value list = stack_pop(module->stack);
+    CHECK(indexable(list), "Invalid list type");
+    CHECK(get_type(index) == TYPE_INTEGER, "Invalid index type");
+
+    HeapValue* l = GET_PTR(list);
+    CHECK(GET_INT(index) < l->length, "Index out of bounds");
+    stack_push(module->stack, get_element(list, GET_INT(index)));
+    NEXT(OP_GetIndex);
+    DISPATCH();
+  }
+
+  case_special: {
+    stack_push(module->stack, MAKE_SPECIAL());
+    NEXT(OP_Special);
+    DISPATCH();
+  }
+
+  case_jump_rel: {
+    INCREASE_IP_BY(pc, i1);
+    DISPATCH();
+  }
+  
+  case_slice: {
+    Value list = stack_pop(module->stack);
+    CHECK(indexable(list), "Invalid list type");
+    HEAP_SITE(pc);
+    stack_push(module->stack, list_slice(list, i1));
+    NEXT(OP_Slice);
+    DISPATCH();
+  }
+
+  case_list_length: {
+    Value list = stack_pop(module->stack);
+    CHECK(indexable(list), "Invalid list type");
+    HeapValue* l = GET_PTR(list);
+    stack_push(module->stack, MAKE_INTEGER(l->length));
+    DROP(list);
+    NEXT(OP_ListLength);
+    DISPATCH();
+  }
+
+  case_halt: {
+    PLUME_PROBE0(halt);
+    halt = 1;
+    if (interpreter_counting) atomic_fetch_add_explicit(&dispatched, counter, memory_order_relaxed);
+    return module->stack->values[module->stack->stack_pointer - 1];
+  }
+
+  case_update: {
+    Value var = stack_pop(module->stack);
+    CHECK(get_type(var) == TYPE_MUTABLE, "Invalid mutable type");
+
+    Value value = stack_pop(module->stack);
+    mutable_update(var, value);
+    NEXT(OP_Update);
+    DISPATCH();
+  }
+
+  case_make_mutable: {
+    Value value = stack_pop(module->stack);
+    HEAP_SITE(pc);
+    Value mutable = MAKE_MUTABLE(value);
+    stack_push(module->stack, mutable);
+    NEXT(OP_MakeMutable);
+    DISPATCH();
+  }
+
+  case_unmut: {
+    Value value = stack_pop(module->stack);
+    CHECK(get_type(value) == TYPE_MUTABLE, "Invalid mutable type");
+    stack_push(module->stack, take_element(value, GET_MUTABLE(value)));
+    NEXT(OP_UnMut);
+    DISPATCH();
+  }
+    
+  case_add: {
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(a + b));
+    NEXT(OP_Add);
+    DISPATCH();
+  }
+
+  case_sub: {
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(b - a));
+    NEXT(OP_Sub);
+    DISPATCH();
+  }
+
+  case_return_const: {
+    Frame fr = pop_frame(module);
+    if (heap_refcounting) {
+      drop_frame(module, &module->stack->values[fr.stack_pointer],
+                 &module->stack->values[module->stack->stack_pointer]);
+    }
+    module->stack->stack_pointer = fr.stack_pointer;
+    module->base_pointer = fr.base_ptr;
+
+    stack_push(module->stack, module->constants[i1]);
+
+    pc = fr.instruction_pointer;
+    module->current_pc = pc;
+
+    DISPATCH();
+  }
+
+  case_add_const: {
+    Value a = stack_pop(module->stack);
+    Value b = module->constants[i1];
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(a + b));
+    NEXT(OP_AddConst);
+    DISPATCH();
+  }
+
+  case_sub_const: {
+    Value a = stack_pop(module->stack);
+    Value b = module->constants[i1];
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+    stack_push(module->stack, MAKE_INTEGER(a - b));
+    NEXT(OP_SubConst);
+    DISPATCH();
+  }
+
+  case_jump_else_rel_cmp: {
+    CHECK_FMT(known_comparison(i2), "Unknown comparison: %d", i2);
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    Value cmp = comparison_table[i2](a, b);
+    CHECK(get_type(cmp) == TYPE_INTEGER, "Expected integer");
+    DROP(a);
+    DROP(b);
+
+    if (GET_INT(cmp) == 0) {
+      INCREASE_IP_BY(pc, i1);
+    } else {
+      NEXT(OP_JumpElseRelCmp);
+    }
+
+    DISPATCH();
+  }
+
+  case_ijump_else_rel_cmp_constant: {
+    Value a = stack_pop(module->stack);
+    Value b = module->constants[i3];
+
+    CHECK(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers");
+    CHECK_FMT(known_comparison(i2), "Unknown comparison: %d", i2);
+
+    void* icomparison_table[] = { 
+      UNKNOWN, UNKNOWN, &&icmp_eq, UNKNOWN, 
+      UNKNOWN, &&icmp_and, &&icmp_or };
+
+    uint32_t res;
+
+    goto *icomparison_table[i2];
+
+    icmp_eq: { res = GET_INT(a) == GET_INT(b); goto next; }
+    icmp_and: { res = GET_INT(a) & GET_INT(b); goto next; }
+    icmp_or: { res = GET_INT(a) | GET_INT(b); goto next; }
+
+    next: {
+      INCREASE_IP_BY(pc, (uint32_t) res == 0 ? i1 : ENCODED_SIZE(OP_IJumpElseRelCmpConst));
+      DISPATCH();
+    }
+  }
+
+  case_call_global: {
+    Value callee = module->stack->values[i1];
+
+    CHECK(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
+    DUP(callee);
+  
+    int32_t argc = i2;
+    NEXT(OP_CallGlobal);
+    CHECK_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack);
+    interpreter_table[(callee & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, argc);
+
+    DISPATCH();
+  }
+
+  case_call_local: {
+    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
+
+    Value callee = module->stack->values[locals + i1];
+
+    CHECK(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
+    DUP(callee);
+  
+    int32_t argc = i1;
+    NEXT(OP_CallLocal);
+    CHECK_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack);
+    interpreter_table[(callee & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, argc);
+
+    DISPATCH();
+  }
+
+  case_make_and_store_lambda: {
+    int32_t new_pc = pc + ENCODED_SIZE(OP_MakeAndStoreLambda);
+    Value lambda = MAKE_FUNCTION(new_pc, i3);
+
+    module->stack->values[i1] = lambda;
+
+    INCREASE_IP_BY(pc, ENCODED_SIZE(OP_MakeAndStoreLambda) + i2);
+    DISPATCH();
+  }
+
+  case_mul: {
+    Value a = stack_pop(module->stack);
+    Value b = stack_pop(module->stack);
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(a * b));
+    NEXT(OP_Mul);
+    DISPATCH();
+  }
+
+  case_mul_const: {
+    Value a = stack_pop(module->stack);
+    Value b = module->constants[i1];
+
+    CHECK_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+
+    stack_push(module->stack, MAKE_INTEGER(a * b));
+    NEXT(OP_MulConst);
+    DISPATCH();
+  }
+
+  case_make_closure: {
+    int32_t new_pc = pc + ENCODED_SIZE(OP_MakeClosure);
+    Value code = MAKE_FUNCTION(new_pc, i2);
+
+    HEAP_SITE(pc);
+    Value closure = MAKE_CLOSURE(code, stack_pop_n(module->stack, i3), i3);
+    stack_push(module->stack, closure);
+    INCREASE_IP_BY(pc, ENCODED_SIZE(OP_MakeClosure) + i1);
+
+    DISPATCH();
+  }
+
+  case_load_capture: {
+    Value closure = module->envs[module->locals_count - 1];
+    CHECK(get_type(closure) == TYPE_CLOSURE, "Invalid closure environment");
+    DUP(GET_CAPTURE(closure, i1));
+    stack_push(module->stack, GET_CAPTURE(closure, i1));
+    NEXT(OP_LoadCapture);
+    DISPATCH();
+  }
+
+  case_make_constructor: {
+    HEAP_SITE(pc);
+    Value list = MAKE_LIST(stack_pop_n(module->stack, i1), i1);
+    SET_CONSTRUCTOR_TAG(list, i2);
+    stack_push(module->stack, list);
+    NEXT(OP_MakeConstructor);
+    DISPATCH();
+  }
+
+  // Followed by i1 + 1 `JumpRel` entries, the last one being the default.
+  // The selected entry's offset is read directly instead of dispatching it.
+  case_switch: {
+    Value value = stack_pop(module->stack);
+    uint32_t index;
+
+    if (i2 == SwitchTag) {
+      CHECK(IS_PTR(value), "Invalid constructor type");
+      index = GET_CONSTRUCTOR_TAG(value);
+    } else {
+      CHECK(get_type(value) == TYPE_INTEGER, "Invalid switch value type");
+      index = GET_INT(value);
+    }
+
+    DROP(value);
+    if (index >= (uint32_t) i1) index = i1;
+
+    int32_t entry = pc + ENCODED_SIZE(OP_Switch) + index * ENCODED_SIZE(OP_JumpRel);
+    pc = entry + read_operand(&bytecode[entry + 1]);
+    DISPATCH();
+  }
+
+  case_map_new: {
+    HEAP_SITE(pc);
+    stack_push(module->stack, map_new(i1));
+    NEXT(OP_MapNew);
+    DISPATCH();
+  }
+
+  case_map_get: {
+    Value key = stack_pop(module->stack);
+    Value map = stack_pop(module->stack);
+    CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+    Value value;
+    if (!map_get(map, key, &value)) value = MAKE_SPECIAL();
+    stack_push(module->stack, value);
+    DROP(key);
+    NEXT(OP_MapGet);
+    DISPATCH();
+  }
+
+  case_map_contains: {
+    Value key = stack_pop(module->stack);
+    Value map = stack_pop(module->stack);
+    CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+    Value value;
+    stack_push(module->stack, MAKE_INTEGER(map_get(map, key, &value)));
+    DROP(key);
+    NEXT(OP_MapContains);
+    DISPATCH();
+  }
+
+  // Mutable maps are updated in place, persistent ones return a new map
+  case_map_insert: {
+    Value value = stack_pop(module->stack);
+    Value key = stack_pop(module->stack);
+    Value map = stack_pop(module->stack);
+    CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+    HEAP_SITE(pc);
+    stack_push(module->stack, map_insert_owned(map, key, value));
+    NEXT(OP_MapInsert);
+    DISPATCH();
+  }
+
+  case_map_remove: {
+    Value key = stack_pop(module->stack);
+    Value map = stack_pop(module->stack);
+    CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+    HEAP_SITE(pc);
+    stack_push(module->stack, map_remove(map, key));
+    NEXT(OP_MapRemove);
+    DISPATCH();
+  }
+
+  case_map_size: {
+    Value map = stack_pop(module->stack);
+    CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+    stack_push(module->stack, MAKE_INTEGER(GET_PTR(map)->length));
+    NEXT(OP_MapSize);
+    DISPATCH();
+  }
+
+  case_map_entries: {
+    Value map = stack_pop(module->stack);
+    CHECK(get_type(map) == TYPE_MAP || get_type(map) == TYPE_PMAP, "Invalid map type");
+
+    HEAP_SITE(pc);
+    stack_push(module->stack, map_entries(map));
+    NEXT(OP_MapEntries);
+    DISPATCH();
+  }
+
+  case_concat: {
+    Value b = stack_pop(module->stack);
+    Value a = stack_pop(module->stack);
+    CHECK(get_type(a) == TYPE_STRING && get_type(b) == TYPE_STRING, "Expected strings");
+
+    HEAP_SITE(pc);
+    stack_push(module->stack, concat_strings(a, b));
+    NEXT(OP_Concat);
+    DISPATCH();
+  }
+
+  case_builder_new: {
+    HEAP_SITE(pc);
+    stack_push(module->stack, builder_new(i1));
+    NEXT(OP_BuilderNew);
+    DISPATCH();
+  }
+
+  case_builder_append: {
+    Value string = stack_pop(module->stack);
+    Value builder = module->stack->values[module->stack->stack_pointer - 1];
+    CHECK(get_type(builder) == TYPE_BUILDER, "Invalid string builder type");
+    CHECK(get_type(string) == TYPE_STRING, "Expected string");
+
+    HEAP_SITE(pc);
+    builder_append(builder, string);
+    DROP(string);
+    NEXT(OP_BuilderAppend);
+    DISPATCH();
+  }
+
+  case_builder_finish: {
+    Value builder = stack_pop(module->stack);
+    CHECK(get_type(builder) == TYPE_BUILDER, "Invalid string builder type");
+
+    HEAP_SITE(pc);
+    stack_push(module->stack, builder_finish(builder));
+    DROP(builder);
+    NEXT(OP_BuilderFinish);
+    DISPATCH();
+  }
+
+  case_nop: {
+    NEXT(OP_Nop);
+    DISPATCH();
+  }
+
+  case_list_pick: {
+    Value* values = stack_pop_n(module->stack, i1);
+    Value value = list_pick(values, i1, i2);
+    stack_push(module->stack, value);
+    NEXT(OP_ListPick);
+    DISPATCH();
+  }
+
+  case_move_local: {
+    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
+
+    stack_push(module->stack, module->stack->values[locals + i1]);
+    module->stack->values[locals + i1] = MAKE_SPECIAL();
+    NEXT(OP_MoveLocal);
+    DISPATCH();
+  }
+
+  case_push_int: {
+    stack_push(module->stack, MAKE_INTEGER((int32_t) i1));
+    NEXT(OP_PushInt);
+    DISPATCH();
+  }
+
+  case_add_int: {
+    Value a = stack_pop(module->stack);
+    CHECK_FMT(get_type(a) == TYPE_INTEGER, "Expected integer, got %s", type_of(a));
+    stack_push(module->stack, MAKE_INTEGER(a + (int32_t) i1));
+    NEXT(OP_AddInt);
+    DISPATCH();
+  }
+
+  case_sub_int: {
+    Value a = stack_pop(module->stack);
+    CHECK_FMT(get_type(a) == TYPE_INTEGER, "Expected integer, got %s", type_of(a));
+    stack_push(module->stack, MAKE_INTEGER(a - (int32_t) i1));
+    NEXT(OP_SubInt);
+    DISPATCH();
+  }
+
+  case_mul_int: {
+    Value a = stack_pop(module->stack);
+    CHECK_FMT(get_type(a) == TYPE_INTEGER, "Expected integer, got %s", type_of(a));
+    stack_push(module->stack, MAKE_INTEGER(a * (int32_t) i1));
+    NEXT(OP_MulInt);
+    DISPATCH();
+  }
+
+  case_return_int: {
+    Frame fr = pop_frame(module);
+    if (heap_refcounting) {
+      drop_frame(module, &module->stack->values[fr.stack_pointer],
+                 &module->stack->values[module->stack->stack_pointer]);
+    }
+    module->stack->stack_pointer = fr.stack_pointer;
+    module->base_pointer = fr.base_ptr;
+
+    stack_push(module->stack, MAKE_INTEGER((int32_t) i1));
+
+    pc = fr.instruction_pointer;
+    module->current_pc = pc;
+
+    DISPATCH();
+  }
+
+  case_ijump_else_rel_cmp_int: {
+    Value a = stack_pop(module->stack);
+    uint32_t b = (uint32_t) (int32_t) i3;
+    uint32_t res;
+
+    CHECK(get_type(a) == TYPE_INTEGER, "Expected integer");
+
+    CHECK_FMT(known_comparison(i2), "Unknown comparison: %d", i2);
+    switch (i2) {
+      case CompareEqual: res = GET_INT(a) == b; break;
+      case CompareAnd: res = GET_INT(a) & b; break;
+      default: res = GET_INT(a) | b; break;
+    }
+
+    INCREASE_IP_BY(pc, res == 0 ? i1 : ENCODED_SIZE(OP_IJumpElseRelCmpInt));
+    DISPATCH();
+  }
+
+  case_dup_local: {
+    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
+
+    Value value = module->stack->values[locals + i1];
+    value_dup(value);
+    stack_push(module->stack, value);
+    NEXT(OP_DupLocal);
+    DISPATCH();
+  }
+
+  // Stub of a function encoded on its first call, see `encode`
+  case_decode: {
+    pc = encoding_decode(module, i1);
+    DISPATCH();
+  }
+
+  // Return of a memoized call, see `op_memo_call`
+  case_memo_return: {
+    pc = memo_return(module, module->stack->values[module->stack->stack_pointer - 1]);
+    DISPATCH();
+  }
+
+  case_profile: {
+    layout_count(pc);
+    goto *handlers[op];
+  }
+
+  case_unknown: {
+    THROW_FMT("Unknown opcode: %d", op);
+    return MAKE_SPECIAL();
+  }
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <module.h>
+#include <stdint.h>
+
+// Profile-guided layout of the compact code. A profiling run counts how
+// often each instruction executes and writes the counts out by
+// instruction, which stay valid as long as the program does not change.
+// Loading the program with them, `encode` puts functions that ran first,
+// hottest first, and moves blocks of their bodies that never ran after
+// the others.
+
+// Counts by compact pc while profiling, NULL otherwise
+extern uint64_t *layout_counts;
+
+static inline void layout_count(int32_t pc) {
+  if (layout_counts != NULL) __atomic_fetch_add(&layout_counts[pc], 1, __ATOMIC_RELAXED);
+}
+
+// Sends every dispatch through the interpreter's profiling table from the
+// next `run_interpreter` on
+void layout_profile_start();
+
+// Writes the counts by instruction of `des` to `path`
+void layout_profile_write(Deserialized des, const char *path);
+
+// Counts by instruction read back from `path`, for a program of
+// `instr_count` instructions
+uint64_t *layout_profile_read(const char *path, size_t instr_count);
+
+#endif  // LAYOUT_H
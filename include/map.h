@@ -0,0 +1,60 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <value.h>
+
+// TYPE_MAP is a mutable open-addressing table probed in groups of
+// MAP_GROUP_WIDTH control bytes, Swiss-table style. TYPE_PMAP is a
+// persistent hash array mapped trie whose updates copy only the path to
+// the changed entry. Both are keyed by any Value, compared structurally.
+
+#define MAP_GROUP_WIDTH 8
+#define MAP_MIN_CAPACITY 8
+
+#define HAMT_BITS 5
+#define HAMT_MAX_SHIFT 60
+
+typedef struct {
+  Value key;
+  Value value;
+} MapEntry;
+
+// Inline payload of a TYPE_MAP heap value
+typedef struct {
+  uint8_t *ctrl;
+  MapEntry *entries;
+  uint32_t capacity;
+  uint32_t growth_left;
+} Map;
+
+// Inner node of a TYPE_PMAP. Below HAMT_MAX_SHIFT, `bitmap` tells which
+// of the 32 hash slices are present; past it the node is a collision
+// bucket and `bitmap` is the entry count. Child entries have their key set
+// to HAMT_CHILD and the node pointer in `value`.
+typedef struct {
+  uint32_t bitmap;
+  MapEntry entries[];
+} HamtNode;
+
+#define HAMT_CHILD (SIGNATURE_FUNCENV | MASK_PAYLOAD_PTR)
+
+#define GET_MAP(x) ((Map*) GET_PTR(x)->as_ptr)
+#define GET_HAMT(x) ((HamtNode*) (uintptr_t) GET_PTR(x)->as_ptr[0])
+
+uint64_t hash_value(Value value);
+bool values_equal(Value a, Value b);
+
+Value map_new(bool persistent);
+bool map_get(Value map, Value key, Value *out);
+Value map_insert(Value map, Value key, Value value);
+Value map_remove(Value map, Value key);
+Value map_entries(Value map);
+
+// Calls `visit` on every entry, in the order of `map_entries`, without
+// allocating
+typedef void (*MapVisitor)(Value key, Value value, void *data);
+void map_each(Value map, MapVisitor visit, void *data);
+
+#endif  // MAP_H
\ No newline at end of file
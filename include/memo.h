@@ -0,0 +1,38 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <module.h>
+#include <stdbool.h>
+#include <value.h>
+
+// Memoized functions are closures tagged CLOSURE_MEMOIZED, whose calls are
+// looked up in a bounded cache keyed on the closure and its arguments.
+// Arguments hash and compare structurally, as map keys do. Each thread has
+// its own cache, a colliding entry replaces the previous one.
+
+#define MEMO_CACHE_SIZE (1 << 14)
+
+// Calls with more arguments always run the function
+#define MEMO_MAX_ARGS 4
+
+// Memoized call running in a frame, cached on return to `pc`. The closure
+// is frozen, the arguments are counted for as long as the call runs.
+typedef struct MemoCall {
+  Value callee;
+  Value args[MEMO_MAX_ARGS];
+  size_t argc;
+  int32_t pc;
+} MemoCall;
+
+// memoize(f): f as a closure whose results are cached. f must be pure.
+Value memoize(int argc, Module *module, Value *args);
+
+bool memo_lookup(Value callee, Value *args, size_t argc, Value *out);
+
+// Keeps `args` and `result` alive for as long as the cache holds them
+void memo_store(Value callee, Value *args, size_t argc, Value result);
+
+// Hits and misses over all threads, printed with --stats
+void memo_report();
+
+#endif  // MEMO_H
@@ -13,6 +13,9 @@ typedef struct Module {
   size_t base_pointer;
   size_t callstack;
 
+  // Last call or return target, read by the sampling profiler
+  volatile int32_t current_pc;
+
   Constants constants;
   Stack *stack;
   struct {
@@ -25,16 +28,54 @@ typedef struct Module {
 
   size_t *locals;
   size_t locals_count;
+
+  // Closure of each frame, only written when a closure is called
+  Value *envs;
+
+  // Shared compact program and the pc of its final `Halt`, which calls
+  // made from natives return to
+  uint8_t *code;
+  int32_t halt_pc;
+
+  // Pc of `MemoReturn` and the memoized calls waiting for their result
+  int32_t memo_pc;
+  struct MemoCall *memo_calls;
+  size_t memo_count;
 } Module;
 
 typedef Value (*Native)(int argc, Module *m, Value *args);
 
 typedef struct {
   Module *module;
+  size_t constant_count;
   Libraries libraries;
+  FunctionNames names;
   
   size_t instr_count;
   int32_t *instrs;
+
+  // Whether the program runs without the checks of the checked loop, see
+  // BYTECODE_TRUSTED
+  bool trusted;
+
+  // Compact encoding run by the interpreter, see `encode`
+  uint8_t *code;
+  int32_t *offsets;
+  int32_t memo_pc;
 } Deserialized;
 
+// Library name under which the compiler references natives built into
+// the VM
+#define BUILTIN_LIBRARY "builtin"
+
+Module *module_new(Constants constants, size_t num_libraries);
+void module_load_libraries(Module *module, Libraries libraries);
+
+// A module with its own stacks and frames sharing the program, constants
+// and natives of `parent`, for running Plume code on another thread
+Module *module_fork(Module *parent);
+
+// Resolves a native on first use and caches it in `module->natives`
+Native module_native(Module *module, int32_t lib, int32_t index, char *name);
+
 #endif  // MODULE_H
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <function_table.h>
+#include <module.h>
+
+// Shared view of the instruction stream for load-time passes. Indices are
+// in instructions, not words.
+typedef struct {
+  int32_t *instrs;
+  size_t instr_count;
+
+  Constants constants;
+  size_t constant_count;
+
+  FunctionTable functions;
+  int32_t *owners;
+  bool *targets;
+} Analysis;
+
+#define INSTR(a, idx) (&(a)->instrs[(idx) * 4])
+
+Analysis analysis_new(Deserialized des);
+void analysis_free(Analysis *analysis);
+
+// Global functions whose calls are replaced by their body: a single block
+// that consumes its arguments in order, calls nothing and returns once
+#define INLINE_MAX_LENGTH 8
+
+typedef struct {
+  // Instructions between the argument loads and the `Return`, start is -1
+  // when the function is not inlinable
+  int32_t start;
+  int32_t length;
+  int32_t arity;
+} InlineBody;
+
+size_t escape_analysis(Analysis *analysis);
+size_t ownership_analysis(Analysis *analysis);
+size_t constant_folding(Analysis *analysis);
+size_t inline_calls(Analysis *analysis, InlineBody *bodies);
+
+void optimize(Deserialized des);
+
+// Inlinable bodies by global, from code no pass has run on yet
+InlineBody *inlinables_new(Deserialized des);
+
+// Turns calls to inlinable globals into `OP_Inline`, expanded by the encoder
+void optimize_calls(Deserialized des, InlineBody *bodies);
+
+// Marks last uses of locals for reference counting, needed whether
+// optimizing or not
+void optimize_ownership(Deserialized des);
+
+#endif  // OPTIMIZER_H
\ No newline at end of file
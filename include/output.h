@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <value.h>
+
+// Printed values are formatted straight into a buffer owned by the VM, one
+// per thread, which is handed to stdout in a single call when full and at
+// the end of each print. Going through stdout keeps the order with natives
+// and errors that print on their own.
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+// Strings from this length on are handed to stdout without being copied
+#define OUTPUT_DIRECT_LENGTH (1 << 12)
+
+// Buffer of stdout when it is not a terminal, so that it is written in
+// large chunks
+#define OUTPUT_STDOUT_SIZE (1 << 16)
+
+void output_start();
+
+void output_bytes(const char *data, size_t length);
+void output_int(int64_t value);
+void output_float(double value);
+void output_value(Value value);
+
+// Hands the buffer to stdout
+void output_flush();
+
+// Writes out everything printed so far, at halt
+void output_finish();
+
+#endif  // OUTPUT_H
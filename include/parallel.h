@@ -0,0 +1,28 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <module.h>
+#include <value.h>
+
+// Builtin natives applying a Plume function to the elements of a list on
+// a pool of worker threads. Each worker runs a forked module with its own
+// stacks and frames over the shared program and constants. The pool has
+// $PLUME_THREADS threads, defaulting to the number of online cores.
+
+// Lists shorter than this are processed on the calling thread
+#define PARALLEL_MIN_LENGTH 64
+
+// Chunks per thread, more chunks balance uneven element costs
+#define PARALLEL_CHUNKS_PER_THREAD 4
+
+// parallel_map(list, f): [f(x) for x in list]
+Value parallel_map(int argc, Module *module, Value *args);
+
+// parallel_filter(list, f): elements for which f returns a non-zero integer
+Value parallel_filter(int argc, Module *module, Value *args);
+
+// parallel_fold(list, f, initial): f must be associative, chunks are folded
+// independently and their results combined left to right
+Value parallel_fold(int argc, Module *module, Value *args);
+
+#endif  // PARALLEL_H
@@ -0,0 +1,14 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <function_table.h>
+#include <module.h>
+
+#define PROFILER_INTERVAL_US 1000
+#define PROFILER_MAX_DEPTH 64
+#define PROFILER_MAX_STACKS 4096
+
+void profiler_start(Deserialized des, const char *output);
+void profiler_stop();
+
+#endif  // PROFILER_H
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef ROPE_H
+#define ROPE_H
+
+#include <stdint.h>
+#include <value.h>
+
+// Concatenations shorter than this are copied into a flat string
+#define ROPE_MIN_LENGTH 64
+#define BUILDER_MIN_CAPACITY 64
+
+// Inline payload of a TYPE_BUILDER value, `length` in the header is the
+// number of bytes written so far
+typedef struct {
+  char *data;
+  uint32_t capacity;
+} StringBuilder;
+
+// The payload of a builder is never accessed as the Value array the
+// header declares, only through this pointer
+static inline StringBuilder* heap_builder(HeapValue* v) {
+  return (StringBuilder*) (void*) v->as_ptr;
+}
+
+#define GET_BUILDER(x) heap_builder(GET_PTR(x))
+
+Value string_concat(Value a, Value b);
+
+Value builder_new(uint32_t capacity);
+void builder_append(Value builder, Value string);
+Value builder_finish(Value builder);
+
+#endif  // ROPE_H
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef SERIALIZER_H
+#define SERIALIZER_H
+
+#include <module.h>
+#include <stdio.h>
+
+// Writes `des` in the sectioned format, see deserializer.h
+void serialize(Deserialized des, FILE *file);
+
+#endif  // SERIALIZER_H
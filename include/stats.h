@@ -0,0 +1,38 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware counters read through perf_event_open, attributed to the phases
+// of a run. Counters the kernel refuses are reported as unavailable, wall
+// time and the dispatch count are always reported.
+
+typedef enum {
+  PHASE_DESERIALIZE,
+  PHASE_LIBRARIES,
+  PHASE_EXECUTE,
+  PHASE_COUNT,
+} StatsPhase;
+
+typedef enum {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_L1D_MISSES,
+  COUNTER_LLC_MISSES,
+  COUNTER_ITLB_MISSES,
+  COUNTER_COUNT,
+} StatsCounter;
+
+// Opens the counters and starts the first phase
+void stats_start();
+
+// Ends the current phase and starts `phase`
+void stats_phase(StatsPhase phase);
+
+// `instrumented` when the dispatches were counted by an instrumented loop,
+// whose overhead the counters then include
+void stats_report(uint64_t dispatched, bool instrumented);
+
+#endif  // STATS_H
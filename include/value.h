@@ -1,8 +1,11 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <core/probes.h>
+#include <heap.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 typedef uint64_t Value;
 
 // Masks for important segments of a float value
@@ -54,9 +57,15 @@ typedef enum {
   TYPE_FUNCTION,
   TYPE_FUNCENV,
   TYPE_CLOSURE,
+  TYPE_MAP,
+  TYPE_PMAP,
+  TYPE_BUILDER,
+  TYPE_ARRAY,
   TYPE_UNKNOWN,
 } ValueType;
 
+char *type_name(ValueType type);
+
 // Container for arrays
 typedef struct {
   Value* data;
@@ -68,67 +77,106 @@ typedef struct {
   uint32_t length;
 } String;
 
-// Container type for values
+// Container type for values. The payload is stored inline after the
+// header: list, mutable and closure elements as Values, string bytes
+// NUL-terminated.
 typedef struct {
-  ValueType type;
+  uint16_t type;
+  // Constructor tag of ADT values plus one, see `GET_CONSTRUCTOR_TAG`, string
+  // representation of strings
+  uint16_t tag;
   uint32_t length;
+  // References to the value with reference counting on, 0 when immortal
+  uint32_t refcount;
 
-  union {
-    char* as_string;
-    Value* as_ptr;
-  };
+  Value as_ptr[];
 } HeapValue;
 
 #define MAKE_INTEGER(x) (SIGNATURE_INTEGER | (uint32_t) (x))
 #define MAKE_FLOAT(x) (*(Value*)(&(x)))
 #define MAKE_PTR(x) ( SIGNATURE_POINTER | (uint64_t) (x))
 
-typedef Value Closure[2];
-
 #define MAKE_FUNCTION(x, y) (SIGNATURE_FUNCTION | (uint64_t) (x) | ((uint64_t) (y) << 16))
 #define MAKE_FUNCENV(pc, sp, bp) (SIGNATURE_FUNCENV | (uint64_t) (pc) | ((uint64_t) (sp) << 16) | ((uint64_t) (bp) << 32))
 
-static inline Value MAKE_STRING(char* x, uint32_t len) {
-  HeapValue* v = malloc(sizeof(HeapValue));
-  v->length = len;
-  v->type = TYPE_STRING;
-  v->as_string = x;
+// Allocates a header followed by `payload` bytes in a single block
+static inline HeapValue* MAKE_HEAP(ValueType type, uint32_t length, size_t payload) {
+  HeapValue* v = heap_alloc(sizeof(HeapValue) + payload, type);
+  v->length = length;
+  v->type = type;
+  v->tag = 0;
+  v->refcount = heap_refcounting;
+  PLUME_PROBE2(alloc, type, sizeof(HeapValue) + payload);
+  return v;
+}
+
+static inline Value MAKE_STRING(const char* x, uint32_t len) {
+  HeapValue* v = MAKE_HEAP(TYPE_STRING, len, len + 1);
+  char* data = (char*) v->as_ptr;
+  memcpy(data, x, len);
+  data[len] = '\0';
   return MAKE_PTR(v);
 }
 
-static inline Value MAKE_CLOSURE(reg pc, reg bp) {
-  Closure clos = { pc, bp };
-  HeapValue* v = malloc(sizeof(HeapValue));
-  v->length = 2;
-  v->type = TYPE_CLOSURE;
-  v->as_ptr = clos;
+// Flat closure: the function value followed by the captured values
+static inline Value MAKE_CLOSURE(Value code, const Value* captures, uint32_t count) {
+  HeapValue* v = MAKE_HEAP(TYPE_CLOSURE, count + 1, (count + 1) * sizeof(Value));
+  v->as_ptr[0] = code;
+  memcpy(&v->as_ptr[1], captures, count * sizeof(Value));
   return MAKE_PTR(v);
 }
 
-static inline Value MAKE_LIST(Value* x, uint32_t len) {
-  HeapValue* v = malloc(sizeof(HeapValue));
-  v->length = len;
-  v->type = TYPE_LIST;
-  v->as_ptr = x;
+static inline Value MAKE_LIST(const Value* x, uint32_t len) {
+  HeapValue* v = MAKE_HEAP(TYPE_LIST, len, len * sizeof(Value));
+  memcpy(v->as_ptr, x, len * sizeof(Value));
   return MAKE_PTR(v);
 }
 
 static inline Value MAKE_MUTABLE(Value x) {
-  HeapValue* v = malloc(sizeof(HeapValue));
-  v->length = 1;
-  v->type = TYPE_MUTABLE;
-  v->as_ptr = &x;
+  HeapValue* v = MAKE_HEAP(TYPE_MUTABLE, 1, sizeof(Value));
+  v->as_ptr[0] = x;
   return MAKE_PTR(v);
 }
 
+// Closures wrapped by `memoize` answer repeated calls from a cache
+#define CLOSURE_MEMOIZED 1
+
+// Strings are either flat NUL-terminated bytes, concatenation nodes
+// holding [left, right, flattened copy or 0] or views holding [parent or 0,
+// address of the first byte, flattened copy or 0]
+#define STRING_FLAT 0
+#define STRING_ROPE 1
+#define STRING_VIEW 2
+
+char* string_flatten(Value string);
+
+static inline char* get_string(Value x) {
+  HeapValue* v = (HeapValue*) (x & MASK_PAYLOAD_PTR);
+  return v->tag == STRING_FLAT ? (char*) v->as_ptr : string_flatten(x);
+}
+
+// The `length` bytes of a string without copying views, which are not
+// NUL-terminated
+static inline const char* string_bytes(Value x) {
+  HeapValue* v = (HeapValue*) (x & MASK_PAYLOAD_PTR);
+  return v->tag == STRING_VIEW ? (const char*) (uintptr_t) v->as_ptr[1] : get_string(x);
+}
+
 #define MAKE_SPECIAL() kNull
 #define MAKE_ADDRESS(x) MAKE_INTEGER(x)
 #define MAKE_NATIVE(x) MAKE_STRING(x, strlen(x))
 
 #define GET_PTR(x) ((HeapValue*)((x) & MASK_PAYLOAD_PTR))
-#define GET_STRING(x) GET_PTR(x)->as_string
+#define GET_STRING(x) get_string(x)
 #define GET_LIST(x) GET_PTR(x)->as_ptr
-#define GET_MUTABLE(x) *(GET_PTR(x)->as_ptr)
+#define GET_MUTABLE(x) GET_PTR(x)->as_ptr[0]
+#define GET_CLOSURE_CODE(x) GET_PTR(x)->as_ptr[0]
+#define GET_CAPTURE(x, n) GET_PTR(x)->as_ptr[(n) + 1]
+
+// Lists built by `MakeConstructor` store their tag plus one, so that plain
+// lists, at 0, are not taken for the first constructor. -1 for those.
+#define GET_CONSTRUCTOR_TAG(x) ((int32_t) GET_PTR(x)->tag - 1)
+#define SET_CONSTRUCTOR_TAG(x, t) (GET_PTR(x)->tag = (uint16_t) ((t) + 1))
 
 #define GET_INT(x) ((x) & MASK_PAYLOAD_INT)
 #define GET_FLOAT(x) (*(double*)(&(x)))
@@ -139,6 +187,30 @@ static inline Value MAKE_MUTABLE(Value x) {
 #define IS_PTR(x) (((x) & MASK_SIGNATURE) == SIGNATURE_POINTER)
 #define IS_FUN(x) (((x) & MASK_SIGNATURE) == SIGNATURE_FUNCTION)
 
+// Reference counting, Perceus style: every copy of a reference is a dup
+// and every reference going away a drop, so that a value whose count is
+// one can be updated in place. Values allocated while loading, or handed
+// to code that does not count (natives, maps, other threads), are frozen
+// immortal along with everything they reference. Missing drops only leak.
+void value_release(HeapValue* v);
+void value_freeze(Value value);
+
+static inline void value_dup(Value value) {
+  if (!IS_PTR(value)) return;
+  HeapValue* v = GET_PTR(value);
+  if (v->refcount != 0) v->refcount++;
+}
+
+static inline void value_drop(Value value) {
+  if (!IS_PTR(value)) return;
+  HeapValue* v = GET_PTR(value);
+  if (v->refcount != 0 && --v->refcount == 0) value_release(v);
+}
+
+static inline bool value_unique(Value value) {
+  return IS_PTR(value) && GET_PTR(value)->refcount == 1;
+}
+
 static inline ValueType get_type(Value value) {
   uint64_t signature = value & MASK_SIGNATURE;
   if ((~value & MASK_EXPONENT) != 0) return TYPE_FLOAT;
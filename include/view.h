@@ -0,0 +1,30 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <module.h>
+#include <stdint.h>
+#include <value.h>
+
+// String views reference bytes of another string or of a mapped file
+// instead of copying them. They keep their parent alive, views of views
+// point into the original parent. Mapped files stay mapped for the whole
+// run and have no parent.
+
+// Slices shorter than this are copied into a flat string
+#define VIEW_MIN_LENGTH 32
+
+// Bytes `start` to `start + length` of `string`, which must be in bounds
+Value string_view(Value string, uint32_t start, uint32_t length);
+
+// file_map(path): the content of the file as a string, read as it is
+// accessed. Files must be smaller than 4 GiB.
+Value file_map(int argc, Module *module, Value *args);
+
+// string_split(string, separator): the pieces between separators, the
+// separator must not be empty
+Value string_split(int argc, Module *module, Value *args);
+
+// substring(string, start, length)
+Value substring(int argc, Module *module, Value *args);
+
+#endif  // VIEW_H
@@ -0,0 +1,53 @@
+#include <aot.h>
+#include <core/probes.h>
+#include <heap.h>
+#include <module.h>
+#include <output.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+static Value type_names[TYPE_UNKNOWN + 1];
+
+Module* aot_start(int argc, char** argv, Constants constants, Libraries libraries) {
+  Module* module = module_new(constants, libraries.num_libraries);
+  output_start();
+
+  module->argc = argc;
+  module->argv = malloc(argc * sizeof(Value));
+  for (int i = 0; i < argc; i++) {
+    module->argv[i] = MAKE_STRING(argv[i], strlen(argv[i]));
+  }
+
+  for (int i = 0; i <= TYPE_UNKNOWN; i++) {
+    char* name = type_name(i);
+    type_names[i] = MAKE_STRING(name, strlen(name));
+  }
+
+  module_load_libraries(module, libraries);
+
+  return module;
+}
+
+Value aot_native(Module* module, int32_t lib, int32_t index, Value name,
+                 Value* args, size_t argc) {
+  char* fun = GET_NATIVE(name);
+  Native native = module_native(module, lib, index, fun);
+
+  PLUME_PROBE2(native__entry, fun, argc);
+  Value ret = native(argc, module, args);
+  PLUME_PROBE2(native__return, fun, argc);
+
+  return ret;
+}
+
+Value aot_type_of(Value value) {
+  return type_names[get_type(value)];
+}
+
+_Noreturn void aot_halt(Module* module) {
+  (void) module;
+  PLUME_PROBE0(halt);
+  output_finish();
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,349 @@
+#include <array.h>
+#include <core/error.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+static const char *kind_names[] = { "int32", "int64", "float64", "byte" };
+
+Value array_new(uint16_t kind, uint32_t length) {
+  HeapValue *array = MAKE_HEAP(TYPE_ARRAY, length, length * array_element_size(kind));
+  array->tag = kind;
+  return MAKE_PTR(array);
+}
+
+static Value box_float(double value) {
+  return MAKE_FLOAT(value);
+}
+
+static Value box_int64(int64_t value) {
+  return value >= INT32_MIN && value <= INT32_MAX ? MAKE_INTEGER(value) : box_float(value);
+}
+
+Value array_get(Value array, uint32_t index) {
+  void *data = GET_ARRAY(array);
+
+  switch (GET_PTR(array)->tag) {
+    case ARRAY_INT32:
+      return MAKE_INTEGER(((int32_t *) data)[index]);
+    case ARRAY_INT64:
+      return box_int64(((int64_t *) data)[index]);
+    case ARRAY_FLOAT64:
+      return box_float(((double *) data)[index]);
+    default:
+      return MAKE_INTEGER(((uint8_t *) data)[index]);
+  }
+}
+
+Value array_slice(Value array, uint32_t from) {
+  HeapValue *a = GET_PTR(array);
+  size_t size = array_element_size(a->tag);
+
+  Value slice = array_new(a->tag, a->length - from);
+  memcpy(GET_ARRAY(slice), (char *) GET_ARRAY(array) + from * size, (a->length - from) * size);
+  return slice;
+}
+
+static int64_t to_int64(Value value) {
+  switch (get_type(value)) {
+    case TYPE_INTEGER:
+      return (int32_t) GET_INT(value);
+    case TYPE_FLOAT:
+      return (int64_t) GET_FLOAT(value);
+    default:
+      THROW_FMT("Expected a number, got %s", type_of(value));
+  }
+}
+
+static double to_double(Value value) {
+  switch (get_type(value)) {
+    case TYPE_INTEGER:
+      return (int32_t) GET_INT(value);
+    case TYPE_FLOAT:
+      return GET_FLOAT(value);
+    default:
+      THROW_FMT("Expected a number, got %s", type_of(value));
+  }
+}
+
+static HeapValue *expect_array(Value value, const char *native) {
+  if (get_type(value) != TYPE_ARRAY)
+    THROW_FMT("%s expects a typed array, got %s", native, type_of(value));
+  return GET_PTR(value);
+}
+
+Value array_from(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "array_from expects a kind and a list");
+  (void) argc;
+  (void) module;
+  char *name = GET_STRING(args[0]);
+  Value source = args[1];
+
+  uint16_t kind = 0;
+  while (kind <= ARRAY_BYTE && strcmp(kind_names[kind], name) != 0) kind++;
+  if (kind > ARRAY_BYTE) THROW_FMT("Unknown array kind: %s", name);
+
+  ValueType type = get_type(source);
+  if (type != TYPE_LIST && type != TYPE_ARRAY)
+    THROW_FMT("array_from expects a list or an array, got %s", type_of(source));
+
+  uint32_t length = GET_PTR(source)->length;
+  Value array = array_new(kind, length);
+  void *data = GET_ARRAY(array);
+
+  for (uint32_t i = 0; i < length; i++) {
+    Value element = type == TYPE_LIST ? GET_LIST(source)[i] : array_get(source, i);
+
+    switch (kind) {
+      case ARRAY_INT32:
+        ((int32_t *) data)[i] = to_int64(element);
+        break;
+      case ARRAY_INT64:
+        ((int64_t *) data)[i] = to_int64(element);
+        break;
+      case ARRAY_FLOAT64:
+        ((double *) data)[i] = to_double(element);
+        break;
+      case ARRAY_BYTE:
+        ((uint8_t *) data)[i] = to_int64(element);
+        break;
+    }
+  }
+
+  return array;
+}
+
+Value array_to_list(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "array_to_list expects an array");
+  (void) argc;
+  (void) module;
+  HeapValue *array = expect_array(args[0], "array_to_list");
+
+  HeapValue *list = MAKE_HEAP(TYPE_LIST, array->length, array->length * sizeof(Value));
+  for (uint32_t i = 0; i < array->length; i++) list->as_ptr[i] = array_get(args[0], i);
+
+  return MAKE_PTR(list);
+}
+
+// Reductions keep ARRAY_LANES partial results over consecutive elements,
+// the remainder going to the first lane. Integers are summed modulo 2^64.
+#define DEFINE_SUM(name, type, wide)                                 \
+  static wide name(const type *data, uint32_t length) {             \
+    wide lanes[ARRAY_LANES] = { 0 };                                 \
+    uint32_t i = 0;                                                  \
+    for (; i + ARRAY_LANES <= length; i += ARRAY_LANES) {            \
+      for (int k = 0; k < ARRAY_LANES; k++) lanes[k] += data[i + k]; \
+    }                                                                \
+    for (; i < length; i++) lanes[0] += data[i];                     \
+                                                                     \
+    wide sum = 0;                                                    \
+    for (int k = 0; k < ARRAY_LANES; k++) sum += lanes[k];           \
+    return sum;                                                      \
+  }
+
+DEFINE_SUM(sum_int32, int32_t, uint64_t)
+DEFINE_SUM(sum_int64, int64_t, uint64_t)
+DEFINE_SUM(sum_float64, double, double)
+DEFINE_SUM(sum_byte, uint8_t, uint64_t)
+
+Value array_sum(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "array_sum expects an array");
+  (void) argc;
+  (void) module;
+  HeapValue *array = expect_array(args[0], "array_sum");
+  void *data = GET_ARRAY(args[0]);
+
+  switch (array->tag) {
+    case ARRAY_INT32:
+      return box_int64(sum_int32(data, array->length));
+    case ARRAY_INT64:
+      return box_int64(sum_int64(data, array->length));
+    case ARRAY_FLOAT64:
+      return box_float(sum_float64(data, array->length));
+    default:
+      return box_int64(sum_byte(data, array->length));
+  }
+}
+
+// `data` must not be empty
+#define DEFINE_EXTREMUM(name, type, better)                                  \
+  static type name(const type *data, uint32_t length) {                     \
+    type lanes[ARRAY_LANES];                                                 \
+    for (int k = 0; k < ARRAY_LANES; k++) lanes[k] = data[0];                \
+                                                                             \
+    uint32_t i = 0;                                                          \
+    for (; i + ARRAY_LANES <= length; i += ARRAY_LANES) {                    \
+      for (int k = 0; k < ARRAY_LANES; k++) {                                \
+        lanes[k] = data[i + k] better lanes[k] ? data[i + k] : lanes[k];     \
+      }                                                                      \
+    }                                                                        \
+    for (; i < length; i++) lanes[0] = data[i] better lanes[0] ? data[i] : lanes[0]; \
+                                                                             \
+    type result = lanes[0];                                                  \
+    for (int k = 1; k < ARRAY_LANES; k++) {                                  \
+      result = lanes[k] better result ? lanes[k] : result;                   \
+    }                                                                        \
+    return result;                                                           \
+  }
+
+DEFINE_EXTREMUM(min_int32, int32_t, <)
+DEFINE_EXTREMUM(min_int64, int64_t, <)
+DEFINE_EXTREMUM(min_float64, double, <)
+DEFINE_EXTREMUM(min_byte, uint8_t, <)
+DEFINE_EXTREMUM(max_int32, int32_t, >)
+DEFINE_EXTREMUM(max_int64, int64_t, >)
+DEFINE_EXTREMUM(max_float64, double, >)
+DEFINE_EXTREMUM(max_byte, uint8_t, >)
+
+static Value extremum(Value value, bool max, const char *native) {
+  HeapValue *array = expect_array(value, native);
+  if (array->length == 0) THROW_FMT("%s of an empty array", native);
+  void *data = GET_ARRAY(value);
+
+  switch (array->tag) {
+    case ARRAY_INT32:
+      return MAKE_INTEGER(max ? max_int32(data, array->length) : min_int32(data, array->length));
+    case ARRAY_INT64:
+      return box_int64(max ? max_int64(data, array->length) : min_int64(data, array->length));
+    case ARRAY_FLOAT64:
+      return box_float(max ? max_float64(data, array->length) : min_float64(data, array->length));
+    default:
+      return MAKE_INTEGER(max ? max_byte(data, array->length) : min_byte(data, array->length));
+  }
+}
+
+Value array_min(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "array_min expects an array");
+  (void) argc;
+  (void) module;
+  return extremum(args[0], false, "array_min");
+}
+
+Value array_max(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "array_max expects an array");
+  (void) argc;
+  (void) module;
+  return extremum(args[0], true, "array_max");
+}
+
+typedef void (*Kernel)(void *out, const void *a, const void *b, Value scalar, uint32_t length);
+
+// out = a op b, or a op scalar when `b` is NULL. Integers are computed
+// unsigned so that they wrap.
+#define DEFINE_KERNEL(name, type, wide, convert, op)                                 \
+  static void name(void *out_, const void *a_, const void *b_, Value scalar_,        \
+                   uint32_t length) {                                                \
+    type *restrict out = out_;                                                       \
+    const type *a = a_;                                                              \
+    const type *b = b_;                                                              \
+                                                                                     \
+    if (b != NULL) {                                                                 \
+      for (uint32_t i = 0; i < length; i++) out[i] = (type) ((wide) a[i] op (wide) b[i]); \
+      return;                                                                        \
+    }                                                                                \
+                                                                                     \
+    wide scalar = (wide) convert(scalar_);                                           \
+    for (uint32_t i = 0; i < length; i++) out[i] = (type) ((wide) a[i] op scalar);   \
+  }
+
+#define DEFINE_KERNELS(name, op)                                    \
+  DEFINE_KERNEL(name##_int32, int32_t, uint32_t, to_int64, op)      \
+  DEFINE_KERNEL(name##_int64, int64_t, uint64_t, to_int64, op)      \
+  DEFINE_KERNEL(name##_float64, double, double, to_double, op)      \
+  DEFINE_KERNEL(name##_byte, uint8_t, uint32_t, to_int64, op)       \
+  static const Kernel name##_kernels[] = {                          \
+    name##_int32, name##_int64, name##_float64, name##_byte         \
+  };
+
+DEFINE_KERNELS(add, +)
+DEFINE_KERNELS(sub, -)
+DEFINE_KERNELS(mul, *)
+
+static Value elementwise(Value *args, const Kernel *kernels, const char *native) {
+  HeapValue *a = expect_array(args[0], native);
+  const void *b = NULL;
+
+  if (get_type(args[1]) == TYPE_ARRAY) {
+    HeapValue *other = GET_PTR(args[1]);
+    if (other->tag != a->tag || other->length != a->length)
+      THROW_FMT("%s expects arrays of the same kind and length", native);
+    b = GET_ARRAY(args[1]);
+  }
+
+  Value result = array_new(a->tag, a->length);
+  kernels[a->tag](GET_ARRAY(result), GET_ARRAY(args[0]), b, args[1], a->length);
+  return result;
+}
+
+Value array_add(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "array_add expects two operands");
+  (void) argc;
+  (void) module;
+  return elementwise(args, add_kernels, "array_add");
+}
+
+Value array_sub(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "array_sub expects two operands");
+  (void) argc;
+  (void) module;
+  return elementwise(args, sub_kernels, "array_sub");
+}
+
+Value array_mul(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "array_mul expects two operands");
+  (void) argc;
+  (void) module;
+  return elementwise(args, mul_kernels, "array_mul");
+}
+
+// Blocks of ARRAY_LANES elements are tested at once, the matching one is
+// then scanned for the first match
+#define DEFINE_FIND(name, type)                                       \
+  static int64_t name(const type *data, uint32_t length, type x) {    \
+    uint32_t i = 0;                                                   \
+    for (; i + ARRAY_LANES <= length; i += ARRAY_LANES) {             \
+      int found = 0;                                                  \
+      for (int k = 0; k < ARRAY_LANES; k++) found |= data[i + k] == x; \
+      if (found) break;                                               \
+    }                                                                 \
+                                                                      \
+    for (; i < length; i++) {                                         \
+      if (data[i] == x) return i;                                     \
+    }                                                                 \
+    return -1;                                                        \
+  }
+
+DEFINE_FIND(find_int32, int32_t)
+DEFINE_FIND(find_int64, int64_t)
+DEFINE_FIND(find_float64, double)
+DEFINE_FIND(find_byte, uint8_t)
+
+Value array_find(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "array_find expects an array and a value");
+  (void) argc;
+  (void) module;
+  HeapValue *array = expect_array(args[0], "array_find");
+  void *data = GET_ARRAY(args[0]);
+  double x = to_double(args[1]);
+
+  if (array->tag == ARRAY_FLOAT64) return MAKE_INTEGER(find_float64(data, array->length, x));
+
+  // Integer arrays only hold integers of their range
+  if (!(x >= -0x1p63 && x < 0x1p63)) return MAKE_INTEGER(-1);
+  int64_t integer = (int64_t) x;
+  if (integer != x) return MAKE_INTEGER(-1);
+
+  switch (array->tag) {
+    case ARRAY_INT32:
+      if (integer < INT32_MIN || integer > INT32_MAX) return MAKE_INTEGER(-1);
+      return MAKE_INTEGER(find_int32(data, array->length, integer));
+    case ARRAY_INT64:
+      return MAKE_INTEGER(find_int64(data, array->length, integer));
+    default:
+      if (integer < 0 || integer > UINT8_MAX) return MAKE_INTEGER(-1);
+      return MAKE_INTEGER(find_byte(data, array->length, integer));
+  }
+}
@@ -0,0 +1,22 @@
+#include <bytecode.h>
+
+static const char *opcode_names[] = {
+  "LoadLocal", "StoreLocal", "LoadConstant", "LoadGlobal", "StoreGlobal",
+  "Return", "Compare", "And", "Or", "LoadNative", "MakeList", "ListGet",
+  "Call", "JumpElseRel", "TypeOf", "ConstructorName", "Phi", "MakeLambda",
+  "GetIndex", "Special", "JumpRel", "Slice", "ListLength", "Halt", "Update",
+  "MakeMutable", "UnMut", "Add", "Sub", "ReturnConst", "AddConst",
+  "SubConst", "JumpElseRelCmp", "IJumpElseRelCmp", "JumpElseRelCmpConst",
+  "IJumpElseRelCmpConst", "CallGlobal", "CallLocal", "MakeAndStoreLambda",
+  "Mul", "MulConst", "MakeClosure", "LoadCapture",
+  "MakeConstructor", "Switch", "MapNew", "MapGet", "MapContains", "MapInsert",
+  "MapRemove", "MapSize", "MapEntries", "Concat", "BuilderNew",
+  "BuilderAppend", "BuilderFinish", "Nop", "ListPick", "MoveLocal", "PushInt",
+  "AddInt", "SubInt", "MulInt", "ReturnInt", "IJumpElseRelCmpInt", "DupLocal",
+  "Decode", "Inline", "MemoReturn",
+};
+
+const char *opcode_name(int32_t opcode) {
+  if (opcode < 0 || opcode >= OPCODE_COUNT) return "Unknown";
+  return opcode_names[opcode];
+}
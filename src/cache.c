@@ -0,0 +1,440 @@
+#include <bytecode.h>
+#include <cache.h>
+#include <core/error.h>
+#include <encoding.h>
+#include <module.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Distinguishes images written by different builds of the VM, overridable
+// by the build for reproducible IDs
+#ifndef PLUME_BUILD_ID
+#define PLUME_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint64_t build;
+  uint64_t size;
+
+  uint32_t constant_count;
+  uint32_t library_count;
+  uint32_t name_count;
+  uint32_t binding_count;
+  uint32_t instr_count;
+  uint32_t trusted;
+
+  // Compact code, see `Encoding`
+  uint32_t code_size;
+  int32_t memo_pc;
+  uint32_t function_count;
+  uint32_t inlinable_count;
+
+  // Section offsets from the start of the image
+  uint64_t constants;
+  uint64_t libraries;
+  uint64_t names;
+  uint64_t bindings;
+  uint64_t instrs;
+  uint64_t code;
+  uint64_t offsets;
+  uint64_t instructions;
+  uint64_t functions;
+  uint64_t inlinables;
+} CacheHeader;
+
+typedef struct {
+  uint64_t name;
+  uint32_t num_functions;
+  uint32_t is_standard;
+} CachedLibrary;
+
+typedef struct {
+  int32_t pc;
+  uint32_t reserved;
+  uint64_t name;
+} CachedName;
+
+// String constants are laid out as heap values inside the image, their
+// entries in the constant pool hold the offset with the pointer signature
+// until relocated against the mapping
+#define RELOCATABLE(offset) (SIGNATURE_POINTER | (offset))
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  return hash;
+}
+
+static uint64_t build_id(void) {
+  uint64_t hash = fnv1a(0xcbf29ce484222325ull, PLUME_BUILD_ID, strlen(PLUME_BUILD_ID));
+  int32_t layout[] = { CACHE_VERSION, OPCODE_COUNT, sizeof(Value), sizeof(HeapValue) };
+  return fnv1a(hash, layout, sizeof(layout));
+}
+
+static uint64_t hash_file(uint64_t hash, FILE *file) {
+  char buffer[8192];
+  size_t read;
+
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    hash = fnv1a(hash, buffer, read);
+  }
+
+  return hash;
+}
+
+uint64_t cache_key(FILE *file, bool optimized, bool refcounting, const char *layout) {
+  uint64_t hash = hash_file(build_id(), file);
+  rewind(file);
+
+  bool options[] = { optimized, refcounting, layout != NULL };
+  hash = fnv1a(hash, options, sizeof(options));
+
+  // A missing profile fails loading later on
+  FILE *profile = layout != NULL ? fopen(layout, "r") : NULL;
+  if (profile != NULL) {
+    hash = hash_file(hash, profile);
+    fclose(profile);
+  }
+
+  return hash;
+}
+
+#ifndef _WIN32
+
+static char *cache_dir(bool create) {
+  char *dir = getenv("PLUME_CACHE_DIR");
+  char *base = NULL;
+  char *suffix = "";
+
+  if (dir == NULL && (base = getenv("XDG_CACHE_HOME")) != NULL) {
+    suffix = "/plume";
+  } else if (dir == NULL && (base = getenv("HOME")) != NULL) {
+    suffix = "/.cache/plume";
+  } else if (dir == NULL) {
+    return NULL;
+  }
+
+  if (dir == NULL) {
+    dir = malloc(strlen(base) + strlen(suffix) + 1);
+    sprintf(dir, "%s%s", base, suffix);
+  } else {
+    dir = strdup(dir);
+  }
+
+  // mkdir -p, existing components are fine
+  if (create) {
+    for (char *p = dir + 1; *p; p++) {
+      if (*p != '/') continue;
+      *p = '\0';
+      mkdir(dir, 0755);
+      *p = '/';
+    }
+    mkdir(dir, 0755);
+  }
+
+  return dir;
+}
+
+static char *cache_path(uint64_t key, bool create) {
+  char *dir = cache_dir(create);
+  if (dir == NULL) return NULL;
+
+  char *path = malloc(strlen(dir) + 32);
+  sprintf(path, "%s/%016llx.plmc", dir, (unsigned long long) key);
+  free(dir);
+
+  return path;
+}
+
+static bool is_image(const char *name) {
+  size_t length = strlen(name);
+  return length > 5 && strcmp(name + length - 5, ".plmc") == 0;
+}
+
+// Removes the least recently used images until the rest fit in
+// CACHE_MAX_SIZE. Loads touch their image, see `cache_load`.
+static void cache_evict(void) {
+  char *dir = cache_dir(false);
+  if (dir == NULL) return;
+
+  DIR *handle = opendir(dir);
+  if (handle == NULL) {
+    free(dir);
+    return;
+  }
+
+  char *path = malloc(strlen(dir) + 256 + 2);
+  for (;;) {
+    uint64_t total = 0;
+    time_t oldest_time = 0;
+    char oldest[256] = "";
+
+    rewinddir(handle);
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+      if (!is_image(entry->d_name)) continue;
+
+      struct stat st;
+      sprintf(path, "%s/%s", dir, entry->d_name);
+      if (stat(path, &st) != 0) continue;
+
+      total += st.st_size;
+      if (oldest[0] == '\0' || st.st_mtime < oldest_time) {
+        oldest_time = st.st_mtime;
+        snprintf(oldest, sizeof(oldest), "%s", entry->d_name);
+      }
+    }
+
+    if (total <= CACHE_MAX_SIZE || oldest[0] == '\0') break;
+
+    sprintf(path, "%s/%s", dir, oldest);
+    if (remove(path) != 0) break;
+  }
+
+  free(path);
+  closedir(handle);
+  free(dir);
+}
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+} Buffer;
+
+// Returns the offset of `size` zeroed bytes, aligned for Values
+static uint64_t buffer_reserve(Buffer *buffer, size_t size) {
+  size_t offset = (buffer->size + 7) & ~(size_t) 7;
+
+  if (offset + size > buffer->capacity) {
+    while (offset + size > buffer->capacity) buffer->capacity *= 2;
+    buffer->data = realloc(buffer->data, buffer->capacity);
+  }
+
+  memset(buffer->data + buffer->size, 0, offset + size - buffer->size);
+  buffer->size = offset + size;
+
+  return offset;
+}
+
+static uint64_t buffer_string(Buffer *buffer, const char *string) {
+  size_t length = strlen(string);
+  uint64_t offset = buffer_reserve(buffer, length + 1);
+  memcpy(buffer->data + offset, string, length);
+  return offset;
+}
+
+#define AT(buffer, type, offset) ((type *) ((buffer).data + (offset)))
+
+void cache_store(uint64_t key, Deserialized des, Encoding encoding) {
+  char *path = cache_path(key, true);
+  if (path == NULL) return;
+
+  Buffer buffer = { malloc(4096), 0, 4096 };
+  buffer_reserve(&buffer, sizeof(CacheHeader));
+
+  uint64_t constants = buffer_reserve(&buffer, des.constant_count * sizeof(Value));
+  for (size_t i = 0; i < des.constant_count; i++) {
+    Value value = des.module->constants[i];
+
+    if (IS_PTR(value)) {
+      HeapValue *string = GET_PTR(value);
+      uint64_t offset = buffer_reserve(&buffer, sizeof(HeapValue) + string->length + 1);
+      memcpy(buffer.data + offset, string, sizeof(HeapValue) + string->length + 1);
+      value = RELOCATABLE(offset);
+    }
+
+    AT(buffer, Value, constants)[i] = value;
+  }
+
+  Libraries libs = des.libraries;
+  uint64_t libraries = buffer_reserve(&buffer, libs.num_libraries * sizeof(CachedLibrary));
+  for (size_t i = 0; i < libs.num_libraries; i++) {
+    uint64_t name = buffer_string(&buffer, libs.libraries[i].name);
+    AT(buffer, CachedLibrary, libraries)[i] = (CachedLibrary) {
+      name, libs.libraries[i].num_functions, libs.libraries[i].is_standard
+    };
+  }
+
+  uint64_t names = buffer_reserve(&buffer, des.names.num_names * sizeof(CachedName));
+  for (size_t i = 0; i < des.names.num_names; i++) {
+    uint64_t name = buffer_string(&buffer, des.names.names[i].name);
+    AT(buffer, CachedName, names)[i] = (CachedName) { des.names.names[i].pc, 0, name };
+  }
+
+  // One binding per distinct native, in order of first use
+  NativeBinding *found = malloc((des.instr_count + 1) * sizeof(NativeBinding));
+  uint32_t binding_count = 0;
+  for (size_t pc = 0; pc < des.instr_count * 4; pc += 4) {
+    if (des.instrs[pc] != OP_LoadNative) continue;
+
+    NativeBinding binding = { des.instrs[pc + 2], des.instrs[pc + 3], des.instrs[pc + 1] };
+    bool seen = false;
+    for (uint32_t i = 0; i < binding_count && !seen; i++) {
+      seen = found[i].lib == binding.lib && found[i].index == binding.index;
+    }
+    if (!seen) found[binding_count++] = binding;
+  }
+
+  uint64_t bindings = buffer_reserve(&buffer, binding_count * sizeof(NativeBinding));
+  memcpy(buffer.data + bindings, found, binding_count * sizeof(NativeBinding));
+  free(found);
+
+  // As the load-time passes left them, functions not encoded yet aside
+  uint64_t instrs = buffer_reserve(&buffer, des.instr_count * 4 * sizeof(int32_t));
+  memcpy(buffer.data + instrs, des.instrs, des.instr_count * 4 * sizeof(int32_t));
+
+  uint64_t code = buffer_reserve(&buffer, encoding.size);
+  memcpy(buffer.data + code, des.code, encoding.size);
+
+  uint64_t offsets = buffer_reserve(&buffer, (des.instr_count + 1) * sizeof(int32_t));
+  memcpy(buffer.data + offsets, des.offsets, (des.instr_count + 1) * sizeof(int32_t));
+
+  uint64_t instructions = buffer_reserve(&buffer, encoding.size * sizeof(int32_t));
+  memcpy(buffer.data + instructions, encoding.instructions, encoding.size * sizeof(int32_t));
+
+  size_t functions_size = encoding.num_functions * sizeof(LazyFunction);
+  uint64_t functions = buffer_reserve(&buffer, functions_size);
+  memcpy(buffer.data + functions, encoding.functions, functions_size);
+
+  uint32_t inlinable_count = encoding.inlinables != NULL ? GLOBALS_SIZE : 0;
+  uint64_t inlinables = buffer_reserve(&buffer, inlinable_count * sizeof(InlineBody));
+  if (inlinable_count > 0) {
+    memcpy(buffer.data + inlinables, encoding.inlinables, inlinable_count * sizeof(InlineBody));
+  }
+
+  *AT(buffer, CacheHeader, 0) = (CacheHeader) {
+    CACHE_MAGIC, CACHE_VERSION, key, build_id(), buffer.size,
+    des.constant_count, libs.num_libraries, des.names.num_names, binding_count,
+    des.instr_count, des.trusted,
+    encoding.size, des.memo_pc, encoding.num_functions, inlinable_count,
+    constants, libraries, names, bindings, instrs, code, offsets, instructions, functions,
+    inlinables,
+  };
+
+  // Concurrent starts race to write the same image, the rename is atomic
+  char *temp = malloc(strlen(path) + 32);
+  sprintf(temp, "%s.%d.tmp", path, (int) getpid());
+
+  FILE *file = fopen(temp, "wb");
+  if (file != NULL) {
+    bool written = fwrite(buffer.data, 1, buffer.size, file) == buffer.size;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temp, path) != 0) remove(temp);
+  }
+
+  cache_evict();
+
+  free(temp);
+  free(buffer.data);
+  free(path);
+}
+
+bool cache_load(uint64_t key, Deserialized *des, CacheImage *image, Encoding *encoding) {
+  char *path = cache_path(key, false);
+  if (path == NULL) return false;
+
+  int fd = open(path, O_RDONLY);
+  free(path);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+
+  // Private and writable, so relocation and later rewrites stay in-process
+  char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  // Marks the image as used for eviction
+  futimens(fd, NULL);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+
+  CacheHeader *header = (CacheHeader *) base;
+  if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+      header->key != key || header->build != build_id() || header->size != st.st_size) {
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  Constants constants = (Constants) (base + header->constants);
+  for (size_t i = 0; i < header->constant_count; i++) {
+    if (!IS_PTR(constants[i])) continue;
+
+    // Strings of the image are never freed
+    constants[i] = MAKE_PTR(base + (constants[i] & MASK_PAYLOAD_PTR));
+    GET_PTR(constants[i])->refcount = 0;
+  }
+
+  Libraries libraries = { malloc(header->library_count * sizeof(Library)), header->library_count };
+  CachedLibrary *cached_libraries = (CachedLibrary *) (base + header->libraries);
+  for (size_t i = 0; i < header->library_count; i++) {
+    libraries.libraries[i] = (Library) {
+      base + cached_libraries[i].name, cached_libraries[i].num_functions,
+      cached_libraries[i].is_standard
+    };
+  }
+
+  FunctionNames names = { NULL, header->name_count };
+  CachedName *cached_names = (CachedName *) (base + header->names);
+  if (header->name_count > 0) names.names = malloc(header->name_count * sizeof(FunctionName));
+  for (size_t i = 0; i < header->name_count; i++) {
+    names.names[i] = (FunctionName) { cached_names[i].pc, base + cached_names[i].name };
+  }
+
+  des->module = module_new(constants, header->library_count);
+  des->constant_count = header->constant_count;
+  des->libraries = libraries;
+  des->names = names;
+  des->instr_count = header->instr_count;
+  des->instrs = (int32_t *) (base + header->instrs);
+  des->trusted = header->trusted != 0;
+  des->code = (uint8_t *) (base + header->code);
+  des->offsets = (int32_t *) (base + header->offsets);
+  des->memo_pc = header->memo_pc;
+
+  *encoding = (Encoding) {
+    header->code_size, (int32_t *) (base + header->instructions),
+    (LazyFunction *) (base + header->functions), header->function_count,
+    header->inlinable_count > 0 ? (InlineBody *) (base + header->inlinables) : NULL
+  };
+
+  *image = (CacheImage) {
+    base, st.st_size, (NativeBinding *) (base + header->bindings), header->binding_count
+  };
+
+  return true;
+}
+
+#else
+
+void cache_store(uint64_t key, Deserialized des, Encoding encoding) {}
+
+bool cache_load(uint64_t key, Deserialized *des, CacheImage *image, Encoding *encoding) {
+  return false;
+}
+
+#endif
+
+void cache_bind_natives(CacheImage image, Module *module) {
+  for (uint32_t i = 0; i < image.num_bindings; i++) {
+    NativeBinding binding = image.bindings[i];
+    module_native(module, binding.lib, binding.index,
+                  GET_NATIVE(module->constants[binding.constant]));
+  }
+}
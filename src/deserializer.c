@@ -3,81 +3,17 @@
 #include <callstack.h>
 #include <core/error.h>
 #include <deserializer.h>
+#include <heap.h>
 #include <module.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <value.h>
 
-Instruction deserialize_instruction(FILE* file) {
-  Instruction instr;
-
-  uint8_t opcode;
-  fread(&opcode, sizeof(uint8_t), 1, file);
-
-  int32_t operand1 = 0, operand2 = 0, operand3 = 0;
-
-  instr.opcode = opcode;
-
-  switch (opcode) {
-    case OP_Return:
-    case OP_And:
-    case OP_Or:
-    case OP_TypeOf:
-    case OP_ConstructorName:
-    case OP_GetIndex:
-    case OP_Special:
-    case OP_ListLength:
-    case OP_Halt:
-    case OP_MakeMutable:
-    case OP_Update:
-    case OP_UnMut:
-    case OP_Add:
-    case OP_Sub:
-      break;
-    case OP_LoadNative: {
-      fread(&operand1, sizeof(int32_t), 1, file);
-      fread(&operand2, sizeof(int32_t), 1, file);
-      fread(&operand3, sizeof(int32_t), 1, file);
-      break;
-    }
-    default: {
-      fread(&operand1, sizeof(int32_t), 1, file);
-      switch (opcode) {
-        case OP_Phi:
-        case OP_MakeLambda: {
-          fread(&operand2, sizeof(int32_t), 1, file);
-          break;
-        }
-      }
-      break;
-    }
-  }
-  instr.operand1 = operand1;
-  instr.operand2 = operand2;
-  instr.operand3 = operand3;
-
-  return instr;
-}
-
-Bytecode deserialize_bytecode(FILE* file) {
-  Bytecode bytecode;
-
-  int32_t instruction_count;
-  fread(&instruction_count, sizeof(int32_t), 1, file);
-
-  Instruction* instructions = malloc(instruction_count * sizeof(Instruction));
-  for (size_t i = 0; i < instruction_count; i++) {
-    instructions[i] = deserialize_instruction(file);
-  }
-
-  assert(instructions != NULL);
-
-  bytecode.instructions = instructions;
-  bytecode.instruction_count = instruction_count;
-
-  return bytecode;
-}
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 Value deserialize_value(FILE* file) {
   Value value;
@@ -103,11 +39,12 @@ Value deserialize_value(FILE* file) {
       int32_t length;
       fread(&length, sizeof(int32_t), 1, file);
 
-      char* string_value = malloc(length + 1);
+      HeapValue* string = MAKE_HEAP(TYPE_STRING, length, length + 1);
+      char* string_value = (char*) string->as_ptr;
       fread(string_value, sizeof(char), length, file);
       string_value[length] = '\0';
 
-      value = MAKE_STRING(string_value, length);
+      value = MAKE_PTR(string);
       break;
     }
 
@@ -118,11 +55,12 @@ Value deserialize_value(FILE* file) {
   return value;
 }
 
-Constants deserialize_constants(FILE* file) {
+Constants deserialize_constants(FILE* file, int32_t* count) {
   Constants constants;
 
   int32_t constant_count;
   fread(&constant_count, sizeof(int32_t), 1, file);
+  *count = constant_count;
 
   constants = malloc(constant_count * sizeof(Value));
   for (size_t i = 0; i < constant_count; i++) {
@@ -171,30 +109,161 @@ Libraries deserialize_libraries(FILE* file) {
   return libraries;
 }
 
+FunctionNames deserialize_names(FILE* file) {
+  FunctionNames names = { NULL, 0 };
+
+  // The names section is optional and trails the instructions
+  int32_t name_count;
+  if (fread(&name_count, sizeof(int32_t), 1, file) != 1 || name_count <= 0)
+    return names;
+
+  names.names = malloc(name_count * sizeof(FunctionName));
+
+  for (size_t i = 0; i < name_count; i++) {
+    int32_t pc, length;
+    fread(&pc, sizeof(int32_t), 1, file);
+    fread(&length, sizeof(int32_t), 1, file);
+
+    char* name = malloc(length + 1);
+    fread(name, sizeof(char), length, file);
+    name[length] = '\0';
+
+    names.names[i] = (FunctionName) { pc, name };
+  }
+
+  names.num_names = name_count;
+
+  return names;
+}
+
+static Section* find_section(Section* sections, uint32_t count, SectionKind kind) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (sections[i].kind == kind) return &sections[i];
+  }
+
+  return NULL;
+}
+
+// Only the names are needed at load time, function bodies are found
+// from their definitions
+FunctionNames deserialize_functions(FILE* file, Section section) {
+  FunctionNames names = { NULL, 0 };
+
+  fseek(file, section.offset, SEEK_SET);
+  int32_t function_count;
+  if (fread(&function_count, sizeof(int32_t), 1, file) != 1 || function_count <= 0)
+    return names;
+
+  FunctionEntry* entries = malloc(function_count * sizeof(FunctionEntry));
+  fread(entries, sizeof(FunctionEntry), function_count, file);
+  names.names = malloc(function_count * sizeof(FunctionName));
+
+  for (size_t i = 0; i < function_count; i++) {
+    if (entries[i].name_length == 0) continue;
+
+    char* name = malloc(entries[i].name_length + 1);
+    fseek(file, section.offset + entries[i].name, SEEK_SET);
+    fread(name, sizeof(char), entries[i].name_length, file);
+    name[entries[i].name_length] = '\0';
+
+    names.names[names.num_names++] = (FunctionName) { entries[i].entry * 4, name };
+  }
+
+  free(entries);
+  return names;
+}
+
+// Privately mapped where possible, so pages of code are only read, and
+// copied by load-time passes, for the functions a run calls. The mapping
+// lives as long as the program.
+int32_t* deserialize_code(FILE* file, Section section) {
+#ifndef _WIN32
+  if (section.size > 0) {
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t start = section.offset & ~(page - 1);
+
+    char* base = mmap(NULL, section.size + (section.offset - start), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fileno(file), start);
+    if (base != MAP_FAILED) return (int32_t*) (base + (section.offset - start));
+  }
+#endif
+
+  int32_t* instrs = malloc(section.size + 1);
+  fseek(file, section.offset, SEEK_SET);
+  fread(instrs, 1, section.size, file);
+  return instrs;
+}
+
+Deserialized deserialize_sectioned(FILE* file) {
+  BytecodeHeader header;
+  fread(&header, sizeof(BytecodeHeader), 1, file);
+  if (header.version != BYTECODE_VERSION)
+    THROW_FMT("Unsupported bytecode version %u, expected %d", header.version, BYTECODE_VERSION);
+
+  Section* sections = malloc(header.section_count * sizeof(Section));
+  if (fread(sections, sizeof(Section), header.section_count, file) != header.section_count)
+    THROW("Truncated bytecode section table");
+
+  Section* constants_section = find_section(sections, header.section_count, SECTION_CONSTANTS);
+  Section* libraries_section = find_section(sections, header.section_count, SECTION_LIBRARIES);
+  Section* functions_section = find_section(sections, header.section_count, SECTION_FUNCTIONS);
+  Section* code_section = find_section(sections, header.section_count, SECTION_CODE);
+
+  if (constants_section == NULL || libraries_section == NULL || code_section == NULL)
+    THROW("Missing bytecode section");
+
+  int32_t constant_count = 0;
+  fseek(file, constants_section->offset, SEEK_SET);
+  Constants constants = deserialize_constants(file, &constant_count);
+
+  fseek(file, libraries_section->offset, SEEK_SET);
+  Libraries libraries = deserialize_libraries(file);
+
+  FunctionNames names = { NULL, 0 };
+  if (functions_section != NULL) names = deserialize_functions(file, *functions_section);
+
+  Deserialized deserialized;
+  deserialized.module = module_new(constants, libraries.num_libraries);
+  deserialized.constant_count = constant_count;
+  deserialized.libraries = libraries;
+  deserialized.names = names;
+  deserialized.instr_count = code_section->size / (4 * sizeof(int32_t));
+  deserialized.instrs = deserialize_code(file, *code_section);
+  deserialized.trusted = (header.flags & BYTECODE_TRUSTED) != 0;
+
+  free(sections);
+  return deserialized;
+}
+
 Deserialized deserialize(FILE* file) {
-  Module* module = malloc(sizeof(Module));
+  uint32_t magic = 0;
+  fread(&magic, sizeof(uint32_t), 1, file);
+  rewind(file);
+
+  if (magic == BYTECODE_MAGIC) return deserialize_sectioned(file);
 
-  Constants constants = deserialize_constants(file);
+  int32_t constant_count = 0;
+  Constants constants = deserialize_constants(file, &constant_count);
   Libraries libraries = deserialize_libraries(file);
 
-  size_t instr_count;
+  int32_t instr_count = 0;
   fread(&instr_count, sizeof(int32_t), 1, file);
 
   int32_t* instrs = malloc(instr_count * 4 * sizeof(int32_t));
   fread(instrs, sizeof(int32_t), instr_count * 4, file);
 
-  module->constants = constants;
-  module->stack = stack_new();
-  module->callstack = 0;
-  module->locals_count = 0;
-  module->locals = malloc(MAX_FRAMES * sizeof(size_t));
-  module->natives = calloc(libraries.num_libraries, sizeof(Native));
+  FunctionNames names = deserialize_names(file);
+
+  Module* module = module_new(constants, libraries.num_libraries);
 
   Deserialized deserialized;
   deserialized.module = module;
+  deserialized.constant_count = constant_count;
   deserialized.libraries = libraries;
+  deserialized.names = names;
   deserialized.instr_count = instr_count;
   deserialized.instrs = instrs;
+  deserialized.trusted = false;
 
   return deserialized;
 }
@@ -0,0 +1,573 @@
+#include <bytecode.h>
+#include <core/error.h>
+#include <encoding.h>
+#include <heap.h>
+#include <module.h>
+#include <optimizer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Instructions `start` to `end` of a function body that run one after the
+// other, see `layout_blocks`
+typedef struct {
+  size_t start;
+  size_t end;
+  bool ran;
+  bool falls_through;
+} Block;
+
+static struct {
+  Deserialized *des;
+  bool optimized;
+  int32_t size;
+
+  // Instruction each byte of the compact code belongs to
+  int32_t *instructions;
+
+  LazyFunction *functions;
+  size_t num_functions;
+  size_t capacity;
+
+  // By global, for expanding `OP_Inline`
+  InlineBody *inlinables;
+
+  // Executions by instruction in a profiling run, NULL without one
+  const uint64_t *profile;
+} program;
+
+#ifndef _WIN32
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+// Plume code only runs on one thread there
+#define LOCK()
+#define UNLOCK()
+#endif
+
+static bool is_jump(int32_t opcode) {
+  switch (opcode) {
+    case OP_JumpRel:
+    case OP_JumpElseRel:
+    case OP_JumpElseRelCmp:
+    case OP_IJumpElseRelCmp:
+    case OP_JumpElseRelCmpConst:
+    case OP_IJumpElseRelCmpConst:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool is_definer(int32_t opcode) {
+  return opcode == OP_MakeLambda || opcode == OP_MakeClosure || opcode == OP_MakeAndStoreLambda;
+}
+
+static int32_t body_length(int32_t *ins) {
+  return ins[0] == OP_MakeAndStoreLambda ? ins[2] : ins[1];
+}
+
+static bool falls_through(int32_t opcode) {
+  switch (opcode) {
+    case OP_Return:
+    case OP_ReturnConst:
+    case OP_Halt:
+    case OP_JumpRel:
+    case OP_Switch:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// End of the instructions that move together starting at `idx`: a switch
+// with its table, a definer with the body of its function
+static size_t unit_end(int32_t *ins, size_t idx) {
+  if (ins[0] == OP_Switch) return idx + 2 + ins[1];
+  if (is_definer(ins[0])) return idx + 1 + body_length(ins);
+  return idx + 1;
+}
+
+// Integer constant `index` as an immediate, if it fits
+static bool small_int(Deserialized des, int32_t index, int16_t *out) {
+  Value value = des.module->constants[index];
+  if (get_type(value) != TYPE_INTEGER) return false;
+
+  int32_t integer = (int32_t) GET_INT(value);
+  if (integer < INT16_MIN || integer > INT16_MAX) return false;
+
+  *out = integer;
+  return true;
+}
+
+// Opcode an instruction is encoded with, -1 when it is dropped
+static int32_t encoded_opcode(Deserialized des, int32_t *ins) {
+  int16_t imm;
+
+  switch (ins[0]) {
+    case OP_Nop:
+      return -1;
+    case OP_LoadLocal:
+      // Loads that are not moves copy the reference
+      return heap_refcounting ? OP_DupLocal : OP_LoadLocal;
+    case OP_LoadConstant:
+      return small_int(des, ins[1], &imm) ? OP_PushInt : OP_LoadConstant;
+    case OP_AddConst:
+      return small_int(des, ins[1], &imm) ? OP_AddInt : OP_AddConst;
+    case OP_SubConst:
+      return small_int(des, ins[1], &imm) ? OP_SubInt : OP_SubConst;
+    case OP_MulConst:
+      return small_int(des, ins[1], &imm) ? OP_MulInt : OP_MulConst;
+    case OP_ReturnConst:
+      return small_int(des, ins[1], &imm) ? OP_ReturnInt : OP_ReturnConst;
+    case OP_IJumpElseRelCmpConst:
+      return small_int(des, ins[3], &imm) ? OP_IJumpElseRelCmpInt : OP_IJumpElseRelCmpConst;
+    default:
+      return ins[0];
+  }
+}
+
+// Bytes instruction `ins` takes once encoded as `opcode`, an inlined call
+// taking those of the callee's body
+static int32_t encoded_size(Deserialized des, int32_t *ins, int32_t opcode) {
+  if (opcode != OP_Inline) return ENCODED_SIZE(opcode);
+
+  InlineBody body = program.inlinables[ins[1]];
+  int32_t size = 0;
+  for (int32_t idx = body.start; idx < body.start + body.length; idx++) {
+    int32_t inner = encoded_opcode(des, &des.instrs[idx * 4]);
+    if (inner >= 0) size += ENCODED_SIZE(inner);
+  }
+
+  return size;
+}
+
+static void write_operand(uint8_t *code, int64_t operand, size_t idx) {
+  if (operand < INT16_MIN || operand > INT16_MAX)
+    THROW_FMT("Operand %lld of instruction %zu does not fit the compact encoding",
+              (long long) operand, idx);
+
+  int16_t value = operand;
+  memcpy(code, &value, sizeof(value));
+}
+
+// Writes `ins` as `opcode` with `operands`, pc-relative ones resolved
+static void write_instruction(uint8_t *at, int32_t opcode, int32_t *ins, int32_t *operands,
+                              size_t idx) {
+  // Only a capacity hint
+  if (ins[0] == OP_BuilderNew && operands[0] > INT16_MAX) operands[0] = INT16_MAX;
+
+  // Immediates replace constants, `DupLocal` keeps its local
+  if (opcode != ins[0] && opcode != OP_DupLocal) {
+    int32_t constant = opcode == OP_IJumpElseRelCmpInt ? 2 : 0;
+    operands[constant] = (int32_t) GET_INT(program.des->module->constants[operands[constant]]);
+  }
+
+  at[0] = opcode;
+  for (int k = 0; k < operand_counts[opcode]; k++) {
+    write_operand(at + 1 + 2 * k, operands[k], idx);
+  }
+}
+
+static bool mark_leader(bool *leaders, size_t from, size_t to, size_t target) {
+  if (target < from || target > to) return false;
+  leaders[target - from] = true;
+  return true;
+}
+
+// Orders the blocks of the function body `from` to `to` by the profile:
+// blocks that ran keep their order, those that never ran follow them. A
+// block that no longer comes right before the one it falls through to
+// gets `fallthrough` set on its last instruction, for a jump there.
+static void layout_blocks(size_t from, size_t to, int32_t *order, int32_t *fallthrough) {
+  Deserialized *des = program.des;
+  bool *leaders = calloc(to - from + 1, sizeof(bool));
+  Block *blocks = malloc((to - from) * sizeof(Block));
+  size_t num_blocks = 0, num_ran = 0;
+  bool valid = true;
+
+  // Blocks start at jump targets and after jumps and instructions that do
+  // not fall through
+  leaders[0] = true;
+  for (size_t idx = from; idx < to && valid;) {
+    int32_t *ins = &des->instrs[idx * 4];
+    size_t end = unit_end(ins, idx);
+
+    if (is_jump(ins[0])) valid = mark_leader(leaders, from, to, idx + ins[1]);
+    if (ins[0] == OP_Switch) {
+      for (size_t entry = idx + 1; entry < end && valid; entry++) {
+        valid = mark_leader(leaders, from, to, entry + des->instrs[entry * 4 + 1]);
+      }
+    }
+    if ((is_jump(ins[0]) || !falls_through(ins[0])) && end <= to) leaders[end - from] = true;
+    idx = end;
+  }
+
+  // A block ran if any of its instructions did. Blocks of dropped
+  // instructions only count as run, moving them would only add a jump.
+  for (size_t idx = from; idx < to && valid;) {
+    int32_t *ins = &des->instrs[idx * 4];
+    if (leaders[idx - from]) blocks[num_blocks++] = (Block) { idx, idx, false, true };
+
+    Block *block = &blocks[num_blocks - 1];
+    if (program.profile[idx] > 0) block->ran = true;
+
+    block->end = unit_end(ins, idx);
+    block->falls_through = falls_through(ins[0]);
+    idx = block->end;
+  }
+  for (size_t b = 0; b < num_blocks && valid; b++) {
+    bool encoded = false;
+    for (size_t idx = blocks[b].start; idx < blocks[b].end; idx = unit_end(&des->instrs[idx * 4], idx)) {
+      if (encoded_opcode(*des, &des->instrs[idx * 4]) >= 0) encoded = true;
+    }
+    if (!encoded) blocks[b].ran = true;
+    if (blocks[b].ran) num_ran++;
+  }
+
+  // Bodies that never ran keep their order, as do those falling off their
+  // end, which only happens in code that is not a function
+  valid = valid && num_blocks > 0 && blocks[0].ran && num_ran < num_blocks &&
+          !blocks[num_blocks - 1].falls_through;
+
+  if (valid) {
+    size_t k = 0, previous = num_blocks;
+    for (int pass = 0; pass < 2; pass++) {
+      for (size_t b = 0; b < num_blocks; b++) {
+        if (blocks[b].ran != (pass == 0)) continue;
+
+        if (previous < num_blocks && blocks[previous].falls_through && b != previous + 1)
+          fallthrough[k - 1] = blocks[previous + 1].start;
+
+        for (size_t idx = blocks[b].start; idx < blocks[b].end; idx++) order[k++] = idx;
+        previous = b;
+      }
+    }
+
+    if (blocks[previous].falls_through) fallthrough[k - 1] = blocks[previous + 1].start;
+  }
+
+  free(leaders);
+  free(blocks);
+}
+
+// Encodes instructions `from` to `to` at `base`, returning the end or -1
+// when the code would not fit, in which case only `offsets` changed. With
+// `lazy`, bodies of the functions defined there are left out for a stub
+// each, which stands for the body's first instruction until it is encoded.
+// Without it, blocks are laid out by the profile if there is one.
+static int32_t encode_range(size_t from, size_t to, int32_t base, bool lazy) {
+  Deserialized *des = program.des;
+  size_t count = to - from;
+  int32_t *opcodes = malloc(count * sizeof(int32_t));
+  int32_t *offsets = des->offsets;
+  size_t first_function = program.num_functions;
+  int32_t size = base;
+
+  int32_t *order = malloc(count * sizeof(int32_t));
+  int32_t *fallthrough = malloc(count * sizeof(int32_t));
+  for (size_t k = 0; k < count; k++) {
+    order[k] = from + k;
+    fallthrough[k] = -1;
+  }
+  if (!lazy && program.profile != NULL) layout_blocks(from, to, order, fallthrough);
+
+  // Dropped instructions share the offset of the next one, so jumps to
+  // them land on what follows
+  for (size_t k = 0; k < count; k++) {
+    size_t idx = order[k];
+    int32_t *ins = &des->instrs[idx * 4];
+    opcodes[idx - from] = encoded_opcode(*des, ins);
+    offsets[idx] = size;
+    if (opcodes[idx - from] >= 0) size += encoded_size(*des, ins, opcodes[idx - from]);
+    if (fallthrough[k] >= 0) size += ENCODED_SIZE(OP_JumpRel);
+
+    if (lazy && is_definer(ins[0]) && body_length(ins) > 0) {
+      if (program.num_functions == program.capacity) {
+        program.capacity = program.capacity == 0 ? 16 : program.capacity * 2;
+        program.functions = realloc(program.functions, program.capacity * sizeof(LazyFunction));
+      }
+
+      program.functions[program.num_functions++] = (LazyFunction) {
+        idx, body_length(ins), size, -1, false, 0
+      };
+
+      opcodes[idx + 1 - from] = OP_Decode;
+      offsets[idx + 1] = size;
+      size += ENCODED_SIZE(OP_Decode);
+      k += body_length(ins);
+    }
+  }
+  offsets[to] = size;
+
+  // Pcs are stored in 16 bits in function values and frames
+  if (size >= ENCODED_CAPACITY) {
+    free(opcodes);
+    free(order);
+    free(fallthrough);
+    return -1;
+  }
+
+  size_t function = first_function;
+  for (size_t k = 0; k < count; k++) {
+    size_t idx = order[k];
+    int32_t opcode = opcodes[idx - from];
+    if (opcode < 0) continue;
+
+    int32_t *ins = &des->instrs[idx * 4];
+    int32_t operands[3] = { ins[1], ins[2], ins[3] };
+    uint8_t *at = &des->code[offsets[idx]];
+
+    for (int32_t pc = offsets[idx]; pc < offsets[idx] + encoded_size(*des, ins, opcode); pc++) {
+      program.instructions[pc] = idx;
+    }
+
+    if (opcode == OP_Decode) {
+      at[0] = OP_Decode;
+      write_operand(at + 1, function++, idx);
+      k += program.functions[function - 1].length - 1;
+      continue;
+    }
+
+    // Inlined bodies have no jumps, the call's instructions stand for them
+    if (opcode == OP_Inline) {
+      InlineBody body = program.inlinables[ins[1]];
+      for (int32_t inner = body.start; inner < body.start + body.length; inner++) {
+        int32_t *callee = &des->instrs[inner * 4];
+        int32_t inner_opcode = encoded_opcode(*des, callee);
+        if (inner_opcode < 0) continue;
+
+        int32_t inner_operands[3] = { callee[1], callee[2], callee[3] };
+        write_instruction(at, inner_opcode, callee, inner_operands, idx);
+        at += ENCODED_SIZE(inner_opcode);
+      }
+      continue;
+    }
+
+    if (is_jump(ins[0])) {
+      operands[0] = offsets[idx + ins[1]] - offsets[idx];
+    }
+
+    switch (ins[0]) {
+      case OP_MakeLambda:
+      case OP_MakeClosure:
+        operands[0] = offsets[idx + 1 + ins[1]] - offsets[idx + 1];
+        break;
+      case OP_MakeAndStoreLambda:
+        operands[1] = offsets[idx + 1 + ins[2]] - offsets[idx + 1];
+        break;
+    }
+
+    write_instruction(at, opcode, ins, operands, idx);
+  }
+
+  // Blocks moved away from the one they fall through to jump there
+  for (size_t k = 0; k < count; k++) {
+    if (fallthrough[k] < 0) continue;
+
+    size_t idx = order[k];
+    int32_t opcode = opcodes[idx - from];
+    int32_t pc = offsets[idx] + (opcode >= 0 ? encoded_size(*des, &des->instrs[idx * 4], opcode) : 0);
+
+    des->code[pc] = OP_JumpRel;
+    write_operand(&des->code[pc + 1], offsets[fallthrough[k]] - pc, idx);
+    for (int32_t byte = pc; byte < pc + ENCODED_SIZE(OP_JumpRel); byte++) {
+      program.instructions[byte] = idx;
+    }
+  }
+
+  free(opcodes);
+  free(order);
+  free(fallthrough);
+  return size;
+}
+
+// Sends calls to `fn` back through its stub
+static void unencode(LazyFunction *fn) {
+  int32_t body = fn->definer + 1;
+  program.des->offsets[body] = fn->stub;
+  for (int32_t idx = body + 1; idx < body + fn->length; idx++) program.des->offsets[idx] = -1;
+  fn->pc = -1;
+}
+
+// Runs the load-time passes over the body of `fn` and encodes it after
+// the code so far, false when it does not fit
+static bool encode_function(LazyFunction *fn) {
+  Deserialized *des = program.des;
+
+  // The definer comes along so that passes see the body as a function
+  Deserialized view = *des;
+  view.instrs = &des->instrs[fn->definer * 4];
+  view.instr_count = fn->length + 1;
+
+  if (!fn->passed) {
+    if (program.optimized) {
+      optimize(view);
+      optimize_calls(view, program.inlinables);
+    }
+    if (heap_refcounting) optimize_ownership(view);
+    fn->passed = true;
+  }
+
+  // Offsets of the body are kept by the enclosing range
+  int32_t body = fn->definer + 1;
+  int32_t end = des->offsets[body + fn->length];
+  int32_t size = encode_range(body, body + fn->length, program.size, false);
+  des->offsets[body + fn->length] = end;
+
+  if (size < 0) {
+    unencode(fn);
+    return false;
+  }
+
+  fn->pc = program.size;
+  program.size = size;
+  return true;
+}
+
+static void encode_function_or_throw(LazyFunction *fn) {
+  if (!encode_function(fn)) THROW_FMT("Program too large for %d bytes of code", ENCODED_CAPACITY);
+}
+
+static int compare_executed(const void *a, const void *b) {
+  const LazyFunction *x = &program.functions[*(const size_t *) a];
+  const LazyFunction *y = &program.functions[*(const size_t *) b];
+  if (x->executed != y->executed) return x->executed < y->executed ? 1 : -1;
+  return x->definer < y->definer ? -1 : x->definer > y->definer;
+}
+
+// Functions that ran in the profile are encoded up front, hottest first,
+// so that they sit together. Their stubs stay until the first call, which
+// points globals at the body as for any other function.
+static void encode_profiled() {
+  size_t *hot = malloc(program.num_functions * sizeof(size_t));
+  size_t num_hot = 0;
+
+  for (size_t function = 0; function < program.num_functions; function++) {
+    LazyFunction *fn = &program.functions[function];
+    for (int32_t idx = fn->definer + 1; idx < fn->definer + 1 + fn->length; idx++) {
+      fn->executed += program.profile[idx];
+    }
+    if (fn->executed > 0) hot[num_hot++] = function;
+  }
+
+  qsort(hot, num_hot, sizeof(size_t), compare_executed);
+  for (size_t k = 0; k < num_hot; k++) encode_function_or_throw(&program.functions[hot[k]]);
+
+  free(hot);
+}
+
+void encode(Deserialized *des, bool optimized, const uint64_t *profile) {
+  program.des = des;
+  program.optimized = optimized;
+  program.profile = profile;
+  program.inlinables = optimized ? inlinables_new(*des) : NULL;
+  program.instructions = malloc(ENCODED_CAPACITY * sizeof(int32_t));
+
+  // Pages of code are only touched as functions get encoded
+  des->code = malloc(ENCODED_CAPACITY);
+  des->offsets = malloc((des->instr_count + 1) * sizeof(int32_t));
+  for (size_t idx = 0; idx <= des->instr_count; idx++) des->offsets[idx] = -1;
+
+  program.size = encode_range(0, des->instr_count, 0, true);
+  if (program.size < 0) THROW_FMT("Program too large for %d bytes of code", ENCODED_CAPACITY);
+
+  // Falling off the end halts
+  des->code[program.size] = OP_Halt;
+  program.instructions[program.size] = des->instr_count;
+  program.size++;
+
+  des->memo_pc = program.size;
+  des->code[program.size] = OP_MemoReturn;
+  program.instructions[program.size] = des->instr_count;
+  program.size++;
+
+  if (profile != NULL) encode_profiled();
+}
+
+int32_t encoding_decode(Module *module, int32_t function) {
+  LOCK();
+
+  Deserialized *des = program.des;
+  LazyFunction *fn = &program.functions[function];
+  int32_t *definer = &des->instrs[fn->definer * 4];
+
+  if (fn->pc < 0) encode_function_or_throw(fn);
+
+  // Calls through the stub jump to the body from now on
+  uint8_t *stub = &des->code[fn->stub];
+  if (*stub == OP_Decode) {
+    write_operand(stub + 1, fn->pc - fn->stub, fn->definer);
+    __atomic_store_n(stub, (uint8_t) OP_JumpRel, __ATOMIC_RELEASE);
+  }
+
+  // A global still holding the stub calls the body directly instead
+  if (definer[0] == OP_MakeAndStoreLambda) {
+    Value *global = &module->stack->values[definer[1]];
+    if (*global == MAKE_FUNCTION(fn->stub, definer[3])) *global = MAKE_FUNCTION(fn->pc, definer[3]);
+  }
+
+  UNLOCK();
+  return fn->pc;
+}
+
+bool encode_all() {
+  int32_t size = program.size;
+  size_t function = 0;
+  for (; function < program.num_functions; function++) {
+    LazyFunction *fn = &program.functions[function];
+    if (fn->pc < 0 && !encode_function(fn)) break;
+  }
+
+  if (function == program.num_functions) return true;
+
+  // Runs only encode the functions they call, which may fit where all of
+  // them do not
+  for (size_t k = 0; k < function; k++) {
+    if (program.functions[k].pc >= size) unencode(&program.functions[k]);
+  }
+  program.size = size;
+  return false;
+}
+
+Encoding encoding_state() {
+  return (Encoding) {
+    program.size, program.instructions, program.functions, program.num_functions,
+    program.inlinables
+  };
+}
+
+void encode_resume(Deserialized *des, Encoding state, bool optimized, const uint64_t *profile) {
+  program.des = des;
+  program.optimized = optimized;
+  program.profile = profile;
+  program.inlinables = state.inlinables;
+  program.size = state.size;
+
+  program.instructions = malloc(ENCODED_CAPACITY * sizeof(int32_t));
+  memcpy(program.instructions, state.instructions, state.size * sizeof(int32_t));
+
+  program.functions = malloc((state.num_functions + 1) * sizeof(LazyFunction));
+  memcpy(program.functions, state.functions, state.num_functions * sizeof(LazyFunction));
+  program.num_functions = program.capacity = state.num_functions;
+
+  // Functions left are encoded after the saved code
+  uint8_t *code = malloc(ENCODED_CAPACITY);
+  memcpy(code, des->code, state.size);
+  des->code = code;
+
+  int32_t *offsets = malloc((des->instr_count + 1) * sizeof(int32_t));
+  memcpy(offsets, des->offsets, (des->instr_count + 1) * sizeof(int32_t));
+  des->offsets = offsets;
+}
+
+int32_t encoded_instruction(int32_t pc) {
+  if (pc < 0 || pc >= program.size) return -1;
+  return program.instructions[pc];
+}
@@ -0,0 +1,76 @@
+#include <bytecode.h>
+#include <function_table.h>
+#include <module.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *function_name(Deserialized des, int32_t entry, char *fallback) {
+  for (size_t i = 0; i < des.names.num_names; i++) {
+    if (des.names.names[i].pc == entry) return des.names.names[i].name;
+  }
+
+  return fallback;
+}
+
+FunctionTable function_table_new(Deserialized des) {
+  FunctionTable table = { NULL, 0 };
+  size_t capacity = 0;
+
+  for (int32_t pc = 0; pc < des.instr_count * 4; pc += 4) {
+    int32_t length;
+    char fallback[32];
+
+    switch (des.instrs[pc]) {
+      case OP_MakeLambda:
+        length = des.instrs[pc + 1];
+        snprintf(fallback, sizeof(fallback), "lambda_%d", pc + 4);
+        break;
+      case OP_MakeClosure:
+        length = des.instrs[pc + 1];
+        snprintf(fallback, sizeof(fallback), "closure_%d", pc + 4);
+        break;
+      case OP_MakeAndStoreLambda:
+        length = des.instrs[pc + 2];
+        snprintf(fallback, sizeof(fallback), "global_%d", des.instrs[pc + 1]);
+        break;
+      default:
+        continue;
+    }
+
+    if (table.num_ranges == capacity) {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+      table.ranges = realloc(table.ranges, capacity * sizeof(FunctionRange));
+    }
+
+    // Lambdas are found in pc order, so the table is sorted by start
+    char *name = function_name(des, pc + 4, NULL);
+    table.ranges[table.num_ranges++] = (FunctionRange) {
+      pc + 4, pc + (length + 1) * 4, strdup(name != NULL ? name : fallback)
+    };
+  }
+
+  return table;
+}
+
+int32_t function_table_lookup(FunctionTable table, int32_t pc) {
+  size_t lo = 0, hi = table.num_ranges;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (table.ranges[mid].start <= pc) lo = mid + 1;
+    else hi = mid;
+  }
+
+  // Walk outwards through enclosing lambdas until one contains the pc
+  for (int32_t i = (int32_t) lo - 1; i >= 0; i--) {
+    if (pc < table.ranges[i].end) return i;
+  }
+
+  return -1;
+}
+
+void function_table_free(FunctionTable table) {
+  for (size_t i = 0; i < table.num_ranges; i++) free(table.ranges[i].name);
+  free(table.ranges);
+}
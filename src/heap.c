@@ -0,0 +1,186 @@
+#include <bytecode.h>
+#include <heap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+bool heap_tracking = false;
+bool heap_refcounting = false;
+bool heap_arena = false;
+_Thread_local HeapChunk *heap_chunk = NULL;
+_Thread_local HeapChunk *heap_large = NULL;
+_Thread_local HeapReuse heap_reuse[HEAP_REUSE_SIZE / 8 + 1];
+_Thread_local int32_t heap_site = -1;
+
+typedef struct {
+  uint64_t count;
+  uint64_t bytes;
+} AllocStat;
+
+static struct {
+  AllocStat total;
+  AllocStat by_type[TYPE_UNKNOWN + 1];
+  AllocStat load;
+
+  uint64_t live;
+  uint64_t peak;
+
+  int32_t *instrs;
+  int32_t *offsets;
+  size_t instr_count;
+  size_t code_size;
+  AllocStat *sites;
+} stats;
+
+// Counters are shared by the threads of parallel natives
+static void stat_add(AllocStat *stat, size_t size) {
+  __atomic_fetch_add(&stat->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stat->bytes, size, __ATOMIC_RELAXED);
+}
+
+void heap_track_alloc(size_t size, int type) {
+  stat_add(&stats.total, size);
+
+  if (type < 0 || type > TYPE_UNKNOWN) type = TYPE_UNKNOWN;
+  stat_add(&stats.by_type[type], size);
+
+  uint64_t live = __atomic_add_fetch(&stats.live, size, __ATOMIC_RELAXED);
+  uint64_t peak = __atomic_load_n(&stats.peak, __ATOMIC_RELAXED);
+  while (live > peak && !__atomic_compare_exchange_n(&stats.peak, &peak, live, true,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+
+  // Sites are indexed by compact pc
+  AllocStat *site = &stats.load;
+  if (heap_site >= 0 && stats.sites != NULL && heap_site < stats.code_size) {
+    site = &stats.sites[heap_site];
+  }
+
+  stat_add(site, size);
+}
+
+void heap_track_free(size_t size, int type) {
+  (void) type;
+  __atomic_fetch_sub(&stats.live, size, __ATOMIC_RELAXED);
+}
+
+void heap_recycle(void *ptr, size_t size, int type) {
+  if (heap_tracking) heap_track_free(size, type);
+  if (heap_arena) return;
+
+  if (size <= HEAP_REUSE_SIZE && size % 8 == 0) {
+    HeapReuse *reuse = &heap_reuse[size / 8];
+    if (reuse->count < HEAP_REUSE_DEPTH) {
+      reuse->blocks[reuse->count++] = ptr;
+      return;
+    }
+  }
+
+  free(ptr);
+}
+
+void *heap_arena_grow(size_t size) {
+  size_t capacity = size > HEAP_ARENA_LARGE ? size : HEAP_ARENA_CHUNK;
+  HeapChunk *chunk = malloc(sizeof(HeapChunk) + capacity);
+  chunk->size = capacity;
+  chunk->used = size;
+
+  if (size > HEAP_ARENA_LARGE) {
+    chunk->previous = heap_large;
+    heap_large = chunk;
+  } else {
+    chunk->previous = heap_chunk;
+    heap_chunk = chunk;
+  }
+
+  return chunk->data;
+}
+
+HeapRegion heap_region_open() {
+  return (HeapRegion) { heap_chunk, heap_chunk != NULL ? heap_chunk->used : 0, heap_large };
+}
+
+static void release_chunks(HeapChunk **chain, HeapChunk *until) {
+  while (*chain != until) {
+    HeapChunk *previous = (*chain)->previous;
+    free(*chain);
+    *chain = previous;
+  }
+}
+
+void heap_region_close(HeapRegion region) {
+  release_chunks(&heap_chunk, region.chunk);
+  release_chunks(&heap_large, region.large);
+
+  if (heap_chunk != NULL) heap_chunk->used = region.used;
+}
+
+void heap_arena_release() {
+  heap_region_close((HeapRegion) { NULL, 0, NULL });
+}
+
+void heap_stats_start() {
+  memset(&stats, 0, sizeof(stats));
+  heap_tracking = true;
+}
+
+void heap_stats_attach(int32_t *instrs, int32_t *offsets, size_t instr_count,
+                       size_t code_size) {
+  stats.instrs = instrs;
+  stats.offsets = offsets;
+  stats.instr_count = instr_count;
+  stats.code_size = code_size;
+  stats.sites = calloc(code_size, sizeof(AllocStat));
+}
+
+void heap_stats_report() {
+  if (!heap_tracking) return;
+
+  fprintf(stderr, "Allocation profile\n");
+  fprintf(stderr, "  total: %llu bytes in %llu allocations\n",
+          (unsigned long long) stats.total.bytes,
+          (unsigned long long) stats.total.count);
+  fprintf(stderr, "  live: %llu bytes, peak live: %llu bytes\n",
+          (unsigned long long) stats.live, (unsigned long long) stats.peak);
+
+  fprintf(stderr, "  by type:\n");
+  for (int i = 0; i <= TYPE_UNKNOWN; i++) {
+    if (stats.by_type[i].count == 0) continue;
+    fprintf(stderr, "    %-12s %12llu bytes %10llu allocations\n", type_name(i),
+            (unsigned long long) stats.by_type[i].bytes,
+            (unsigned long long) stats.by_type[i].count);
+  }
+
+  // Selection of the heaviest sites, reported by instruction. Dropped `Nop`s
+  // share their offset with the next instruction, functions never called
+  // have none.
+  fprintf(stderr, "  top sites:\n");
+  if (stats.load.count > 0) {
+    fprintf(stderr, "    %-6s %-20s %12llu bytes %10llu allocations\n", "-",
+            "<load>", (unsigned long long) stats.load.bytes,
+            (unsigned long long) stats.load.count);
+  }
+
+  size_t top[HEAP_TOP_SITES];
+  size_t num_top = 0;
+
+  for (size_t i = 0; i < stats.instr_count && stats.sites != NULL; i++) {
+    if (stats.instrs[i * 4] == OP_Nop || stats.offsets[i] < 0) continue;
+    if (stats.sites[stats.offsets[i]].count == 0) continue;
+
+    AllocStat site = stats.sites[stats.offsets[i]];
+    size_t j = num_top < HEAP_TOP_SITES ? num_top++ : HEAP_TOP_SITES;
+    while (j > 0 && stats.sites[stats.offsets[top[j - 1]]].bytes < site.bytes) {
+      if (j < HEAP_TOP_SITES) top[j] = top[j - 1];
+      j--;
+    }
+    if (j < HEAP_TOP_SITES) top[j] = i;
+  }
+
+  for (size_t i = 0; i < num_top; i++) {
+    AllocStat site = stats.sites[stats.offsets[top[i]]];
+    fprintf(stderr, "    %-6zu %-20s %12llu bytes %10llu allocations\n",
+            top[i] * 4, opcode_name(stats.instrs[top[i] * 4]),
+            (unsigned long long) site.bytes, (unsigned long long) site.count);
+  }
+}
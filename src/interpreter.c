@@ -1,21 +1,41 @@
+#include <array.h>
 #include <assert.h>
 #include <bytecode.h>
 #include <callstack.h>
 #include <core/debug.h>
 #include <core/error.h>
 #include <core/library.h>
+#include <core/probes.h>
+#include <encoding.h>
+#include <heap.h>
 #include <interpreter.h>
+#include <layout.h>
+#include <map.h>
+#include <memo.h>
+#include <rope.h>
 #include <module.h>
+#include <output.h>
 #include <stack.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <value.h>
 
-#define INCREASE_IP_BY(pc, x) (pc += ((x) * 4))
-#define INCREASE_IP(pc) INCREASE_IP_BY(pc, 1)
+// Selects the tail-calling interpreter over the computed goto loop
+#ifndef PLUME_TAIL_CALLS
+#define PLUME_TAIL_CALLS 0
+#endif
 
-int halt = 0;
+bool interpreter_counting = false;
+const bool interpreter_counting_instrumented = PLUME_TAIL_CALLS;
+bool interpreter_checked = false;
+static _Atomic uint64_t dispatched = 0;
 
-typedef Value (*ComparisonFun)(Value, Value);
+uint64_t interpreter_dispatched() {
+  return dispatched;
+}
+
+// Per thread, workers of the parallel natives halt on every callback
+_Thread_local int halt = 0;
 
 static inline Value compare_eq_int(Value a, Value b) {
   return MAKE_INTEGER(GET_INT(a) == GET_INT(b));
@@ -30,14 +50,9 @@ Value compare_eq(Value a, Value b) {
       return MAKE_INTEGER(a == b);
     case TYPE_FLOAT:
       return MAKE_INTEGER(GET_FLOAT(a) == GET_FLOAT(b));
-    case TYPE_STRING: {
-      HeapValue* a_ptr = GET_PTR(a);
-      HeapValue* b_ptr = GET_PTR(b);
-
-      if (a_ptr->length != b_ptr->length) return MAKE_INTEGER(0);
-
-      return MAKE_INTEGER(strcmp(a_ptr->as_string, b_ptr->as_string) == 0);
-    }
+    case TYPE_STRING:
+    case TYPE_ARRAY:
+      return MAKE_INTEGER(values_equal(a, b));
     default: 
       THROW_FMT("Cannot compare values of type %s", type_of(a));
   }
@@ -53,471 +68,435 @@ Value compare_or(Value a, Value b) {
   return MAKE_INTEGER(GET_INT(a) || GET_INT(b));
 }
 
-ComparisonFun comparison_table[] = { NULL, NULL, compare_eq, NULL, NULL, compare_and, compare_or };
-
-void op_call(Module *module, int32_t *pc, Value callee, size_t argc) {
-  ASSERT_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack);
+ComparisonFun comparison_table[] = {
+  [CompareEqual] = compare_eq, [CompareAnd] = compare_and, [CompareOr] = compare_or,
+};
 
-  int16_t ipc = (int16_t) (callee & MASK_PAYLOAD_INT);
-  int16_t local_space = (int16_t) ((callee >> 16) & MASK_PAYLOAD_INT);
+// Reference counting, see `value_drop`. Values are all immortal with it
+// off, so the flag only spares the loads.
+#define DUP(value) do { if (IS_PTR(value) && heap_refcounting) value_dup(value); } while (0)
+#define DROP(value) do { if (IS_PTR(value) && heap_refcounting) value_drop(value); } while (0)
 
-  int32_t new_pc = *pc + 4;
-  create_frame(module, new_pc, local_space, argc);
+// Returns `element` read out of `container`, whose reference goes away
+static inline Value take_element(Value container, Value element) {
+  DUP(element);
+  DROP(container);
+  return element;
+}
 
-  *pc = ipc;
+// Typed arrays are indexed, measured and sliced as lists are
+static inline bool indexable(Value value) {
+  ValueType type = get_type(value);
+  return type == TYPE_LIST || type == TYPE_ARRAY;
 }
 
-void op_native_call(Module *module, int32_t *pc, Value callee, size_t argc) {
-  char* fun = GET_NATIVE(callee);
+// Elements of typed arrays are boxed as they are read
+static inline Value get_element(Value list, uint32_t index) {
+  HeapValue* l = GET_PTR(list);
+  if (l->type == TYPE_LIST) return take_element(list, l->as_ptr[index]);
 
-  Value libIdx = stack_pop(module->stack);
-  ASSERT_FMT(get_type(libIdx) == TYPE_INTEGER,
-              "Invalid library (for function %s) index", fun);
-  int32_t lib_idx = GET_INT(libIdx);
-  Value fun_name = stack_pop(module->stack);
-  ASSERT_FMT(get_type(fun_name) == TYPE_INTEGER,
-              "Invalid library (for function %s)", fun);
-  int32_t lib_name = GET_INT(fun_name);
+  Value element = array_get(list, index);
+  DROP(list);
+  return element;
+}
 
-  ASSERT_FMT(module->natives[lib_name].functions != NULL,
-              "Library not loaded (for function %s)", fun);
+// A list whose only reference is the one being sliced is shifted in place
+static Value list_slice(Value list, uint32_t from) {
+  HeapValue* l = GET_PTR(list);
+  uint32_t length = l->length - from;
 
-  if (module->natives[lib_name].functions[lib_idx] == NULL) {
-    void* lib = module->handles[lib_name];
-    ASSERT_FMT(lib != NULL, "Library with function %s not loaded", fun);
-    Native nfun = get_proc_address(lib, fun);
-    ASSERT_FMT(nfun != NULL, "Native function %s not found", fun);
-    module->natives[lib_name].functions[lib_idx] = nfun;
+  if (l->type == TYPE_ARRAY) {
+    Value slice = array_slice(list, from);
+    DROP(list);
+    return slice;
+  }
 
-    Value* args = stack_pop_n(module->stack, argc);
-    Value ret = nfun(argc, module, args);
-    stack_push(module->stack, ret);
-  } else {
-    Native nfun = module->natives[lib_name].functions[lib_idx];
-    ASSERT_FMT(nfun != NULL, "Native function %s not found", fun);
+  if (heap_refcounting && l->refcount == 1) {
+    for (uint32_t i = 0; i < from; i++) value_drop(l->as_ptr[i]);
+    memmove(l->as_ptr, &l->as_ptr[from], length * sizeof(Value));
 
-    Value* args = stack_pop_n(module->stack, argc);
-    Value ret = nfun(argc, module, args);
+    if (heap_tracking) heap_track_free(from * sizeof(Value), TYPE_LIST);
+    l->length = length;
+    l->tag = 0;
+    return list;
+  }
 
-    stack_push(module->stack, ret);
+  Value slice = MAKE_LIST(&l->as_ptr[from], length);
+  if (heap_refcounting) {
+    for (uint32_t i = 0; i < length; i++) value_dup(GET_LIST(slice)[i]);
+    value_drop(list);
   }
 
-  *pc += 4;
+  return slice;
 }
 
-typedef void (*InterpreterFunc)(Module*, int32_t*, Value, size_t);
+// Takes the references of the values not picked
+static inline Value list_pick(Value* values, int32_t count, int32_t index) {
+  if (heap_refcounting) {
+    for (int32_t i = 0; i < count; i++) {
+      if (i != index) value_drop(values[i]);
+    }
+  }
 
-InterpreterFunc interpreter_table[] = { op_native_call, op_call };
+  return values[index];
+}
 
-void run_interpreter(Deserialized des) {
-  Module* module = des.module;
-  int32_t* bytecode = des.instrs;
-  int counter = 0;
-  int32_t pc = 0;
-
-  #define op bytecode[pc]
-  #define i1 bytecode[pc + 1]
-  #define i2 bytecode[pc + 2]
-  #define i3 bytecode[pc + 3]
-
-  #define UNKNOWN &&case_unknown
-
-  void* jmp_table[] = { 
-    &&case_load_local, &&case_store_local, &&case_load_constant, 
-    &&case_load_global, &&case_store_global, &&case_return, 
-    &&case_compare, &&case_and, &&case_or, &&case_load_native, 
-    &&case_make_list, &&case_list_get, &&case_call, 
-    &&case_jump_else_rel, UNKNOWN, UNKNOWN, UNKNOWN,
-    &&case_make_lambda, &&case_get_index, 
-    &&case_special, &&case_jump_rel, &&case_slice, &&case_list_length,
-    &&case_halt, &&case_update, &&case_make_mutable, &&case_unmut, 
-    &&case_add, &&case_sub, &&case_return_const, &&case_add_const, 
-    &&case_sub_const, &&case_jump_else_rel_cmp, UNKNOWN, UNKNOWN, 
-    &&case_ijump_else_rel_cmp_constant, &&case_call_global,
-    &&case_call_local, &&case_make_and_store_lambda, &&case_mul,
-    &&case_mul_const };
-
-  goto *jmp_table[op];
-
-  case_load_local: {
-    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
-
-    Value value = module->stack->values[locals + i1];
-    stack_push(module->stack, value);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+static inline void mutable_update(Value var, Value value) {
+  if (heap_refcounting) {
+    // Immortal boxes only reference immortal values
+    if (GET_PTR(var)->refcount == 0) {
+      value_freeze(value);
+    } else {
+      value_drop(GET_MUTABLE(var));
+    }
   }
 
-  case_store_local: {
-    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
-    module->stack->values[locals + i1] = stack_pop(module->stack);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  GET_MUTABLE(var) = value;
+  DROP(var);
+}
 
-  case_load_constant: {
-    Value value = module->constants[i1];
-    stack_push(module->stack, value);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+// Ropes take over both sides, flat copies neither
+static inline Value concat_strings(Value a, Value b) {
+  Value result = string_concat(a, b);
+
+  if (heap_refcounting) {
+    if (result == a) {
+      value_drop(b);
+    } else if (result == b) {
+      value_drop(a);
+    } else if (GET_PTR(result)->tag == STRING_FLAT) {
+      value_drop(a);
+      value_drop(b);
+    }
   }
 
-  case_load_global: {
-    Value value = module->stack->values[i1];
-    stack_push(module->stack, value);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
-  
-  case_store_global: {
-    module->stack->values[i1] = stack_pop(module->stack);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+  return result;
+}
+
+// Maps reference their keys and values without counting
+static inline Value map_insert_owned(Value map, Value key, Value value) {
+  if (heap_refcounting) {
+    value_freeze(key);
+    value_freeze(value);
   }
-  
-  case_return: {
-    Frame fr = pop_frame(module);
-    Value ret = stack_pop(module->stack);
 
-    module->stack->stack_pointer = fr.stack_pointer;
-    module->base_pointer = fr.base_ptr;
-    stack_push(module->stack, ret);
+  return map_insert(map, key, value);
+}
 
-    pc = fr.instruction_pointer;
-    goto *jmp_table[op];
-  }
-  
-  case_compare: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
-
-    stack_push(module->stack, comparison_table[i1](a, b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
-  
-  case_and: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
+// Drops the values a returning frame leaves between `from` and `to`, and
+// its closure. Called once the frame is popped.
+static void drop_frame(Module* module, Value* from, Value* to) {
+  for (Value* value = from; value < to; value++) value_drop(*value);
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  value_drop(module->envs[module->locals_count]);
+  module->envs[module->locals_count] = 0;
+}
 
-    stack_push(module->stack, MAKE_INTEGER(a && b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+void op_call(Module *module, int32_t *pc, Value callee, size_t argc) {
+  ASSERT_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack);
 
-  case_or: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
+  int16_t ipc = (int16_t) (callee & MASK_PAYLOAD_INT);
+  int16_t local_space = (int16_t) ((callee >> 16) & MASK_PAYLOAD_INT);
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  // The caller has already moved `pc` past the call
+  create_frame(module, *pc, local_space, argc);
 
-    stack_push(module->stack, MAKE_INTEGER(a || b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  *pc = ipc;
+  module->current_pc = ipc;
+  PLUME_PROBE2(function__entry, ipc, module->callstack);
+}
 
-  case_load_native: {
-    Value name = module->constants[i1];
-    ASSERT(get_type(name) == TYPE_STRING, "Invalid native function name type");
-    stack_push(module->stack, MAKE_INTEGER(i2));
-    stack_push(module->stack, MAKE_INTEGER(i3));
-    stack_push(module->stack, name);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
-  
-  case_make_list: {
-    Value* values = malloc(sizeof(Value) * i1);
-    memcpy(values, stack_pop_n(module->stack, i1),
-            i1 * sizeof(Value));
-    stack_push(module->stack, MAKE_LIST(values, i1));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
-  
-  case_list_get: {
-    Value list = stack_pop(module->stack);
-    ASSERT(get_type(list) == TYPE_LIST, "Invalid list type");
-    HeapValue* l = GET_PTR(list);
-    ASSERT(i1 < l->length, "Index out of bounds");
-    stack_push(module->stack, l->as_ptr[i1]);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
-  
-  case_call: {
-    Value callee = stack_pop(module->stack);
+void op_native_call(Module *module, int32_t *pc, Value callee, size_t argc) {
+  char* fun = GET_NATIVE(callee);
 
-    ASSERT(IS_CLO(callee) || IS_PTR(callee), "Invalid callee type");
-  
-    interpreter_table[(callee & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, i1);
+  Value libIdx = stack_pop(module->stack);
+  ASSERT_FMT(get_type(libIdx) == TYPE_INTEGER,
+              "Invalid library (for function %s) index", fun);
+  int32_t lib_idx = GET_INT(libIdx);
+  Value fun_name = stack_pop(module->stack);
+  ASSERT_FMT(get_type(fun_name) == TYPE_INTEGER,
+              "Invalid library (for function %s)", fun);
+  int32_t lib_name = GET_INT(fun_name);
 
-    goto *jmp_table[op];
-  }
-  
-  case_jump_else_rel: {
-    Value value = stack_pop(module->stack);
-    ASSERT(get_type(value) == TYPE_INTEGER, "Invalid value type")
-    if (GET_INT(value) == 0) {
-      INCREASE_IP_BY(pc, i1);
-    } else {
-      INCREASE_IP(pc);
-    }
-    goto *jmp_table[op];
-  }
-  
-  case_make_lambda: {
-    int32_t new_pc = pc + 4;
-    Value lambda = MAKE_FUNCTION(new_pc, i2);
+  Native nfun = module_native(module, lib_name, lib_idx, fun);
 
-    stack_push(module->stack, lambda);
-    INCREASE_IP_BY(pc, i1 + 1);
+  // Arguments stay on the stack during the call, so natives calling back
+  // into Plume code do not overwrite them
+  Value* args = &module->stack->values[module->stack->stack_pointer - argc];
 
-    goto *jmp_table[op];
-  }
-  
-  case_get_index: {
-    Value index = stack_pop(module->stack);
-    Value list = stack_pop(module->stack);
-    ASSERT(get_type(list) == TYPE_LIST, "Invalid list type");
-    ASSERT(get_type(index) == TYPE_INTEGER, "Invalid index type");
-
-    HeapValue* l = GET_PTR(list);
-    ASSERT((int64_t) index < l->length, "Index out of bounds");
-    stack_push(module->stack, l->as_ptr[index]);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+  // Natives do not count the references they keep or hand back
+  if (heap_refcounting) {
+    for (size_t i = 0; i < argc; i++) value_freeze(args[i]);
   }
 
-  case_special: {
-    stack_push(module->stack, MAKE_SPECIAL());
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  HEAP_SITE(*pc - 1);
+  PLUME_PROBE2(native__entry, fun, argc);
+  Value ret = nfun(argc, module, args);
+  PLUME_PROBE2(native__return, fun, argc);
 
-  case_jump_rel: {
-    INCREASE_IP_BY(pc, i1);
-    goto *jmp_table[op];
-  }
-  
-  case_slice: {
-    Value list = stack_pop(module->stack);
-    ASSERT(get_type(list) == TYPE_LIST, "Invalid list type");
-    HeapValue* l = GET_PTR(list);
-    HeapValue* new_list = malloc(sizeof(HeapValue));
-
-    new_list->type = TYPE_LIST;
-    new_list->length = l->length - i1;
-    new_list->as_ptr = malloc(sizeof(Value) * new_list->length);
-
-    memcpy(new_list->as_ptr, &l->as_ptr[i1], (l->length - i1) * sizeof(Value));
-    stack_push(module->stack, MAKE_PTR(new_list));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  // Later allocations without a site are not the native's
+  HEAP_SITE(-1);
 
-  case_list_length: {
-    Value list = stack_pop(module->stack);
-    ASSERT(get_type(list) == TYPE_LIST, "Invalid list type");
-    HeapValue* l = GET_PTR(list);
-    stack_push(module->stack, MAKE_INTEGER(l->length));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  module->stack->stack_pointer -= argc;
 
-  case_halt: {
-    halt = 1;
-    return;
-  }
+  stack_push(module->stack, ret);
+}
 
-  case_update: {
-    Value var = stack_pop(module->stack);
-    ASSERT(get_type(var) == TYPE_MUTABLE, "Invalid mutable type");
+void op_closure_call(Module *module, int32_t *pc, Value callee, size_t argc) {
+  op_call(module, pc, GET_CLOSURE_CODE(callee), argc);
+  module->envs[module->locals_count - 1] = callee;
+}
 
-    HeapValue* l = GET_PTR(var);
+// Hits skip the frame altogether. Misses run in a frame returning to
+// `MemoReturn`, which caches the result before going on at `*pc`.
+void op_memo_call(Module *module, int32_t *pc, Value callee, size_t argc) {
+  Value* args = &module->stack->values[module->stack->stack_pointer - argc];
 
-    Value value = stack_pop(module->stack);
-    memcpy(l->as_ptr, &value, sizeof(Value));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  Value result;
+  if (memo_lookup(callee, args, argc, &result)) {
+    // The call owned its arguments
+    for (size_t i = 0; i < argc; i++) DROP(args[i]);
 
-  case_make_mutable: {
-    Value value = stack_pop(module->stack);
-    Value* v = malloc(sizeof(Value));
-    memcpy(v, &value, sizeof(Value));
-    HeapValue* l = malloc(sizeof(HeapValue));
-    l->type = TYPE_MUTABLE;
-    l->length = 1;
-    l->as_ptr = v;
-    Value mutable = MAKE_PTR(l);
-    stack_push(module->stack, mutable);
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+    module->stack->stack_pointer -= argc;
+    stack_push(module->stack, result);
+    return;
   }
 
-  case_unmut: {
-    Value value = stack_pop(module->stack);
-    ASSERT(get_type(value) == TYPE_MUTABLE, "Invalid mutable type");
-    stack_push(module->stack, GET_MUTABLE(value));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+  if (argc > MEMO_MAX_ARGS || module->memo_pc < 0) {
+    op_closure_call(module, pc, callee, argc);
+    return;
   }
-    
-  case_add: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
-
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
 
-    stack_push(module->stack, MAKE_INTEGER(a + b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
+  // The frame drops its arguments before they are cached
+  MemoCall *call = &module->memo_calls[module->memo_count++];
+  call->callee = callee;
+  call->argc = argc;
+  call->pc = *pc;
+  for (size_t i = 0; i < argc; i++) {
+    call->args[i] = args[i];
+    DUP(args[i]);
   }
 
-  case_sub: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
+  *pc = module->memo_pc;
+  op_closure_call(module, pc, callee, argc);
+}
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+// Caches `result` of the innermost memoized call, returning where it goes on
+static int32_t memo_return(Module *module, Value result) {
+  MemoCall *call = &module->memo_calls[--module->memo_count];
+  memo_store(call->callee, call->args, call->argc, result);
 
-    stack_push(module->stack, MAKE_INTEGER(b - a));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  for (size_t i = 0; i < call->argc; i++) DROP(call->args[i]);
 
-  case_return_const: {
-    Frame fr = pop_frame(module);
-    module->stack->stack_pointer = fr.stack_pointer;
-    module->base_pointer = fr.base_ptr;
+  module->current_pc = call->pc;
+  return call->pc;
+}
 
-    stack_push(module->stack, module->constants[i1]);
+// Heap callees are either closures or native function names
+void op_pointer_call(Module *module, int32_t *pc, Value callee, size_t argc) {
+  if (GET_PTR(callee)->type == TYPE_CLOSURE && GET_PTR(callee)->tag == CLOSURE_MEMOIZED) {
+    op_memo_call(module, pc, callee, argc);
+  } else if (GET_PTR(callee)->type == TYPE_CLOSURE) {
+    op_closure_call(module, pc, callee, argc);
+  } else {
+    op_native_call(module, pc, callee, argc);
+  }
+}
 
-    pc = fr.instruction_pointer;
+typedef void (*InterpreterFunc)(Module*, int32_t*, Value, size_t);
 
-    goto *jmp_table[op];
-  }
+InterpreterFunc interpreter_table[] = { op_pointer_call, op_call };
 
-  case_add_const: {
-    Value a = stack_pop(module->stack);
-    Value b = module->constants[i1];
+// Interned results of OP_TypeOf
+static Value type_names[TYPE_UNKNOWN + 1];
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+#if PLUME_TAIL_CALLS
 
-    stack_push(module->stack, MAKE_INTEGER(a + b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+// Each opcode is a function ending in a tail call to the next one, with
+// the VM state passed as arguments so that it stays in registers across
+// the whole chain. `sp` points one past the top of the stack, whose value
+// is held in `tos` rather than in its slot. Both are written back to the
+// module around anything that may look at the stack.
 
-  case_sub_const: {
-    Value a = stack_pop(module->stack);
-    Value b = module->constants[i1];
+// Only musttail guarantees the chain does not grow the C stack: clang and
+// GCC 15 have it. Nested, the combined test does not parse without
+// __has_attribute.
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define MUSTTAIL __attribute__((musttail))
+#endif
+#endif
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
-    stack_push(module->stack, MAKE_INTEGER(a - b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+#ifndef MUSTTAIL
+#error "PLUME_TAIL_CALLS needs a compiler supporting musttail"
+#endif
 
-  case_jump_else_rel_cmp: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
+typedef struct Dispatch Dispatch;
 
-    Value cmp = comparison_table[i2](a, b);
-    ASSERT(get_type(cmp) == TYPE_INTEGER, "Expected integer");
+#define TAIL_PARAMS \
+  Module* module, const uint8_t* ip, Value* sp, Value* locals, Value tos, const Dispatch* table
+#define TAIL_ARGS module, ip, sp, locals, tos, table
 
-    if (GET_INT(cmp) == 0) {
-      INCREASE_IP_BY(pc, i1);
-    } else {
-      INCREASE_IP(pc);
-    }
+typedef Value (*Handler)(TAIL_PARAMS);
 
-    goto *jmp_table[op];
-  }
+struct Dispatch {
+  Handler handlers[OPCODE_COUNT];
+};
 
-  case_ijump_else_rel_cmp_constant: {
-    Value a = stack_pop(module->stack);
-    Value b = module->constants[i3];
+#define TAIL(name) LOOP(tail_##name)
+#define HANDLER(name) static Value TAIL(name)(TAIL_PARAMS)
+#define DISPATCH() MUSTTAIL return table->handlers[*ip](TAIL_ARGS)
 
-    ASSERT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers");
-    
-    void* icomparison_table[] = { 
-      UNKNOWN, UNKNOWN, &&icmp_eq, UNKNOWN, 
-      UNKNOWN, &&icmp_and, &&icmp_or };
+#define op (*ip)
+#define i1 read_operand(ip + 1)
+#define i2 read_operand(ip + 3)
+#define i3 read_operand(ip + 5)
+#define PC() ((int32_t) (ip - module->code))
 
-    uint32_t res;
+#define NEXT(opcode) ip += ENCODED_SIZE(opcode); DISPATCH()
 
-    goto *icomparison_table[i2];
+#define PUSH(value)           \
+  do {                        \
+    Value pushed = (value);   \
+    sp[-1] = tos;             \
+    tos = pushed;             \
+    sp++;                     \
+  } while (0)
 
-    icmp_eq: { res = GET_INT(a) == GET_INT(b); goto next; }
-    icmp_and: { res = GET_INT(a) & GET_INT(b); goto next; }
-    icmp_or: { res = GET_INT(a) | GET_INT(b); goto next; }
+#define POP(name) Value name = tos; sp--; tos = sp[-1]
 
-    next: {
-      INCREASE_IP_BY(pc, (uint32_t) res == 0 ? i1 : 1);
-      goto *jmp_table[op];
-    }
-  }
+// Pops the two topmost values, the result is then stored in `tos`
+#define POP2(a, b) Value a = tos; Value b = sp[-2]; sp--
 
-  case_call_global: {
-    Value callee = module->stack->values[i1];
+// Pops `n` values, returning them in stack order
+#define POP_N(n) (sp[-1] = tos, sp -= (n), tos = sp[-1], sp)
 
-    ASSERT(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
-  
-    interpreter_table[(callee & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, i2);
+#define SPILL()                                                     \
+  do {                                                              \
+    sp[-1] = tos;                                                   \
+    module->stack->stack_pointer = sp - module->stack->values;      \
+  } while (0)
 
-    goto *jmp_table[op];
-  }
+#define RELOAD()                                                    \
+  do {                                                              \
+    sp = module->stack->values + module->stack->stack_pointer;      \
+    tos = sp[-1];                                                   \
+    locals = frame_locals(module);                                  \
+  } while (0)
 
-  case_call_local: {
-    size_t locals = module->base_pointer - module->locals[module->locals_count - 1];
+static _Thread_local uint64_t counted = 0;
 
-    Value callee = module->stack->values[locals + i1];
+static inline Value* frame_locals(Module* module) {
+  if (module->locals_count == 0) return module->stack->values;
+  return &module->stack->values[module->base_pointer - module->locals[module->locals_count - 1]];
+}
 
-    ASSERT(IS_FUN(callee) || IS_PTR(callee), "Invalid callee type");
-  
-    interpreter_table[(callee & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, i1);
+// Calls go through the module's stack, `pc` is already past the call
+#define CALL(callee, argc)                                                        \
+  do {                                                                            \
+    int32_t pc = PC();                                                            \
+    SPILL();                                                                      \
+    CHECK_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack); \
+    interpreter_table[((callee) & MASK_SIGNATURE) == SIGNATURE_FUNCTION](module, &pc, callee, argc); \
+    ip = module->code + pc;                                                       \
+    RELOAD();                                                                     \
+  } while (0)
+
+#define RETURN(value)                                                             \
+  do {                                                                            \
+    Value ret = (value);                                                          \
+    Frame fr = pop_frame(module);                                                 \
+    if (heap_refcounting) {                                                       \
+      sp[-1] = tos;                                                               \
+      drop_frame(module, module->stack->values + fr.stack_pointer,                \
+                 ret == tos ? sp - 1 : sp);                                       \
+    }                                                                             \
+    module->base_pointer = fr.base_ptr;                                           \
+    sp = module->stack->values + fr.stack_pointer + 1;                            \
+    tos = ret;                                                                    \
+    locals = frame_locals(module);                                                \
+    ip = module->code + fr.instruction_pointer;                                   \
+    module->current_pc = fr.instruction_pointer;                                  \
+    DISPATCH();                                                                   \
+  } while (0)
+
+#endif
+
+// Checks of the checked loop, always on in builds with assertions
+#define CHECK(condition, message) \
+  if ((CHECKED || ENABLE_ASSERTIONS) && !(condition)) { THROW(message); }
+#define CHECK_FMT(condition, ...) \
+  if ((CHECKED || ENABLE_ASSERTIONS) && !(condition)) { THROW_FMT(__VA_ARGS__); }
+
+#define CHECKED 1
+#define LOOP(name) name##_checked
+#include <interpreter_loop.h>
+#undef LOOP
+#undef CHECKED
+
+#define CHECKED 0
+#define LOOP(name) name##_unchecked
+#include <interpreter_loop.h>
+#undef LOOP
+#undef CHECKED
+
+// Runs from `pc` until the next `Halt`, returning the value on top of the
+// stack at that point
+static Value interpret(Module* module, uint8_t* bytecode, int32_t pc) {
+  if (interpreter_checked) return interpret_checked(module, bytecode, pc);
+  return interpret_unchecked(module, bytecode, pc);
+}
 
-    goto *jmp_table[op];
+void run_interpreter(Deserialized des) {
+  for (int i = 0; i <= TYPE_UNKNOWN; i++) {
+    char* name = type_name(i);
+    type_names[i] = MAKE_STRING(name, strlen(name));
+    value_freeze(type_names[i]);
+  }
+
+  // Calls from natives return into the program's final `Halt`
+  des.module->code = des.code;
+  for (size_t idx = des.instr_count; idx > 0; idx--) {
+    if (des.instrs[(idx - 1) * 4] == OP_Halt) {
+      des.module->halt_pc = des.offsets[idx - 1];
+      break;
+    }
   }
+  des.module->memo_pc = des.memo_pc;
 
-  case_make_and_store_lambda: {
-    int32_t new_pc = pc + 4;
-    Value lambda = MAKE_FUNCTION(new_pc, i3);
+  interpret(des.module, des.code, 0);
+  output_finish();
 
-    module->stack->values[i1] = lambda;
+  // Nothing allocated by the program outlives it
+  if (heap_arena) heap_arena_release();
+}
 
-    INCREASE_IP_BY(pc, i2 + 1);
-    goto *jmp_table[op];
-  }
+Value interpreter_call(Module* module, Value callee, Value* args, size_t argc) {
+  if (module->code == NULL || module->halt_pc < 0)
+    THROW("Plume functions can only be called back from the interpreter");
 
-  case_mul: {
-    Value a = stack_pop(module->stack);
-    Value b = stack_pop(module->stack);
+  Value code = IS_PTR(callee) ? GET_CLOSURE_CODE(callee) : callee;
+  int16_t ipc = (int16_t) (code & MASK_PAYLOAD_INT);
+  int16_t local_space = (int16_t) ((code >> 16) & MASK_PAYLOAD_INT);
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  ASSERT_FMT(module->callstack < MAX_FRAMES, "Call stack overflow, reached %zu", module->callstack);
 
-    stack_push(module->stack, MAKE_INTEGER(a * b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  Value result;
+  bool memoized = IS_PTR(callee) && GET_PTR(callee)->tag == CLOSURE_MEMOIZED;
+  if (memoized && memo_lookup(callee, args, argc, &result)) return result;
 
-  case_mul_const: {
-    Value a = stack_pop(module->stack);
-    Value b = module->constants[i1];
+  // The frame drops its arguments and closure on return
+  for (size_t i = 0; i < argc; i++) DUP(args[i]);
+  DUP(callee);
 
-    ASSERT_FMT(get_type(a) == TYPE_INTEGER && get_type(b) == TYPE_INTEGER, "Expected integers, got %s and %s", type_of(a), type_of(b));
+  stack_push_n(module->stack, args, argc);
+  create_frame(module, module->halt_pc, local_space, argc);
+  if (IS_PTR(callee)) module->envs[module->locals_count - 1] = callee;
 
-    stack_push(module->stack, MAKE_INTEGER(a * b));
-    INCREASE_IP(pc);
-    goto *jmp_table[op];
-  }
+  Value ret = interpret(module, module->code, ipc);
+  module->stack->stack_pointer--;
 
-  case_unknown: {
-    THROW_FMT("Unknown opcode: %d", op);
-    return;
-  }
+  if (memoized) memo_store(callee, args, argc, ret);
+  return ret;
 }
 
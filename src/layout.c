@@ -0,0 +1,63 @@
+#include <core/error.h>
+#include <encoding.h>
+#include <layout.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LAYOUT_VERSION 1
+
+uint64_t *layout_counts = NULL;
+
+void layout_profile_start() {
+  layout_counts = calloc(ENCODED_CAPACITY, sizeof(uint64_t));
+}
+
+void layout_profile_write(Deserialized des, const char *path) {
+  if (layout_counts == NULL) return;
+
+  // Inlined bodies and encoder jumps count for the instruction they stand in for
+  uint64_t *counts = calloc(des.instr_count + 1, sizeof(uint64_t));
+  for (int32_t pc = 0; pc < ENCODED_CAPACITY; pc++) {
+    if (layout_counts[pc] == 0) continue;
+
+    int32_t idx = encoded_instruction(pc);
+    if (idx >= 0) counts[idx] += layout_counts[pc];
+  }
+
+  FILE *file = fopen(path, "w");
+  if (file == NULL) THROW_FMT("Could not open layout profile: %s", path);
+
+  // "plume-layout version instructions", then one "index count" line per
+  // instruction that ran
+  fprintf(file, "plume-layout %d %zu\n", LAYOUT_VERSION, des.instr_count);
+  for (size_t idx = 0; idx < des.instr_count; idx++) {
+    if (counts[idx] > 0) fprintf(file, "%zu %llu\n", idx, (unsigned long long) counts[idx]);
+  }
+
+  fclose(file);
+  free(counts);
+  free(layout_counts);
+  layout_counts = NULL;
+}
+
+uint64_t *layout_profile_read(const char *path, size_t instr_count) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) THROW_FMT("Could not open layout profile: %s", path);
+
+  int version;
+  size_t count;
+  if (fscanf(file, "plume-layout %d %zu", &version, &count) != 2 || version != LAYOUT_VERSION)
+    THROW_FMT("Invalid layout profile: %s", path);
+  if (count != instr_count) THROW_FMT("Layout profile %s is for another program", path);
+
+  uint64_t *counts = calloc(instr_count, sizeof(uint64_t));
+  size_t idx;
+  unsigned long long executed;
+  while (fscanf(file, "%zu %llu", &idx, &executed) == 2) {
+    if (idx >= instr_count) THROW_FMT("Invalid layout profile: %s", path);
+    counts[idx] = executed;
+  }
+
+  fclose(file);
+  return counts;
+}
@@ -1,30 +1,83 @@
+#include <cache.h>
 #include <core/debug.h>
 #include <core/error.h>
 #include <core/library.h>
 #include <deserializer.h>
+#include <encoding.h>
+#include <heap.h>
 #include <interpreter.h>
+#include <layout.h>
+#include <memo.h>
+#include <output.h>
+#include <profiler.h>
+#include <serializer.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stats.h>
+#include <string.h>
 #include <time.h>
 
-#ifdef _WIN32
-#define PATH_SEP '\\'
-#else
-#define PATH_SEP '/'
-#endif
-
 #define PLUME_VERSION "0.0.1"
 
-struct Env {
-  char* path;
-  uint8_t res;
+struct Options {
+  int file_index;
+  bool profile_sample;
+  bool profile_alloc;
+  bool optimize;
+  bool cache;
+  bool stats;
+  bool checked;
+  bool unchecked;
+  bool refcount;
+  bool arena;
+  char* profile_output;
+  char* convert;
+  char* layout_profile;
+  char* layout;
 };
 
-static inline struct Env get_std_path() {
-  struct Env env;
-  env.path = getenv("PLUME_PATH");
-  env.res = env.path == NULL;
-  return env;
+// VM options come before the bytecode file, everything after belongs to
+// the program.
+static struct Options parse_options(int argc, char** argv) {
+  struct Options options = { 1, false, false, true, true, false, false, false, false, false, "plume-profile.folded", NULL, NULL, NULL };
+
+  for (; options.file_index < argc; options.file_index++) {
+    char* arg = argv[options.file_index];
+    if (strncmp(arg, "--", 2) != 0) break;
+
+    if (strcmp(arg, "--profile=sample") == 0) {
+      options.profile_sample = true;
+    } else if (strcmp(arg, "--profile=alloc") == 0) {
+      options.profile_alloc = true;
+    } else if (strcmp(arg, "--no-optimize") == 0) {
+      options.optimize = false;
+    } else if (strcmp(arg, "--stats") == 0) {
+      options.stats = true;
+    } else if (strcmp(arg, "--checked") == 0) {
+      options.checked = true;
+    } else if (strcmp(arg, "--unchecked") == 0) {
+      options.unchecked = true;
+    } else if (strcmp(arg, "--refcount") == 0) {
+      options.refcount = true;
+    } else if (strcmp(arg, "--arena") == 0) {
+      options.arena = true;
+    } else if (strcmp(arg, "--no-cache") == 0) {
+      options.cache = false;
+    } else if (strncmp(arg, "--profile-output=", 17) == 0) {
+      options.profile_output = arg + 17;
+    } else if (strncmp(arg, "--convert=", 10) == 0) {
+      options.convert = arg + 10;
+    } else if (strncmp(arg, "--layout-profile=", 17) == 0) {
+      options.layout_profile = arg + 17;
+    } else if (strncmp(arg, "--layout=", 9) == 0) {
+      options.layout = arg + 9;
+    } else {
+      THROW_FMT("Unknown option: %s", arg);
+    }
+  }
+
+  return options;
 }
 
 int main(int argc, char** argv) {
@@ -32,46 +85,81 @@ int main(int argc, char** argv) {
   unsigned long long start = clock_gettime_nsec_np(CLOCK_MONOTONIC);
   #endif
   
-  if (argc < 2) THROW_FMT("Usage: %s <file>\n", argv[0]);
-  FILE* file = fopen(argv[1], "rb");
+  struct Options options = parse_options(argc, argv);
+  if (options.profile_alloc) heap_stats_start();
+
+  // Loading allocates from the arena too, it is all released after the run
+  heap_arena = options.arena;
+  output_start();
+  if (options.stats) stats_start();
+
+  if (options.file_index >= argc) THROW_FMT("Usage: %s [options] <file>\n", argv[0]);
+  char* path = argv[options.file_index];
+  FILE* file = fopen(path, "rb");
+
+  // The program sees the VM path followed by the file and its arguments
+  int program_argc = argc - options.file_index + 1;
+  Value* values = malloc(program_argc * sizeof(Value));
+  values[0] = MAKE_STRING(argv[0], strlen(argv[0]));
+  for (int i = 1; i < program_argc; i++) {
+    char* arg = argv[options.file_index + i - 1];
+    values[i] = MAKE_STRING(arg, strlen(arg));
+  }
 
-  Value* values = malloc(argc * sizeof(Value));
-  for (int i = 0; i < argc; i++) {
-    values[i] = MAKE_STRING(argv[i], strlen(argv[i]));
+  if (file == NULL) THROW_FMT("Could not open file: %s\n", path);
+
+  // Rewrites the program in the sectioned format instead of running it,
+  // marked trusted when vouched for with --unchecked
+  if (options.convert != NULL) {
+    FILE* out = fopen(options.convert, "wb");
+    if (out == NULL) THROW_FMT("Could not open file: %s\n", options.convert);
+    Deserialized converted = deserialize(file);
+    converted.trusted = converted.trusted || options.unchecked;
+    serialize(converted, out);
+    fclose(out);
+    return 0;
   }
 
-  if (file == NULL) THROW_FMT("Could not open file: %s\n", argv[1]);
+  // A cached image of the program skips deserialization and encoding.
+  // Otherwise load-time passes run per function on first call, see `encode`.
+  Deserialized des;
+  CacheImage image;
+  Encoding encoding;
+  uint64_t key = options.cache ? cache_key(file, options.optimize, options.refcount, options.layout) : 0;
+  bool cached = options.cache && cache_load(key, &des, &image, &encoding);
+
+  if (!cached) des = deserialize(file);
+
+  // Constants and program arguments stay immortal, functions are encoded
+  // for reference counting from here on
+  heap_refcounting = options.refcount;
+
+  // Code is laid out by the counts of a previous run, if given
+  uint64_t* layout = options.layout != NULL ? layout_profile_read(options.layout, des.instr_count) : NULL;
+
+  if (cached) {
+    encode_resume(&des, encoding, options.optimize, layout);
+  } else {
+    encode(&des, options.optimize, layout);
+
+    // The image is saved with every function encoded if they fit, so that
+    // later starts run no load-time passes at all
+    if (options.cache) {
+      encode_all();
+      cache_store(key, des, encoding_state());
+    }
+  }
 
-  Deserialized des = deserialize(file);
+  if (options.profile_alloc) heap_stats_attach(des.instrs, des.offsets, des.instr_count, ENCODED_CAPACITY);
 
   fclose(file);
 
-  des.module->argc = argc;
-  des.module->argv = values;
-  des.module->handles = malloc(des.libraries.num_libraries * sizeof(void*));
-
-  struct Env res = get_std_path();
-
-  // TODO: Implement library loading in a flat manner
-  //       in order to avoid `calloc` calls in the loop.
-  Libraries libs = des.libraries;
-
-  for (int i = 0; i < des.libraries.num_libraries; i++) {
-    Library lib = libs.libraries[i];
-    char* path = lib.name;
+  if (options.stats) stats_phase(PHASE_LIBRARIES);
 
-    char* final_path = malloc((lib.is_standard ? strlen(res.path) + 1 : 0) + strlen(path) + 1);
-
-    if (lib.is_standard) {
-      sprintf(final_path, "%s%c%s", res.path, PATH_SEP, path);
-    } else {
-      strcpy(final_path, path);
-    }
-
-    des.module->handles[i] = load_library(final_path);
-    des.module->natives[i].functions =
-        calloc(lib.num_functions, sizeof(Native));
-  }
+  des.module->argc = program_argc;
+  des.module->argv = values;
+  module_load_libraries(des.module, des.libraries);
+  if (cached) cache_bind_natives(image, des.module);
 
   #if DEBUG
   DEBUG_PRINTLN("Instruction count: %zu", des.instr_count);
@@ -84,8 +172,28 @@ int main(int argc, char** argv) {
   unsigned long long start_interp = clock_gettime_nsec_np(CLOCK_MONOTONIC);
   #endif
 
+  // Only bytecode marked as type checked skips the checks, unless asked
+  // otherwise
+  interpreter_checked = options.checked || (!options.unchecked && !des.trusted);
+
+  if (options.profile_sample) profiler_start(des, options.profile_output);
+  if (options.stats) {
+    interpreter_counting = true;
+    stats_phase(PHASE_EXECUTE);
+  }
+  if (options.layout_profile != NULL) layout_profile_start();
+
   run_interpreter(des);
 
+  if (options.stats) {
+    stats_report(interpreter_dispatched(), interpreter_counting_instrumented);
+    memo_report();
+  }
+
+  if (options.profile_sample) profiler_stop();
+  if (options.layout_profile != NULL) layout_profile_write(des, options.layout_profile);
+  if (options.profile_alloc) heap_stats_report();
+
   #if DEBUG
   unsigned long long end_interp = clock_gettime_nsec_np(CLOCK_MONOTONIC);
 
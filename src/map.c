@@ -0,0 +1,456 @@
+#include <array.h>
+#include <core/error.h>
+#include <heap.h>
+#include <map.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
+
+#define LSBS 0x0101010101010101ull
+#define MSBS 0x8080808080808080ull
+
+static inline uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void* bytes, size_t size) {
+  const uint8_t* data = bytes;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ data[i]) * 1099511628211ull;
+  }
+  return mix(h);
+}
+
+uint64_t hash_value(Value value) {
+  switch (get_type(value)) {
+    case TYPE_STRING:
+      return hash_bytes(14695981039346656037ull, string_bytes(value), GET_PTR(value)->length);
+    case TYPE_ARRAY: {
+      HeapValue* array = GET_PTR(value);
+      return hash_bytes(mix(array->tag), array->as_ptr,
+                        array->length * array_element_size(array->tag));
+    }
+    case TYPE_LIST: {
+      HeapValue* list = GET_PTR(value);
+
+      uint64_t h = mix(list->length);
+      for (uint32_t i = 0; i < list->length; i++) {
+        h = mix(h ^ hash_value(list->as_ptr[i]));
+      }
+      return h;
+    }
+    default:
+      // Scalars hash by their encoding, mutables and maps by identity
+      return mix(value);
+  }
+}
+
+bool values_equal(Value a, Value b) {
+  if (a == b) return true;
+
+  ValueType type = get_type(a);
+  if (type != get_type(b)) return false;
+
+  HeapValue* x = type == TYPE_STRING || type == TYPE_LIST || type == TYPE_ARRAY ? GET_PTR(a) : NULL;
+  HeapValue* y = x != NULL ? GET_PTR(b) : NULL;
+
+  switch (type) {
+    case TYPE_STRING:
+      return x->length == y->length &&
+             memcmp(string_bytes(a), string_bytes(b), x->length) == 0;
+    case TYPE_LIST: {
+      if (x->length != y->length) return false;
+
+      for (uint32_t i = 0; i < x->length; i++) {
+        if (!values_equal(x->as_ptr[i], y->as_ptr[i])) return false;
+      }
+      return true;
+    }
+    case TYPE_ARRAY:
+      // Bitwise, as `equal` compares floats
+      return x->tag == y->tag && x->length == y->length &&
+             memcmp(x->as_ptr, y->as_ptr, x->length * array_element_size(x->tag)) == 0;
+    default:
+      return false;
+  }
+}
+
+// Swiss table groups: each control byte is EMPTY, DELETED or the low seven
+// bits of a full slot's hash. Eight of them are matched at once.
+
+static inline uint64_t group_load(const uint8_t* ctrl) {
+  uint64_t group;
+  memcpy(&group, ctrl, sizeof(group));
+  return group;
+}
+
+static inline uint64_t group_match(uint64_t group, uint8_t h2) {
+  uint64_t x = group ^ (LSBS * h2);
+  return (x - LSBS) & ~x & MSBS;
+}
+
+static inline uint64_t group_match_empty(uint64_t group) {
+  return group & (~group << 6) & MSBS;
+}
+
+static inline uint64_t group_match_free(uint64_t group) {
+  return group & ~(group << 7) & MSBS;
+}
+
+static inline size_t group_first(uint64_t match) {
+  return __builtin_ctzll(match) / 8;
+}
+
+static MapEntry* table_find(Map* map, Value key, uint64_t hash) {
+  if (map->capacity == 0) return NULL;
+
+  size_t mask = map->capacity / MAP_GROUP_WIDTH - 1;
+  size_t group = (hash >> 7) & mask;
+  uint8_t h2 = hash & 0x7F;
+
+  for (size_t step = 1; step <= mask + 1; step++) {
+    size_t base = group * MAP_GROUP_WIDTH;
+    uint64_t ctrl = group_load(&map->ctrl[base]);
+
+    for (uint64_t match = group_match(ctrl, h2); match; match &= match - 1) {
+      MapEntry* entry = &map->entries[base + group_first(match)];
+      if (values_equal(entry->key, key)) return entry;
+    }
+
+    if (group_match_empty(ctrl)) return NULL;
+    group = (group + step) & mask;
+  }
+
+  return NULL;
+}
+
+static void table_insert_new(Map* map, Value key, Value value, uint64_t hash) {
+  size_t mask = map->capacity / MAP_GROUP_WIDTH - 1;
+  size_t group = (hash >> 7) & mask;
+
+  for (size_t step = 1;; step++) {
+    size_t base = group * MAP_GROUP_WIDTH;
+    uint64_t match = group_match_free(group_load(&map->ctrl[base]));
+
+    if (match) {
+      size_t slot = base + group_first(match);
+      if (map->ctrl[slot] == CTRL_EMPTY) map->growth_left--;
+
+      map->ctrl[slot] = hash & 0x7F;
+      map->entries[slot] = (MapEntry) { key, value };
+      return;
+    }
+
+    group = (group + step) & mask;
+  }
+}
+
+// Rehashes into a table sized for `size + 1` entries, dropping tombstones
+static void table_resize(Map* map, uint32_t size) {
+  uint32_t capacity = MAP_MIN_CAPACITY;
+  while ((uint64_t) (size + 1) * 8 > (uint64_t) capacity * 7) capacity *= 2;
+
+  Map old = *map;
+
+  map->capacity = capacity;
+  map->growth_left = capacity * 7 / 8;
+  map->ctrl = heap_alloc(capacity, TYPE_MAP);
+  map->entries = heap_alloc(capacity * sizeof(MapEntry), TYPE_MAP);
+  memset(map->ctrl, CTRL_EMPTY, capacity);
+
+  for (uint32_t i = 0; i < old.capacity; i++) {
+    if (old.ctrl[i] & CTRL_EMPTY) continue;
+    MapEntry entry = old.entries[i];
+    table_insert_new(map, entry.key, entry.value, hash_value(entry.key));
+  }
+
+  if (old.capacity > 0) {
+    heap_free(old.ctrl, old.capacity, TYPE_MAP);
+    heap_free(old.entries, old.capacity * sizeof(MapEntry), TYPE_MAP);
+  }
+}
+
+// Persistent trie. Nodes are never mutated once built, updates copy the
+// nodes along the path and share everything else.
+
+static inline uint32_t hamt_count(HamtNode* node, int shift) {
+  return shift >= HAMT_MAX_SHIFT ? node->bitmap : __builtin_popcount(node->bitmap);
+}
+
+static HamtNode* hamt_node_new(uint32_t bitmap, uint32_t count) {
+  HamtNode* node = heap_alloc(sizeof(HamtNode) + count * sizeof(MapEntry), TYPE_PMAP);
+  node->bitmap = bitmap;
+  return node;
+}
+
+// Copies `node` with `count` entries, inserting `entry` at `at` when
+// `insert` is set and replacing it otherwise
+static HamtNode* hamt_with(HamtNode* node, uint32_t bitmap, uint32_t count,
+                           uint32_t at, MapEntry entry, bool insert) {
+  uint32_t new_count = insert ? count + 1 : count;
+  HamtNode* copy = hamt_node_new(bitmap, new_count);
+
+  memcpy(copy->entries, node->entries, at * sizeof(MapEntry));
+  copy->entries[at] = entry;
+  uint32_t rest = insert ? at : at + 1;
+  memcpy(&copy->entries[at + 1], &node->entries[rest], (count - rest) * sizeof(MapEntry));
+
+  return copy;
+}
+
+static HamtNode* hamt_without(HamtNode* node, uint32_t bitmap, uint32_t count, uint32_t at) {
+  HamtNode* copy = hamt_node_new(bitmap, count - 1);
+
+  memcpy(copy->entries, node->entries, at * sizeof(MapEntry));
+  memcpy(&copy->entries[at], &node->entries[at + 1], (count - at - 1) * sizeof(MapEntry));
+
+  return copy;
+}
+
+static bool hamt_get(HamtNode* node, Value key, uint64_t hash, Value* out) {
+  for (int shift = 0; node != NULL; shift += HAMT_BITS) {
+    if (shift >= HAMT_MAX_SHIFT) {
+      for (uint32_t i = 0; i < node->bitmap; i++) {
+        if (values_equal(node->entries[i].key, key)) {
+          *out = node->entries[i].value;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    uint32_t bit = 1u << ((hash >> shift) & 31);
+    if ((node->bitmap & bit) == 0) return false;
+
+    MapEntry* entry = &node->entries[__builtin_popcount(node->bitmap & (bit - 1))];
+    if (entry->key == HAMT_CHILD) {
+      node = (HamtNode*) (uintptr_t) entry->value;
+      continue;
+    }
+
+    if (!values_equal(entry->key, key)) return false;
+
+    *out = entry->value;
+    return true;
+  }
+
+  return false;
+}
+
+static HamtNode* hamt_insert(HamtNode* node, MapEntry entry, uint64_t hash, int shift, bool* added) {
+  if (shift >= HAMT_MAX_SHIFT) {
+    uint32_t count = node != NULL ? node->bitmap : 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+      if (values_equal(node->entries[i].key, entry.key))
+        return hamt_with(node, count, count, i, entry, false);
+    }
+
+    *added = true;
+    if (node == NULL) {
+      HamtNode* bucket = hamt_node_new(1, 1);
+      bucket->entries[0] = entry;
+      return bucket;
+    }
+
+    return hamt_with(node, count + 1, count, count, entry, true);
+  }
+
+  uint32_t bit = 1u << ((hash >> shift) & 31);
+
+  if (node == NULL) {
+    *added = true;
+    HamtNode* leaf = hamt_node_new(bit, 1);
+    leaf->entries[0] = entry;
+    return leaf;
+  }
+
+  uint32_t count = hamt_count(node, shift);
+  uint32_t at = __builtin_popcount(node->bitmap & (bit - 1));
+
+  if ((node->bitmap & bit) == 0) {
+    *added = true;
+    return hamt_with(node, node->bitmap | bit, count, at, entry, true);
+  }
+
+  MapEntry current = node->entries[at];
+  MapEntry replacement = entry;
+
+  if (current.key == HAMT_CHILD) {
+    HamtNode* child = hamt_insert((HamtNode*) (uintptr_t) current.value, entry, hash, shift + HAMT_BITS, added);
+    replacement = (MapEntry) { HAMT_CHILD, (Value) (uintptr_t) child };
+  } else if (!values_equal(current.key, entry.key)) {
+    // Push both entries one level down
+    HamtNode* child = hamt_insert(NULL, current, hash_value(current.key), shift + HAMT_BITS, added);
+    *added = false;
+    child = hamt_insert(child, entry, hash, shift + HAMT_BITS, added);
+    replacement = (MapEntry) { HAMT_CHILD, (Value) (uintptr_t) child };
+  }
+
+  return hamt_with(node, node->bitmap, count, at, replacement, false);
+}
+
+static HamtNode* hamt_remove(HamtNode* node, Value key, uint64_t hash, int shift, bool* removed) {
+  if (node == NULL) return NULL;
+
+  if (shift >= HAMT_MAX_SHIFT) {
+    for (uint32_t i = 0; i < node->bitmap; i++) {
+      if (!values_equal(node->entries[i].key, key)) continue;
+
+      *removed = true;
+      return node->bitmap == 1 ? NULL : hamt_without(node, node->bitmap - 1, node->bitmap, i);
+    }
+    return node;
+  }
+
+  uint32_t bit = 1u << ((hash >> shift) & 31);
+  if ((node->bitmap & bit) == 0) return node;
+
+  uint32_t count = hamt_count(node, shift);
+  uint32_t at = __builtin_popcount(node->bitmap & (bit - 1));
+  MapEntry current = node->entries[at];
+
+  if (current.key == HAMT_CHILD) {
+    HamtNode* child = (HamtNode*) (uintptr_t) current.value;
+    HamtNode* new_child = hamt_remove(child, key, hash, shift + HAMT_BITS, removed);
+
+    if (new_child == child) return node;
+    if (new_child != NULL) {
+      return hamt_with(node, node->bitmap, count, at, (MapEntry) { HAMT_CHILD, (Value) (uintptr_t) new_child }, false);
+    }
+  } else if (!values_equal(current.key, key)) {
+    return node;
+  } else {
+    *removed = true;
+  }
+
+  return count == 1 ? NULL : hamt_without(node, node->bitmap & ~bit, count, at);
+}
+
+static void hamt_each(HamtNode* node, int shift, MapVisitor visit, void* data) {
+  if (node == NULL) return;
+
+  uint32_t count = hamt_count(node, shift);
+  for (uint32_t i = 0; i < count; i++) {
+    MapEntry entry = node->entries[i];
+
+    if (shift < HAMT_MAX_SHIFT && entry.key == HAMT_CHILD) {
+      hamt_each((HamtNode*) (uintptr_t) entry.value, shift + HAMT_BITS, visit, data);
+    } else {
+      visit(entry.key, entry.value, data);
+    }
+  }
+}
+
+static Value make_pmap(HamtNode* root, uint32_t count) {
+  HeapValue* map = MAKE_HEAP(TYPE_PMAP, count, sizeof(Value));
+  map->as_ptr[0] = (Value) (uintptr_t) root;
+  return MAKE_PTR(map);
+}
+
+Value map_new(bool persistent) {
+  if (persistent) return make_pmap(NULL, 0);
+
+  HeapValue* map = MAKE_HEAP(TYPE_MAP, 0, sizeof(Map));
+  memset(map->as_ptr, 0, sizeof(Map));
+  return MAKE_PTR(map);
+}
+
+bool map_get(Value map, Value key, Value* out) {
+  if (get_type(map) == TYPE_PMAP) return hamt_get(GET_HAMT(map), key, hash_value(key), out);
+
+  MapEntry* entry = table_find(GET_MAP(map), key, hash_value(key));
+  if (entry == NULL) return false;
+
+  *out = entry->value;
+  return true;
+}
+
+Value map_insert(Value map, Value key, Value value) {
+  uint64_t hash = hash_value(key);
+  HeapValue* header = GET_PTR(map);
+
+  if (header->type == TYPE_PMAP) {
+    bool added = false;
+    HamtNode* root = hamt_insert(GET_HAMT(map), (MapEntry) { key, value }, hash, 0, &added);
+    return make_pmap(root, header->length + added);
+  }
+
+  Map* table = GET_MAP(map);
+  MapEntry* entry = table_find(table, key, hash);
+
+  if (entry != NULL) {
+    entry->value = value;
+    return map;
+  }
+
+  if (table->growth_left == 0) table_resize(table, header->length);
+
+  table_insert_new(table, key, value, hash);
+  header->length++;
+
+  return map;
+}
+
+Value map_remove(Value map, Value key) {
+  uint64_t hash = hash_value(key);
+  HeapValue* header = GET_PTR(map);
+
+  if (header->type == TYPE_PMAP) {
+    bool removed = false;
+    HamtNode* root = hamt_remove(GET_HAMT(map), key, hash, 0, &removed);
+    return removed ? make_pmap(root, header->length - 1) : map;
+  }
+
+  Map* table = GET_MAP(map);
+  MapEntry* entry = table_find(table, key, hash);
+
+  if (entry != NULL) {
+    table->ctrl[entry - table->entries] = CTRL_DELETED;
+    header->length--;
+  }
+
+  return map;
+}
+
+void map_each(Value map, MapVisitor visit, void* data) {
+  if (GET_PTR(map)->type == TYPE_PMAP) {
+    hamt_each(GET_HAMT(map), 0, visit, data);
+    return;
+  }
+
+  Map* table = GET_MAP(map);
+  for (uint32_t i = 0; i < table->capacity; i++) {
+    if (table->ctrl[i] & CTRL_EMPTY) continue;
+    visit(table->entries[i].key, table->entries[i].value, data);
+  }
+}
+
+typedef struct {
+  Value* pairs;
+  size_t count;
+} Pairs;
+
+static void collect_pair(Value key, Value value, void* data) {
+  Pairs* pairs = data;
+  Value pair[2] = { key, value };
+  pairs->pairs[pairs->count++] = MAKE_LIST(pair, 2);
+}
+
+Value map_entries(Value map) {
+  Pairs pairs = { malloc((GET_PTR(map)->length + 1) * sizeof(Value)), 0 };
+  map_each(map, collect_pair, &pairs);
+
+  Value list = MAKE_LIST(pairs.pairs, pairs.count);
+  free(pairs.pairs);
+
+  return list;
+}
@@ -0,0 +1,92 @@
+#include <core/error.h>
+#include <map.h>
+#include <memo.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+typedef struct {
+  // 0 for an empty entry
+  Value callee;
+  uint64_t hash;
+  uint32_t argc;
+  Value args[MEMO_MAX_ARGS];
+  Value result;
+} MemoEntry;
+
+static _Thread_local MemoEntry *cache = NULL;
+
+static atomic_uint_fast64_t hits, misses, evictions;
+
+Value memoize(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "memoize expects a function");
+  (void) argc;
+  (void) module;
+  Value callee = args[0];
+  ASSERT(IS_FUN(callee) || get_type(callee) == TYPE_CLOSURE, "Expected a function");
+
+  // Captures come along, so the copy runs as the original would
+  uint32_t count = IS_PTR(callee) ? GET_PTR(callee)->length - 1 : 0;
+  Value code = IS_PTR(callee) ? GET_CLOSURE_CODE(callee) : callee;
+  Value closure = MAKE_CLOSURE(code, IS_PTR(callee) ? &GET_CAPTURE(callee, 0) : NULL, count);
+  GET_PTR(closure)->tag = CLOSURE_MEMOIZED;
+
+  // Entries are keyed on its address, which must never be reused
+  value_freeze(closure);
+  return closure;
+}
+
+static uint64_t memo_hash(Value callee, Value *args, size_t argc) {
+  uint64_t hash = hash_value(callee);
+  for (size_t i = 0; i < argc; i++) hash = hash_value(args[i]) ^ (hash * 0x100000001b3ull);
+  return hash;
+}
+
+static MemoEntry *memo_entry(uint64_t hash) {
+  if (cache == NULL) cache = calloc(MEMO_CACHE_SIZE, sizeof(MemoEntry));
+  return &cache[(hash >> 17) & (MEMO_CACHE_SIZE - 1)];
+}
+
+bool memo_lookup(Value callee, Value *args, size_t argc, Value *out) {
+  if (argc > MEMO_MAX_ARGS) return false;
+
+  uint64_t hash = memo_hash(callee, args, argc);
+  MemoEntry *entry = memo_entry(hash);
+
+  bool found = entry->callee == callee && entry->hash == hash && entry->argc == argc;
+  for (size_t i = 0; i < argc && found; i++) found = values_equal(entry->args[i], args[i]);
+
+  atomic_fetch_add_explicit(found ? &hits : &misses, 1, memory_order_relaxed);
+  if (found) *out = entry->result;
+  return found;
+}
+
+void memo_store(Value callee, Value *args, size_t argc, Value result) {
+  if (argc > MEMO_MAX_ARGS) return;
+
+  uint64_t hash = memo_hash(callee, args, argc);
+  MemoEntry *entry = memo_entry(hash);
+  if (entry->callee != 0) atomic_fetch_add_explicit(&evictions, 1, memory_order_relaxed);
+
+  // Evicted values stay alive, callers may still hold them uncounted
+  for (size_t i = 0; i < argc; i++) value_freeze(args[i]);
+  value_freeze(result);
+
+  entry->callee = callee;
+  entry->hash = hash;
+  entry->argc = argc;
+  memcpy(entry->args, args, argc * sizeof(Value));
+  entry->result = result;
+}
+
+void memo_report() {
+  uint64_t calls = hits + misses;
+  if (calls == 0) return;
+
+  fprintf(stderr, "Memoization\n");
+  fprintf(stderr, "  calls: %llu, hits: %llu (%.1f%%), evictions: %llu\n",
+          (unsigned long long) calls, (unsigned long long) hits, 100.0 * hits / calls,
+          (unsigned long long) evictions);
+}
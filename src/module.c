@@ -0,0 +1,138 @@
+#include <array.h>
+#include <callstack.h>
+#include <core/error.h>
+#include <core/library.h>
+#include <memo.h>
+#include <module.h>
+#include <parallel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <view.h>
+
+#ifdef _WIN32
+#define PATH_SEP '\\'
+#else
+#define PATH_SEP '/'
+#endif
+
+Module* module_new(Constants constants, size_t num_libraries) {
+  Module* module = malloc(sizeof(Module));
+
+  module->constants = constants;
+  module->stack = stack_new();
+  module->callstack = 0;
+  module->current_pc = 0;
+  module->locals_count = 0;
+  module->locals = malloc(MAX_FRAMES * sizeof(size_t));
+  module->envs = calloc(MAX_FRAMES, sizeof(Value));
+  module->natives = calloc(num_libraries, sizeof(*module->natives));
+  module->handles = malloc(num_libraries * sizeof(DLL));
+  module->argc = 0;
+  module->argv = NULL;
+  module->code = NULL;
+  module->halt_pc = -1;
+  module->memo_pc = -1;
+  module->memo_calls = malloc(MAX_FRAMES * sizeof(MemoCall));
+  module->memo_count = 0;
+
+  return module;
+}
+
+Module* module_fork(Module* parent) {
+  Module* module = malloc(sizeof(Module));
+  *module = *parent;
+
+  module->stack = stack_new();
+  module->base_pointer = 0;
+  module->callstack = 0;
+  module->current_pc = 0;
+  module->locals_count = 0;
+  module->locals = malloc(MAX_FRAMES * sizeof(size_t));
+  module->envs = calloc(MAX_FRAMES, sizeof(Value));
+  module->memo_calls = malloc(MAX_FRAMES * sizeof(MemoCall));
+  module->memo_count = 0;
+
+  // Globals live at the bottom of the stack, copied as of the fork
+  memcpy(module->stack->values, parent->stack->values, GLOBALS_SIZE * sizeof(Value));
+
+  return module;
+}
+
+static const struct {
+  const char* name;
+  Native native;
+} builtins[] = {
+  { "parallel_map", parallel_map },
+  { "parallel_filter", parallel_filter },
+  { "parallel_fold", parallel_fold },
+  { "memoize", memoize },
+  { "file_map", file_map },
+  { "string_split", string_split },
+  { "substring", substring },
+  { "array_from", array_from },
+  { "array_to_list", array_to_list },
+  { "array_sum", array_sum },
+  { "array_min", array_min },
+  { "array_max", array_max },
+  { "array_add", array_add },
+  { "array_sub", array_sub },
+  { "array_mul", array_mul },
+  { "array_find", array_find },
+};
+
+static Native builtin_native(const char* name) {
+  for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+    if (strcmp(builtins[i].name, name) == 0) return builtins[i].native;
+  }
+
+  return NULL;
+}
+
+// TODO: Implement library loading in a flat manner
+//       in order to avoid `calloc` calls in the loop.
+void module_load_libraries(Module* module, Libraries libs) {
+  char* std_path = getenv("PLUME_PATH");
+
+  for (int i = 0; i < libs.num_libraries; i++) {
+    Library lib = libs.libraries[i];
+    char* path = lib.name;
+
+    module->natives[i].functions = calloc(lib.num_functions, sizeof(Native));
+
+    // Natives of the VM itself are resolved by name, without a handle
+    if (strcmp(path, BUILTIN_LIBRARY) == 0) {
+      module->handles[i] = NULL;
+      continue;
+    }
+
+    if (lib.is_standard && std_path == NULL)
+      THROW_FMT("PLUME_PATH is not set, cannot load %s", path);
+
+    char* final_path = malloc((lib.is_standard ? strlen(std_path) + 1 : 0) + strlen(path) + 1);
+
+    if (lib.is_standard) {
+      sprintf(final_path, "%s%c%s", std_path, PATH_SEP, path);
+    } else {
+      strcpy(final_path, path);
+    }
+
+    module->handles[i] = load_library(final_path);
+  }
+}
+
+Native module_native(Module* module, int32_t lib, int32_t index, char* name) {
+  ASSERT_FMT(module->natives[lib].functions != NULL,
+              "Library not loaded (for function %s)", name);
+
+  Native native = module->natives[lib].functions[index];
+
+  if (native == NULL) {
+    DLL handle = module->handles[lib];
+    native = handle == NULL ? builtin_native(name) : get_proc_address(handle, name);
+    ASSERT_FMT(native != NULL, "Native function %s not found", name);
+    module->natives[lib].functions[index] = native;
+  }
+
+  return native;
+}
@@ -0,0 +1,652 @@
+#include <bytecode.h>
+#include <core/debug.h>
+#include <function_table.h>
+#include <module.h>
+#include <optimizer.h>
+#include <stack.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+static bool is_jump(int32_t opcode) {
+  switch (opcode) {
+    case OP_JumpRel:
+    case OP_JumpElseRel:
+    case OP_JumpElseRelCmp:
+    case OP_IJumpElseRelCmp:
+    case OP_JumpElseRelCmpConst:
+    case OP_IJumpElseRelCmpConst:
+      return true;
+    default:
+      return false;
+  }
+}
+
+Analysis analysis_new(Deserialized des) {
+  Analysis analysis;
+  analysis.instrs = des.instrs;
+  analysis.instr_count = des.instr_count;
+  analysis.constants = des.module->constants;
+  analysis.constant_count = des.constant_count;
+  analysis.functions = function_table_new(des);
+  analysis.owners = malloc(des.instr_count * sizeof(int32_t));
+  analysis.targets = calloc(des.instr_count, sizeof(bool));
+
+  for (size_t idx = 0; idx < des.instr_count; idx++) {
+    int32_t *ins = INSTR(&analysis, idx);
+    analysis.owners[idx] = function_table_lookup(analysis.functions, idx * 4);
+
+    int64_t target = (int64_t) idx + ins[1];
+    if (is_jump(ins[0]) && target >= 0 && target < des.instr_count) {
+      analysis.targets[target] = true;
+    }
+  }
+
+  return analysis;
+}
+
+void analysis_free(Analysis *analysis) {
+  function_table_free(analysis->functions);
+  free(analysis->owners);
+  free(analysis->targets);
+}
+
+// Whether `idx` is directly followed by `opcode` in the same function, with
+// no jump landing between the two.
+static bool followed_by(Analysis *a, size_t idx, int32_t opcode) {
+  return idx + 1 < a->instr_count && a->owners[idx + 1] == a->owners[idx] &&
+         !a->targets[idx + 1] && INSTR(a, idx + 1)[0] == opcode;
+}
+
+static bool preceded_by(Analysis *a, size_t idx, int32_t opcode) {
+  return idx > 0 && a->owners[idx - 1] == a->owners[idx] && !a->targets[idx] &&
+         INSTR(a, idx - 1)[0] == opcode;
+}
+
+// A mutable stored in local `local` stays in its frame when every store is
+// `MakeMutable; StoreLocal` and every load feeds straight into `UnMut` or
+// `Update`. Any other use (argument, return, capture) lets it escape.
+static bool mutable_is_local(Analysis *a, int32_t fn, int32_t local) {
+  FunctionRange range = a->functions.ranges[fn];
+  bool defined = false;
+
+  for (size_t idx = range.start / 4; idx < range.end / 4; idx++) {
+    if (a->owners[idx] != fn) continue;
+
+    int32_t *ins = INSTR(a, idx);
+    if (ins[1] != local) continue;
+
+    switch (ins[0]) {
+      case OP_StoreLocal:
+        if (!preceded_by(a, idx, OP_MakeMutable)) return false;
+        defined = true;
+        break;
+      case OP_LoadLocal:
+        // A load before the first store may see a box from the caller
+        if (!defined) return false;
+        if (!followed_by(a, idx, OP_UnMut) && !followed_by(a, idx, OP_Update))
+          return false;
+        break;
+      case OP_CallLocal:
+        return false;
+    }
+  }
+
+  return defined;
+}
+
+static void unbox_mutable(Analysis *a, int32_t fn, int32_t local) {
+  FunctionRange range = a->functions.ranges[fn];
+
+  for (size_t idx = range.start / 4; idx < range.end / 4; idx++) {
+    if (a->owners[idx] != fn) continue;
+
+    int32_t *ins = INSTR(a, idx);
+    if (ins[1] != local) continue;
+
+    switch (ins[0]) {
+      case OP_StoreLocal:
+        INSTR(a, idx - 1)[0] = OP_Nop;
+        break;
+      case OP_LoadLocal:
+        // `LoadLocal; Update` writes the new value straight into the slot
+        if (INSTR(a, idx + 1)[0] == OP_Update) ins[0] = OP_StoreLocal;
+        INSTR(a, idx + 1)[0] = OP_Nop;
+        break;
+    }
+  }
+}
+
+size_t escape_analysis(Analysis *a) {
+  size_t rewrites = 0;
+
+  for (size_t idx = 0; idx < a->instr_count; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    int32_t fn = a->owners[idx];
+
+    // Locals only exist inside functions
+    if (ins[0] == OP_StoreLocal && fn >= 0 && preceded_by(a, idx, OP_MakeMutable) &&
+        mutable_is_local(a, fn, ins[1])) {
+      unbox_mutable(a, fn, ins[1]);
+      rewrites++;
+    }
+
+    // A list destructured as soon as it is built never needs to exist
+    if (ins[0] == OP_MakeList && followed_by(a, idx, OP_ListGet) &&
+        INSTR(a, idx + 1)[1] < ins[1]) {
+      int32_t index = INSTR(a, idx + 1)[1];
+      ins[0] = OP_ListPick;
+      ins[2] = index;
+      INSTR(a, idx + 1)[0] = OP_Nop;
+      rewrites++;
+    }
+  }
+
+  return rewrites;
+}
+
+// Instructions control may go to after `idx`, returning their count
+static size_t successors(Analysis *a, size_t idx, size_t *out) {
+  int32_t *ins = INSTR(a, idx);
+
+  switch (ins[0]) {
+    case OP_Return:
+    case OP_ReturnConst:
+    case OP_Halt:
+      return 0;
+    case OP_JumpRel:
+      out[0] = idx + ins[1];
+      return 1;
+    case OP_JumpElseRel:
+    case OP_JumpElseRelCmp:
+    case OP_IJumpElseRelCmp:
+    case OP_JumpElseRelCmpConst:
+    case OP_IJumpElseRelCmpConst:
+      out[0] = idx + ins[1];
+      out[1] = idx + 1;
+      return 2;
+    case OP_MakeLambda:
+    case OP_MakeClosure:
+      out[0] = idx + 1 + ins[1];
+      return 1;
+    case OP_MakeAndStoreLambda:
+      out[0] = idx + 1 + ins[2];
+      return 1;
+    default:
+      out[0] = idx + 1;
+      return 1;
+  }
+}
+
+// Rewrites the loads of function `fn` that are the last use of their
+// local into moves, from a backward liveness analysis over the function's
+// own instructions. Remaining loads count as dups.
+static size_t insert_moves(Analysis *a, int32_t fn) {
+  FunctionRange range = a->functions.ranges[fn];
+  size_t start = range.start / 4, end = range.end / 4;
+
+  int32_t *definer = INSTR(a, start - 1);
+  int32_t num_locals = definer[0] == OP_MakeAndStoreLambda ? definer[3] : definer[2];
+  for (size_t idx = start; idx < end; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    if (a->owners[idx] != fn) continue;
+    if (ins[0] == OP_LoadLocal || ins[0] == OP_StoreLocal || ins[0] == OP_CallLocal) {
+      if (ins[1] >= num_locals) num_locals = ins[1] + 1;
+    }
+  }
+
+  if (num_locals <= 0) return 0;
+
+  size_t words = (num_locals + 63) / 64;
+  uint64_t *live = calloc((end - start) * words, sizeof(uint64_t));
+  uint64_t *out = malloc(words * sizeof(uint64_t));
+  size_t targets[2];
+
+  #define LIVE(idx) (&live[((idx) - start) * words])
+
+  // Live locals on entry to each instruction, iterated to a fixed point
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (size_t idx = end; idx-- > start;) {
+      if (a->owners[idx] != fn) continue;
+
+      int32_t *ins = INSTR(a, idx);
+      memset(out, 0, words * sizeof(uint64_t));
+
+      // Switch entries follow the switch as jumps
+      size_t count = ins[0] == OP_Switch ? (size_t) ins[1] + 1 : successors(a, idx, targets);
+      for (size_t k = 0; k < count; k++) {
+        size_t target = ins[0] == OP_Switch ? idx + 1 + k : targets[k];
+        if (target < start || target >= end || a->owners[target] != fn) continue;
+        for (size_t w = 0; w < words; w++) out[w] |= LIVE(target)[w];
+      }
+
+      int32_t local = ins[1];
+      if (ins[0] == OP_StoreLocal) out[local / 64] &= ~(1ull << (local % 64));
+      if (ins[0] == OP_LoadLocal || ins[0] == OP_CallLocal) out[local / 64] |= 1ull << (local % 64);
+
+      if (memcmp(out, LIVE(idx), words * sizeof(uint64_t)) != 0) {
+        memcpy(LIVE(idx), out, words * sizeof(uint64_t));
+        changed = true;
+      }
+    }
+  }
+
+  size_t moves = 0;
+  for (size_t idx = start; idx < end; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    if (a->owners[idx] != fn || ins[0] != OP_LoadLocal) continue;
+
+    // A plain load falls through, so what follows tells whether it is live
+    bool used_later = idx + 1 < end && a->owners[idx + 1] == fn &&
+                      (LIVE(idx + 1)[ins[1] / 64] >> (ins[1] % 64)) & 1;
+    if (!used_later) {
+      ins[0] = OP_MoveLocal;
+      moves++;
+    }
+  }
+
+  #undef LIVE
+
+  free(live);
+  free(out);
+  return moves;
+}
+
+// Closest instruction before `idx` that is not a Nop, -1 when control may
+// reach `idx` without going through it
+static int64_t previous(Analysis *a, size_t idx) {
+  for (size_t k = idx; k-- > 0;) {
+    if (a->targets[k + 1] || a->owners[k] != a->owners[idx]) return -1;
+    if (INSTR(a, k)[0] != OP_Nop) return k;
+  }
+
+  return -1;
+}
+
+static bool integer_load(Analysis *a, int64_t idx, uint32_t *out) {
+  if (idx < 0) return false;
+
+  int32_t *ins = INSTR(a, idx);
+  if (ins[0] == OP_PushInt) {
+    *out = (uint32_t) ins[1];
+    return true;
+  }
+
+  if (ins[0] != OP_LoadConstant || get_type(a->constants[ins[1]]) != TYPE_INTEGER) return false;
+  *out = GET_INT(a->constants[ins[1]]);
+  return true;
+}
+
+// Rewrites `idx` into a load of `value`, as an immediate when it fits or
+// as an existing constant. The pool is shared with running code, so
+// nothing is added to it.
+static bool load_integer(Analysis *a, size_t idx, uint32_t value) {
+  int32_t integer = (int32_t) value;
+  int32_t *ins = INSTR(a, idx);
+
+  if (integer >= INT16_MIN && integer <= INT16_MAX) {
+    ins[0] = OP_PushInt;
+    ins[1] = integer;
+    return true;
+  }
+
+  for (size_t k = 0; k < a->constant_count; k++) {
+    if (a->constants[k] != MAKE_INTEGER(value)) continue;
+    ins[0] = OP_LoadConstant;
+    ins[1] = k;
+    return true;
+  }
+
+  return false;
+}
+
+// Integer comparisons as run by the interpreter, which follows the layout
+// of `comparison_table`. False for the ones it has no handler for.
+static bool compare_integers(int32_t comparison, bool bitwise, uint32_t a, uint32_t b,
+                             uint32_t *out) {
+  switch (comparison) {
+    case CompareEqual: *out = a == b; return true;
+    case CompareAnd: *out = bitwise ? a & b : a && b; return true;
+    case CompareOr: *out = bitwise ? a | b : a || b; return true;
+    default: return false;
+  }
+}
+
+// Evaluates integer arithmetic, comparisons and branches on constants. The
+// operand loads become Nops, so jumps landing on them still see the result.
+size_t constant_folding(Analysis *a) {
+  size_t folds = 0;
+
+  for (size_t idx = 0; idx < a->instr_count; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    int64_t right = previous(a, idx);
+    int64_t left = right >= 0 ? previous(a, right) : -1;
+
+    // Left is pushed first, so it is below right on the stack
+    uint32_t x, y, z = 0, result;
+    bool unary = integer_load(a, right, &y);
+    bool binary = unary && integer_load(a, left, &x);
+    bool constant = ins[0] == OP_AddConst || ins[0] == OP_SubConst || ins[0] == OP_MulConst ||
+                    ins[0] == OP_IJumpElseRelCmpConst;
+
+    if (constant) {
+      Value value = a->constants[ins[0] == OP_IJumpElseRelCmpConst ? ins[3] : ins[1]];
+      if (get_type(value) != TYPE_INTEGER) continue;
+      z = GET_INT(value);
+    }
+
+    // Operand loads the instruction consumes once folded
+    int consumed = 0;
+
+    switch (ins[0]) {
+      case OP_Add:
+        if (binary && load_integer(a, idx, x + y)) consumed = 2;
+        break;
+      case OP_Sub:
+        if (binary && load_integer(a, idx, x - y)) consumed = 2;
+        break;
+      case OP_Mul:
+        if (binary && load_integer(a, idx, x * y)) consumed = 2;
+        break;
+      case OP_Compare:
+        if (binary && compare_integers(ins[1], false, y, x, &result) &&
+            load_integer(a, idx, result))
+          consumed = 2;
+        break;
+      case OP_AddConst:
+        if (unary && load_integer(a, idx, y + z)) consumed = 1;
+        break;
+      case OP_SubConst:
+        if (unary && load_integer(a, idx, y - z)) consumed = 1;
+        break;
+      case OP_MulConst:
+        if (unary && load_integer(a, idx, y * z)) consumed = 1;
+        break;
+
+      // Branches keep their offset as a plain jump when taken
+      case OP_JumpElseRel:
+        if (!unary) break;
+        ins[0] = y != 0 ? OP_Nop : OP_JumpRel;
+        consumed = 1;
+        break;
+      case OP_JumpElseRelCmp:
+        if (!binary || !compare_integers(ins[2], false, y, x, &result)) break;
+        ins[0] = result != 0 ? OP_Nop : OP_JumpRel;
+        consumed = 2;
+        break;
+      case OP_IJumpElseRelCmpConst:
+        if (!unary || !compare_integers(ins[2], true, y, z, &result)) break;
+        ins[0] = result != 0 ? OP_Nop : OP_JumpRel;
+        consumed = 1;
+        break;
+    }
+
+    if (consumed == 0) continue;
+
+    INSTR(a, right)[0] = OP_Nop;
+    if (consumed == 2) INSTR(a, left)[0] = OP_Nop;
+    folds++;
+  }
+
+  return folds;
+}
+
+// A local stored once in the entry block of function `fn`, from a constant
+// and before any load of it, holds that constant for the whole call. Its
+// loads become constant loads and the store goes away.
+static size_t propagate_constants(Analysis *a, int32_t fn) {
+  FunctionRange range = a->functions.ranges[fn];
+  size_t start = range.start / 4, end = range.end / 4;
+  size_t propagated = 0;
+
+  for (size_t idx = start; idx < end && a->owners[idx] == fn && !a->targets[idx]; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    size_t targets[2];
+    if (successors(a, idx, targets) != 1 || targets[0] != idx + 1 || ins[0] == OP_Switch) break;
+
+    int64_t source = previous(a, idx);
+    if (ins[0] != OP_StoreLocal || source < 0) continue;
+    if (INSTR(a, source)[0] != OP_LoadConstant && INSTR(a, source)[0] != OP_PushInt) continue;
+
+    int32_t local = ins[1];
+    bool constant = true;
+    for (size_t k = start; k < end && constant; k++) {
+      int32_t *other = INSTR(a, k);
+      if (a->owners[k] != fn || other[1] != local || k == idx) continue;
+
+      bool load = other[0] == OP_LoadLocal || other[0] == OP_MoveLocal;
+      if (other[0] == OP_StoreLocal || other[0] == OP_CallLocal || (load && k < idx))
+        constant = false;
+    }
+    if (!constant) continue;
+
+    for (size_t k = idx + 1; k < end; k++) {
+      int32_t *other = INSTR(a, k);
+      if (a->owners[k] != fn || other[1] != local) continue;
+      if (other[0] != OP_LoadLocal && other[0] != OP_MoveLocal) continue;
+
+      other[0] = INSTR(a, source)[0];
+      other[1] = INSTR(a, source)[1];
+    }
+
+    INSTR(a, source)[0] = OP_Nop;
+    ins[0] = OP_Nop;
+    propagated++;
+  }
+
+  return propagated;
+}
+
+// Nops out what control cannot reach in function `fn`, as left by folded
+// branches. Definers stay, so their bodies are never run into.
+static size_t remove_unreachable(Analysis *a, int32_t fn) {
+  FunctionRange range = a->functions.ranges[fn];
+  size_t start = range.start / 4, end = range.end / 4;
+  if (start >= end) return 0;
+
+  bool *reached = calloc(end - start, sizeof(bool));
+  size_t *pending = malloc((end - start) * sizeof(size_t));
+  size_t count = 0, targets[2];
+
+  reached[0] = true;
+  pending[count++] = start;
+
+  while (count > 0) {
+    size_t idx = pending[--count];
+    int32_t *ins = INSTR(a, idx);
+
+    size_t num = ins[0] == OP_Switch ? (size_t) ins[1] + 1 : successors(a, idx, targets);
+    for (size_t k = 0; k < num; k++) {
+      size_t target = ins[0] == OP_Switch ? idx + 1 + k : targets[k];
+      if (target < start || target >= end || a->owners[target] != fn) continue;
+      if (reached[target - start]) continue;
+
+      reached[target - start] = true;
+      pending[count++] = target;
+    }
+  }
+
+  size_t removed = 0;
+  for (size_t idx = start; idx < end; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    if (reached[idx - start] || a->owners[idx] != fn || ins[0] == OP_Nop) continue;
+    if (ins[0] == OP_MakeLambda || ins[0] == OP_MakeClosure || ins[0] == OP_MakeAndStoreLambda)
+      continue;
+
+    ins[0] = OP_Nop;
+    removed++;
+  }
+
+  // Jumps over nothing but Nops fall through instead, Switch tables aside
+  for (size_t idx = start; idx < end; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    if (a->owners[idx] != fn || ins[0] != OP_JumpRel || ins[1] <= 0) continue;
+
+    size_t entry = idx;
+    while (entry > start && INSTR(a, entry - 1)[0] == OP_JumpRel) entry--;
+    if (entry > start && INSTR(a, entry - 1)[0] == OP_Switch) continue;
+
+    bool skips = false;
+    for (size_t k = idx + 1; k < idx + ins[1] && !skips; k++) {
+      skips = INSTR(a, k)[0] != OP_Nop;
+    }
+
+    if (!skips) {
+      ins[0] = OP_Nop;
+      removed++;
+    }
+  }
+
+  free(reached);
+  free(pending);
+  return removed;
+}
+
+// Stack effect of the instructions inlined bodies may contain, INT32_MIN
+// for the others
+static int32_t inline_effect(int32_t *ins) {
+  switch (ins[0]) {
+    case OP_LoadConstant: case OP_LoadGlobal: case OP_PushInt: case OP_Special:
+    case OP_MapNew: case OP_BuilderNew:
+      return 1;
+    case OP_StoreGlobal: case OP_Compare: case OP_And: case OP_Or: case OP_GetIndex:
+    case OP_Add: case OP_Sub: case OP_Mul: case OP_MapGet: case OP_MapContains:
+    case OP_MapRemove: case OP_Concat: case OP_BuilderAppend:
+      return -1;
+    case OP_ListGet: case OP_TypeOf: case OP_ConstructorName: case OP_Slice:
+    case OP_ListLength: case OP_MakeMutable: case OP_UnMut: case OP_AddConst:
+    case OP_SubConst: case OP_MulConst: case OP_MapSize: case OP_MapEntries:
+    case OP_BuilderFinish: case OP_Nop:
+      return 0;
+    case OP_Update: case OP_MapInsert:
+      return -2;
+    case OP_MakeList: case OP_MakeConstructor: case OP_ListPick:
+      return 1 - ins[1];
+    default:
+      return INT32_MIN;
+  }
+}
+
+// Arguments are on the stack at the call in the order the body loads
+// them, so dropping the loads and the return leaves the body to run in
+// the caller's frame
+static InlineBody inline_body(Deserialized des, size_t definer) {
+  int32_t *ins = &des.instrs[definer * 4];
+  int32_t start = definer + 1, length = ins[2], locals = ins[3];
+  InlineBody none = { -1, 0, 0 };
+
+  // Definers record the local space rather than the arity. Bodies are
+  // taken for functions whose locals are all arguments, loaded once in
+  // order up front, and only calls passing that many arguments are
+  // inlined: functions with locals of their own never are.
+  if (locals < 0 || length < locals + 1 || length - locals - 1 > INLINE_MAX_LENGTH) return none;
+  if (des.instrs[(start + length - 1) * 4] != OP_Return) return none;
+
+  for (int32_t k = 0; k < locals; k++) {
+    int32_t *load = &des.instrs[(start + k) * 4];
+    if (load[0] != OP_LoadLocal || load[1] != k) return none;
+  }
+
+  int32_t depth = locals;
+  for (int32_t idx = start + locals; idx < start + length - 1; idx++) {
+    int32_t effect = inline_effect(&des.instrs[idx * 4]);
+    if (effect == INT32_MIN || (depth += effect) < 0) return none;
+  }
+
+  // Values left under the result would be dropped by the return
+  if (depth != 1) return none;
+  return (InlineBody) { start + locals, length - locals - 1, locals };
+}
+
+InlineBody *inlinables_new(Deserialized des) {
+  InlineBody *bodies = malloc(GLOBALS_SIZE * sizeof(InlineBody));
+  int32_t *stores = calloc(GLOBALS_SIZE, sizeof(int32_t));
+  for (size_t g = 0; g < GLOBALS_SIZE; g++) bodies[g] = (InlineBody) { -1, 0, 0 };
+
+  // Only globals defined once and never assigned always hold their function
+  for (size_t idx = 0; idx < des.instr_count; idx++) {
+    int32_t *ins = &des.instrs[idx * 4];
+    if (ins[0] != OP_StoreGlobal && ins[0] != OP_MakeAndStoreLambda) continue;
+    if (ins[1] >= 0 && ins[1] < GLOBALS_SIZE) stores[ins[1]]++;
+  }
+
+  size_t inlinable = 0;
+  for (size_t idx = 0; idx < des.instr_count; idx++) {
+    int32_t *ins = &des.instrs[idx * 4];
+    if (ins[0] != OP_MakeAndStoreLambda || ins[1] < 0 || ins[1] >= GLOBALS_SIZE) continue;
+    if (stores[ins[1]] != 1) continue;
+
+    bodies[ins[1]] = inline_body(des, idx);
+    inlinable += bodies[ins[1]].start >= 0;
+  }
+
+  DEBUG_PRINTLN("%zu global functions can be inlined", inlinable);
+
+  free(stores);
+  return bodies;
+}
+
+size_t inline_calls(Analysis *a, InlineBody *bodies) {
+  size_t inlined = 0;
+
+  for (size_t idx = 0; idx < a->instr_count; idx++) {
+    int32_t *ins = INSTR(a, idx);
+    if (ins[0] != OP_CallGlobal || ins[1] < 0 || ins[1] >= GLOBALS_SIZE) continue;
+
+    InlineBody body = bodies[ins[1]];
+    if (body.start < 0 || body.arity != ins[2]) continue;
+
+    ins[0] = OP_Inline;
+    inlined++;
+  }
+
+  return inlined;
+}
+
+size_t ownership_analysis(Analysis *a) {
+  size_t moves = 0;
+  for (size_t fn = 0; fn < a->functions.num_ranges; fn++) moves += insert_moves(a, fn);
+  return moves;
+}
+
+void optimize_ownership(Deserialized des) {
+  Analysis analysis = analysis_new(des);
+
+  ownership_analysis(&analysis);
+  analysis_free(&analysis);
+}
+
+void optimize(Deserialized des) {
+  Analysis analysis = analysis_new(des);
+
+  escape_analysis(&analysis);
+
+  // Propagated constants may fold further, and folds may feed stores
+  size_t folds = constant_folding(&analysis), propagated = 0, removed = 0;
+  for (size_t fn = 0; fn < analysis.functions.num_ranges; fn++) {
+    size_t count = propagate_constants(&analysis, fn);
+    if (count > 0) folds += constant_folding(&analysis);
+    propagated += count;
+  }
+
+  for (size_t fn = 0; fn < analysis.functions.num_ranges; fn++) {
+    removed += remove_unreachable(&analysis, fn);
+  }
+
+  DEBUG_PRINTLN("Folded %zu constant expressions, propagated %zu locals, removed %zu "
+                "unreachable instructions", folds, propagated, removed);
+
+  analysis_free(&analysis);
+}
+
+void optimize_calls(Deserialized des, InlineBody *bodies) {
+  Analysis analysis = analysis_new(des);
+
+  inline_calls(&analysis, bodies);
+  analysis_free(&analysis);
+}
@@ -0,0 +1,201 @@
+#include <array.h>
+#include <map.h>
+#include <math.h>
+#include <output.h>
+#include <rope.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+typedef struct Output {
+  struct Output *next;
+  size_t used;
+  char data[OUTPUT_BUFFER_SIZE];
+} Output;
+
+static _Thread_local Output *output = NULL;
+
+// Buffers of every thread, kept for the whole run
+static Output *outputs = NULL;
+
+// Room for `length` more bytes, `length` at most OUTPUT_BUFFER_SIZE
+static char *output_reserve(size_t length) {
+  if (output == NULL) {
+    output = malloc(sizeof(Output));
+    output->used = 0;
+    output->next = __atomic_load_n(&outputs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&outputs, &output->next, output, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {}
+  }
+
+  if (output->used + length > OUTPUT_BUFFER_SIZE) output_flush();
+  return output->data + output->used;
+}
+
+static void flush(Output *buffer) {
+  if (buffer->used == 0) return;
+  fwrite(buffer->data, 1, buffer->used, stdout);
+  buffer->used = 0;
+}
+
+// Errors exit from whichever thread raised them, possibly mid-print, with
+// other threads' prints pending too
+static void flush_all() {
+  for (Output *buffer = __atomic_load_n(&outputs, __ATOMIC_ACQUIRE); buffer != NULL;
+       buffer = buffer->next) {
+    flush(buffer);
+  }
+}
+
+void output_start() {
+  atexit(flush_all);
+
+#ifndef _WIN32
+  if (!isatty(STDOUT_FILENO)) setvbuf(stdout, NULL, _IOFBF, OUTPUT_STDOUT_SIZE);
+#endif
+}
+
+void output_flush() {
+  if (output != NULL) flush(output);
+}
+
+void output_finish() {
+  output_flush();
+  fflush(stdout);
+}
+
+void output_bytes(const char *data, size_t length) {
+  if (length >= OUTPUT_DIRECT_LENGTH) {
+    output_flush();
+    fwrite(data, 1, length, stdout);
+    return;
+  }
+
+  memcpy(output_reserve(length), data, length);
+  output->used += length;
+}
+
+#define OUTPUT_LITERAL(s) output_bytes(s, sizeof(s) - 1)
+
+static size_t format_int(char *at, int64_t value) {
+  char digits[24];
+  size_t count = 0;
+  uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+
+  size_t length = 0;
+  if (value < 0) at[length++] = '-';
+  while (count > 0) at[length++] = digits[--count];
+  return length;
+}
+
+void output_int(int64_t value) {
+  char *at = output_reserve(24);
+  output->used += format_int(at, value);
+}
+
+// As printf's %f
+void output_float(double value) {
+  // Integral values are common and need no rounding
+  if (fabs(value) < 1e15 && value == (double) (int64_t) value) {
+    char *at = output_reserve(24);
+    size_t length = 0;
+    if (signbit(value)) at[length++] = '-';
+    length += format_int(at + length, (int64_t) fabs(value));
+    memcpy(at + length, ".000000", 7);
+    output->used += length + 7;
+    return;
+  }
+
+  // %f of the largest doubles takes 317 bytes
+  char *at = output_reserve(320);
+  output->used += snprintf(at, 320, "%f", value);
+}
+
+static void output_entry(Value key, Value value, void *data) {
+  bool *first = data;
+  if (!*first) OUTPUT_LITERAL(", ");
+  *first = false;
+
+  output_value(key);
+  OUTPUT_LITERAL(": ");
+  output_value(value);
+}
+
+void output_value(Value value) {
+  switch (get_type(value)) {
+    case TYPE_INTEGER:
+      output_int((int32_t) value);
+      break;
+    case TYPE_SPECIAL:
+      OUTPUT_LITERAL("<special>");
+      break;
+    case TYPE_FLOAT:
+      output_float(GET_FLOAT(value));
+      break;
+    case TYPE_STRING:
+      output_bytes(string_bytes(value), GET_PTR(value)->length);
+      break;
+    case TYPE_LIST: {
+      HeapValue *list = GET_PTR(value);
+      OUTPUT_LITERAL("[");
+      for (uint32_t i = 0; i < list->length; i++) {
+        if (i > 0) OUTPUT_LITERAL(", ");
+        output_value(list->as_ptr[i]);
+      }
+      OUTPUT_LITERAL("]");
+      break;
+    }
+    case TYPE_MUTABLE:
+      OUTPUT_LITERAL("<mutable ");
+      output_value(GET_MUTABLE(value));
+      OUTPUT_LITERAL(">");
+      break;
+    case TYPE_MAP:
+    case TYPE_PMAP: {
+      bool first = true;
+      OUTPUT_LITERAL("{");
+      map_each(value, output_entry, &first);
+      OUTPUT_LITERAL("}");
+      break;
+    }
+    case TYPE_BUILDER: {
+      HeapValue *builder = GET_PTR(value);
+      char *data = GET_BUILDER(value)->data;
+      output_bytes(data, strnlen(data, builder->length));
+      break;
+    }
+    case TYPE_ARRAY: {
+      HeapValue *array = GET_PTR(value);
+      OUTPUT_LITERAL("[");
+      for (uint32_t i = 0; i < array->length; i++) {
+        if (i > 0) OUTPUT_LITERAL(", ");
+        if (array->tag == ARRAY_INT64) {
+          output_int(((int64_t *) GET_ARRAY(value))[i]);
+        } else {
+          output_value(array_get(value, i));
+        }
+      }
+      OUTPUT_LITERAL("]");
+      break;
+    }
+    case TYPE_FUNCTION:
+      OUTPUT_LITERAL("<function>");
+      break;
+    case TYPE_CLOSURE:
+      OUTPUT_LITERAL("<closure>");
+      break;
+    case TYPE_UNKNOWN: default:
+      OUTPUT_LITERAL("<unknown>");
+      break;
+  }
+}
@@ -0,0 +1,253 @@
+#include <core/error.h>
+#include <interpreter.h>
+#include <module.h>
+#include <parallel.h>
+#include <stack.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef enum {
+  JOB_MAP,
+  JOB_FILTER,
+  JOB_FOLD,
+} JobKind;
+
+typedef struct {
+  JobKind kind;
+  Module *parent;
+  Value callee;
+
+  Value *items;
+  uint32_t length;
+  uint32_t chunk_size;
+  uint32_t num_chunks;
+
+  // One per item for maps, one per chunk for folds
+  Value *results;
+  bool *keep;
+
+  atomic_uint next_chunk;
+} Job;
+
+static void run_chunk(Module *module, Job *job, uint32_t chunk) {
+  uint32_t start = chunk * job->chunk_size;
+  uint32_t end = start + job->chunk_size < job->length ? start + job->chunk_size : job->length;
+
+  switch (job->kind) {
+    case JOB_MAP:
+      for (uint32_t i = start; i < end; i++) {
+        job->results[i] = interpreter_call(module, job->callee, &job->items[i], 1);
+      }
+      break;
+
+    case JOB_FILTER:
+      for (uint32_t i = start; i < end; i++) {
+        Value keep = interpreter_call(module, job->callee, &job->items[i], 1);
+        job->keep[i] = GET_INT(keep) != 0;
+      }
+      break;
+
+    case JOB_FOLD: {
+      Value acc = job->items[start];
+      for (uint32_t i = start + 1; i < end; i++) {
+        Value args[2] = { acc, job->items[i] };
+        acc = interpreter_call(module, job->callee, args, 2);
+      }
+      job->results[chunk] = acc;
+      break;
+    }
+  }
+}
+
+static void run_job(Module *module, Job *job) {
+  uint32_t chunk;
+  while ((chunk = atomic_fetch_add(&job->next_chunk, 1)) < job->num_chunks) {
+    run_chunk(module, job, chunk);
+  }
+}
+
+#ifndef _WIN32
+
+static struct {
+  pthread_once_t once;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+
+  // Worker threads, the calling thread takes chunks too
+  size_t num_workers;
+  Module **modules;
+
+  Job *job;
+  uint64_t generation;
+  size_t active;
+} pool = { PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           PTHREAD_COND_INITIALIZER };
+
+// Set on workers and on a caller while it takes chunks of its job: the
+// pool runs one job at a time, so jobs started from there run inline
+static _Thread_local bool in_job = false;
+static Module *pool_parent;
+
+static void *worker_main(void *arg) {
+  Module *module = pool.modules[(size_t) arg];
+  uint64_t seen = 0;
+  in_job = true;
+
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    while (pool.generation == seen) pthread_cond_wait(&pool.wake, &pool.lock);
+    seen = pool.generation;
+    Job *job = pool.job;
+    pthread_mutex_unlock(&pool.lock);
+
+    // Globals may have changed since the previous job
+    memcpy(module->stack->values, job->parent->stack->values, GLOBALS_SIZE * sizeof(Value));
+    run_job(module, job);
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.active == 0) pthread_cond_signal(&pool.done);
+  }
+
+  return NULL;
+}
+
+static void pool_start(void) {
+  char *env = getenv("PLUME_THREADS");
+  long threads = env != NULL ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  pool.num_workers = threads > 1 ? threads - 1 : 0;
+  pool.modules = malloc(pool.num_workers * sizeof(Module *));
+
+  for (size_t i = 0; i < pool.num_workers; i++) {
+    pool.modules[i] = module_fork(pool_parent);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, worker_main, (void *) i);
+    pthread_detach(thread);
+  }
+}
+
+static void job_run(Job *job) {
+  if (!in_job && job->length >= PARALLEL_MIN_LENGTH) {
+    pool_parent = job->parent;
+    pthread_once(&pool.once, pool_start);
+  }
+
+  if (in_job || job->length < PARALLEL_MIN_LENGTH || pool.num_workers == 0) {
+    job->chunk_size = job->length;
+    job->num_chunks = job->length > 0;
+    run_job(job->parent, job);
+    return;
+  }
+
+  // Workers copy the globals and share the items and the callee, so what
+  // they reference is shared from now on. Counts are not atomic.
+  if (heap_refcounting) {
+    for (size_t i = 0; i < GLOBALS_SIZE; i++) value_freeze(job->parent->stack->values[i]);
+    for (uint32_t i = 0; i < job->length; i++) value_freeze(job->items[i]);
+    value_freeze(job->callee);
+  }
+
+  uint32_t chunks = (pool.num_workers + 1) * PARALLEL_CHUNKS_PER_THREAD;
+  job->chunk_size = (job->length + chunks - 1) / chunks;
+  job->num_chunks = (job->length + job->chunk_size - 1) / job->chunk_size;
+
+  pthread_mutex_lock(&pool.lock);
+  pool.job = job;
+  pool.active = pool.num_workers;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+
+  in_job = true;
+  run_job(job->parent, job);
+  in_job = false;
+
+  // Workers hold the job until they report back
+  pthread_mutex_lock(&pool.lock);
+  while (pool.active > 0) pthread_cond_wait(&pool.done, &pool.lock);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+#else
+
+static void job_run(Job *job) {
+  job->chunk_size = job->length;
+  job->num_chunks = job->length > 0;
+  run_job(job->parent, job);
+}
+
+#endif
+
+static Job job_new(JobKind kind, Module *module, Value list, Value callee) {
+  ASSERT(get_type(list) == TYPE_LIST, "Expected a list");
+  ASSERT(IS_FUN(callee) || get_type(callee) == TYPE_CLOSURE, "Expected a function");
+
+  Job job = { kind, module, callee, GET_LIST(list), GET_PTR(list)->length };
+  atomic_init(&job.next_chunk, 0);
+  return job;
+}
+
+Value parallel_map(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "parallel_map expects a list and a function");
+  (void) argc;
+  Job job = job_new(JOB_MAP, module, args[0], args[1]);
+
+  HeapValue *list = MAKE_HEAP(TYPE_LIST, job.length, job.length * sizeof(Value));
+  job.results = list->as_ptr;
+  job_run(&job);
+
+  return MAKE_PTR(list);
+}
+
+Value parallel_filter(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "parallel_filter expects a list and a function");
+  (void) argc;
+  Job job = job_new(JOB_FILTER, module, args[0], args[1]);
+
+  job.keep = malloc(job.length * sizeof(bool));
+  job_run(&job);
+
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < job.length; i++) length += job.keep[i];
+
+  HeapValue *list = MAKE_HEAP(TYPE_LIST, length, length * sizeof(Value));
+  for (uint32_t i = 0, j = 0; i < job.length; i++) {
+    if (job.keep[i]) list->as_ptr[j++] = job.items[i];
+  }
+
+  free(job.keep);
+  return MAKE_PTR(list);
+}
+
+Value parallel_fold(int argc, Module *module, Value *args) {
+  ASSERT(argc == 3, "parallel_fold expects a list, a function and an initial value");
+  (void) argc;
+  Job job = job_new(JOB_FOLD, module, args[0], args[1]);
+
+  // Combined with what the workers return, frozen like the items
+  if (heap_refcounting) value_freeze(args[2]);
+
+  // Enough room for the sequential case, which runs a single chunk
+  uint32_t max_chunks = job.length < 1 ? 1 : job.length;
+  job.results = malloc(max_chunks * sizeof(Value));
+  job_run(&job);
+
+  Value acc = args[2];
+  for (uint32_t i = 0; i < job.num_chunks; i++) {
+    Value pair[2] = { acc, job.results[i] };
+    acc = interpreter_call(module, job.callee, pair, 2);
+  }
+
+  free(job.results);
+  return acc;
+}
@@ -0,0 +1,157 @@
+#include <bytecode.h>
+#include <callstack.h>
+#include <core/error.h>
+#include <encoding.h>
+#include <module.h>
+#include <profiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+typedef struct {
+  uint64_t count;
+  uint32_t hash;
+  uint16_t depth;
+  int32_t frames[PROFILER_MAX_DEPTH];
+} Sample;
+
+static struct {
+  Module *module;
+  FunctionTable table;
+  FILE *output;
+
+  Sample *samples;
+  uint64_t dropped;
+} profiler;
+
+#ifndef _WIN32
+
+// Sampled pcs are into the compact code
+static int32_t frame_function(int32_t pc) {
+  int32_t idx = encoded_instruction(pc);
+  return idx < 0 ? -1 : function_table_lookup(profiler.table, idx * 4);
+}
+
+static void profiler_sample(int signal) {
+  (void) signal;
+  Module *module = profiler.module;
+  int32_t frames[MAX_FRAMES + 1];
+  size_t depth = 0;
+
+  frames[depth++] = frame_function(module->current_pc);
+
+  // Each FUNCENV holds the return pc into its caller and the caller's base
+  size_t bp = module->base_pointer;
+  for (size_t i = 0; i < module->callstack && depth <= MAX_FRAMES; i++) {
+    if (bp >= MAX_STACK_SIZE) break;
+
+    Value env = module->stack->values[bp];
+    if ((env & MASK_SIGNATURE) != SIGNATURE_FUNCENV) break;
+
+    reg ret = (int16_t) GET_NTH_ELEMENT(env, 0);
+    frames[depth++] = frame_function(ret);
+    bp = (int16_t) GET_NTH_ELEMENT(env, 2);
+  }
+
+  // Store root first, keeping the outermost frames when truncating
+  Sample sample = { 1, 2166136261u, 0 };
+  while (depth > 0 && sample.depth < PROFILER_MAX_DEPTH) {
+    int32_t frame = frames[--depth];
+    sample.frames[sample.depth++] = frame;
+    sample.hash = (sample.hash ^ (uint32_t) frame) * 16777619u;
+  }
+
+  for (size_t i = 0; i < PROFILER_MAX_STACKS; i++) {
+    Sample *slot = &profiler.samples[(sample.hash + i) % PROFILER_MAX_STACKS];
+
+    if (slot->count == 0) {
+      *slot = sample;
+      return;
+    }
+
+    if (slot->hash == sample.hash && slot->depth == sample.depth &&
+        memcmp(slot->frames, sample.frames, sample.depth * sizeof(int32_t)) == 0) {
+      slot->count++;
+      return;
+    }
+  }
+
+  profiler.dropped++;
+}
+
+void profiler_start(Deserialized des, const char *output) {
+  profiler.module = des.module;
+  profiler.table = function_table_new(des);
+  profiler.output = fopen(output, "w");
+  if (profiler.output == NULL) THROW_FMT("Could not open profile output: %s", output);
+
+  profiler.samples = calloc(PROFILER_MAX_STACKS, sizeof(Sample));
+  profiler.dropped = 0;
+
+  // Errors and the exit native leave without returning to main
+  atexit(profiler_stop);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = profiler_sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, NULL);
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = PROFILER_INTERVAL_US;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void profiler_stop() {
+  if (profiler.samples == NULL) return;
+
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+  signal(SIGPROF, SIG_IGN);
+
+  FILE *file = profiler.output;
+
+  // Folded stacks: one "root;caller;callee count" line per unique stack
+  for (size_t i = 0; i < PROFILER_MAX_STACKS; i++) {
+    Sample *sample = &profiler.samples[i];
+    if (sample->count == 0) continue;
+
+    for (size_t j = 0; j < sample->depth; j++) {
+      int32_t frame = sample->frames[j];
+      fprintf(file, "%s%s", j > 0 ? ";" : "",
+              frame < 0 ? "main" : profiler.table.ranges[frame].name);
+    }
+
+    fprintf(file, " %llu\n", (unsigned long long) sample->count);
+  }
+
+  fclose(file);
+
+  if (profiler.dropped > 0) {
+    fprintf(stderr, "Profiler dropped %llu samples (stack table full)\n",
+            (unsigned long long) profiler.dropped);
+  }
+
+  free(profiler.samples);
+  profiler.samples = NULL;
+}
+
+#else
+
+void profiler_start(Deserialized des, const char *output) {
+  THROW("Sampling profiler is not supported on this platform");
+}
+
+void profiler_stop() {}
+
+#endif
@@ -0,0 +1,120 @@
+#include <heap.h>
+#include <rope.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+// Writes the bytes of `string` to `out`. Nodes are visited from the right
+// with an explicit stack, so the left-deep chains built by repeated
+// appends neither recurse nor grow the stack.
+static void rope_copy(Value string, char* out) {
+  char* end = out + GET_PTR(string)->length;
+
+  size_t capacity = 16, depth = 0;
+  Value* stack = malloc(capacity * sizeof(Value));
+  stack[depth++] = string;
+
+  while (depth > 0) {
+    Value current = stack[--depth];
+    HeapValue* node = GET_PTR(current);
+
+    if (node->tag != STRING_ROPE || __atomic_load_n(&node->as_ptr[2], __ATOMIC_ACQUIRE) != 0) {
+      end -= node->length;
+      memcpy(end, string_bytes(current), node->length);
+      continue;
+    }
+
+    if (depth + 2 > capacity) {
+      capacity *= 2;
+      stack = realloc(stack, capacity * sizeof(Value));
+    }
+
+    stack[depth++] = node->as_ptr[0];
+    stack[depth++] = node->as_ptr[1];
+  }
+
+  free(stack);
+}
+
+// Ropes and views keep their flattened copy
+char* string_flatten(Value string) {
+  HeapValue* node = GET_PTR(string);
+
+  if (__atomic_load_n(&node->as_ptr[2], __ATOMIC_ACQUIRE) == 0) {
+    HeapValue* flat = MAKE_HEAP(TYPE_STRING, node->length, node->length + 1);
+    rope_copy(string, (char*) flat->as_ptr);
+    ((char*) flat->as_ptr)[node->length] = '\0';
+
+    // Workers of parallel natives may flatten a shared node at once, the
+    // first copy published is kept
+    Value expected = 0;
+    if (!__atomic_compare_exchange_n(&node->as_ptr[2], &expected, MAKE_PTR(flat), false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      heap_free(flat, sizeof(HeapValue) + node->length + 1, TYPE_STRING);
+    }
+  }
+
+  return (char*) GET_PTR(node->as_ptr[2])->as_ptr;
+}
+
+Value string_concat(Value a, Value b) {
+  HeapValue* x = GET_PTR(a);
+  HeapValue* y = GET_PTR(b);
+
+  if (x->length == 0) return b;
+  if (y->length == 0) return a;
+
+  uint32_t length = x->length + y->length;
+
+  if (length < ROPE_MIN_LENGTH) {
+    HeapValue* flat = MAKE_HEAP(TYPE_STRING, length, length + 1);
+    char* data = (char*) flat->as_ptr;
+    rope_copy(a, data);
+    rope_copy(b, data + x->length);
+    data[length] = '\0';
+    return MAKE_PTR(flat);
+  }
+
+  HeapValue* rope = MAKE_HEAP(TYPE_STRING, length, 3 * sizeof(Value));
+  rope->tag = STRING_ROPE;
+  rope->as_ptr[0] = a;
+  rope->as_ptr[1] = b;
+  rope->as_ptr[2] = 0;
+
+  return MAKE_PTR(rope);
+}
+
+Value builder_new(uint32_t capacity) {
+  HeapValue* header = MAKE_HEAP(TYPE_BUILDER, 0, sizeof(StringBuilder));
+  StringBuilder* builder = heap_builder(header);
+
+  builder->capacity = capacity > BUILDER_MIN_CAPACITY ? capacity : BUILDER_MIN_CAPACITY;
+  builder->data = heap_alloc(builder->capacity, TYPE_BUILDER);
+
+  return MAKE_PTR(header);
+}
+
+void builder_append(Value value, Value string) {
+  HeapValue* header = GET_PTR(value);
+  StringBuilder* builder = GET_BUILDER(value);
+  uint32_t length = GET_PTR(string)->length;
+
+  if (header->length + length > builder->capacity) {
+    uint32_t capacity = builder->capacity * 2;
+    if (capacity < header->length + length) capacity = header->length + length;
+
+    char* data = heap_alloc(capacity, TYPE_BUILDER);
+    memcpy(data, builder->data, header->length);
+    heap_free(builder->data, builder->capacity, TYPE_BUILDER);
+
+    builder->data = data;
+    builder->capacity = capacity;
+  }
+
+  rope_copy(string, builder->data + header->length);
+  header->length += length;
+}
+
+Value builder_finish(Value value) {
+  return MAKE_STRING(GET_BUILDER(value)->data, GET_PTR(value)->length);
+}
@@ -0,0 +1,136 @@
+#include <bytecode.h>
+#include <core/error.h>
+#include <deserializer.h>
+#include <function_table.h>
+#include <module.h>
+#include <serializer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+
+#define SECTION_COUNT 4
+
+static void write_i32(FILE* file, int32_t value) {
+  fwrite(&value, sizeof(int32_t), 1, file);
+}
+
+static void write_string(FILE* file, const char* string) {
+  int32_t length = strlen(string);
+  write_i32(file, length);
+  fwrite(string, sizeof(char), length, file);
+}
+
+// Starts a section at the next 8-byte boundary
+static Section section_begin(FILE* file, SectionKind kind) {
+  while (ftell(file) % 8 != 0) fputc(0, file);
+  return (Section) { kind, 0, ftell(file), 0 };
+}
+
+static void section_end(FILE* file, Section* section) {
+  section->size = ftell(file) - section->offset;
+}
+
+static void serialize_constants(FILE* file, Deserialized des) {
+  write_i32(file, des.constant_count);
+
+  for (size_t i = 0; i < des.constant_count; i++) {
+    Value value = des.module->constants[i];
+    uint8_t type = get_type(value);
+    fwrite(&type, sizeof(uint8_t), 1, file);
+
+    switch (type) {
+      case TYPE_INTEGER:
+        write_i32(file, (int32_t) GET_INT(value));
+        break;
+      case TYPE_FLOAT: {
+        double float_value = GET_FLOAT(value);
+        fwrite(&float_value, sizeof(double), 1, file);
+        break;
+      }
+      case TYPE_STRING:
+        write_string(file, GET_STRING(value));
+        break;
+      default:
+        THROW_FMT("Cannot serialize a constant of type %s", type_of(value));
+    }
+  }
+}
+
+static void serialize_libraries(FILE* file, Libraries libraries) {
+  write_i32(file, libraries.num_libraries);
+
+  for (size_t i = 0; i < libraries.num_libraries; i++) {
+    write_string(file, libraries.libraries[i].name);
+    write_i32(file, libraries.libraries[i].is_standard);
+    write_i32(file, libraries.libraries[i].num_functions);
+  }
+}
+
+static const char* source_name(Deserialized des, int32_t pc) {
+  for (size_t i = 0; i < des.names.num_names; i++) {
+    if (des.names.names[i].pc == pc) return des.names.names[i].name;
+  }
+
+  return NULL;
+}
+
+static void serialize_functions(FILE* file, Deserialized des) {
+  FunctionTable table = function_table_new(des);
+  FunctionEntry* entries = calloc(table.num_ranges + 1, sizeof(FunctionEntry));
+
+  // Names follow the entries
+  uint32_t name = sizeof(int32_t) + table.num_ranges * sizeof(FunctionEntry);
+
+  for (size_t i = 0; i < table.num_ranges; i++) {
+    FunctionRange range = table.ranges[i];
+    int32_t* definer = &des.instrs[range.start - 4];
+    const char* source = source_name(des, range.start);
+
+    entries[i] = (FunctionEntry) {
+      range.start / 4, (range.end - range.start) / 4,
+      definer[0] == OP_MakeAndStoreLambda ? definer[3] : definer[2], -1,
+      source != NULL ? name : 0, source != NULL ? strlen(source) : 0
+    };
+    name += entries[i].name_length;
+  }
+
+  write_i32(file, table.num_ranges);
+  fwrite(entries, sizeof(FunctionEntry), table.num_ranges, file);
+
+  for (size_t i = 0; i < table.num_ranges; i++) {
+    const char* source = source_name(des, table.ranges[i].start);
+    if (source != NULL) fwrite(source, sizeof(char), strlen(source), file);
+  }
+
+  free(entries);
+  function_table_free(table);
+}
+
+void serialize(Deserialized des, FILE* file) {
+  uint32_t flags = des.trusted ? BYTECODE_TRUSTED : 0;
+  BytecodeHeader header = { BYTECODE_MAGIC, BYTECODE_VERSION, SECTION_COUNT, flags };
+  Section sections[SECTION_COUNT] = { 0 };
+
+  fwrite(&header, sizeof(BytecodeHeader), 1, file);
+  fwrite(sections, sizeof(Section), SECTION_COUNT, file);
+
+  sections[0] = section_begin(file, SECTION_CONSTANTS);
+  serialize_constants(file, des);
+  section_end(file, &sections[0]);
+
+  sections[1] = section_begin(file, SECTION_LIBRARIES);
+  serialize_libraries(file, des.libraries);
+  section_end(file, &sections[1]);
+
+  sections[2] = section_begin(file, SECTION_FUNCTIONS);
+  serialize_functions(file, des);
+  section_end(file, &sections[2]);
+
+  sections[3] = section_begin(file, SECTION_CODE);
+  fwrite(des.instrs, sizeof(int32_t), des.instr_count * 4, file);
+  section_end(file, &sections[3]);
+
+  fseek(file, sizeof(BytecodeHeader), SEEK_SET);
+  fwrite(sections, sizeof(Section), SECTION_COUNT, file);
+}
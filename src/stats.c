@@ -0,0 +1,173 @@
+#include <stats.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *counter_names[COUNTER_COUNT] = {
+  "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "iTLB-misses",
+};
+
+static const char *phase_names[PHASE_COUNT] = {
+  "deserialize", "libraries", "execute",
+};
+
+static struct {
+  int fds[COUNTER_COUNT];
+  const char *error;
+
+  StatsPhase phase;
+  uint64_t last[COUNTER_COUNT];
+  uint64_t last_ns;
+
+  uint64_t counts[PHASE_COUNT][COUNTER_COUNT];
+  uint64_t ns[PHASE_COUNT];
+} stats;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#ifdef __linux__
+
+#define CACHE_MISS(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} counter_events[COUNTER_COUNT] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_ITLB) },
+};
+
+static int counter_open(StatsCounter counter) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = counter_events[counter].type;
+  attr.config = counter_events[counter].config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Counters get multiplexed when there are more than hardware slots, the
+// count is scaled by the share of time it was actually running
+static uint64_t counter_read(int fd) {
+  uint64_t values[3];
+  if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values)) return 0;
+  if (values[2] == 0) return 0;
+
+  return values[2] < values[1] ? (uint64_t) ((double) values[0] * values[1] / values[2])
+                               : values[0];
+}
+
+void stats_start() {
+  memset(&stats, 0, sizeof(stats));
+
+  bool any = false;
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    stats.fds[i] = counter_open(i);
+    if (stats.fds[i] >= 0) any = true;
+    else if (stats.error == NULL) stats.error = strerror(errno);
+  }
+  if (any) stats.error = NULL;
+
+  stats.phase = PHASE_DESERIALIZE;
+  stats.last_ns = now_ns();
+  for (int i = 0; i < COUNTER_COUNT; i++) stats.last[i] = counter_read(stats.fds[i]);
+}
+
+#else
+
+static uint64_t counter_read(int fd) {
+  return 0;
+}
+
+void stats_start() {
+  memset(&stats, 0, sizeof(stats));
+  for (int i = 0; i < COUNTER_COUNT; i++) stats.fds[i] = -1;
+  stats.error = "perf_event_open is only available on Linux";
+
+  stats.phase = PHASE_DESERIALIZE;
+  stats.last_ns = now_ns();
+}
+
+#endif
+
+void stats_phase(StatsPhase phase) {
+  uint64_t ns = now_ns();
+  stats.ns[stats.phase] += ns - stats.last_ns;
+  stats.last_ns = ns;
+
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    uint64_t value = counter_read(stats.fds[i]);
+    stats.counts[stats.phase][i] += value - stats.last[i];
+    stats.last[i] = value;
+  }
+
+  stats.phase = phase;
+}
+
+void stats_report(uint64_t dispatched, bool instrumented) {
+  stats_phase(stats.phase);
+
+  uint64_t total[COUNTER_COUNT] = { 0 };
+  uint64_t total_ns = 0;
+
+  fprintf(stderr, "Performance counters\n");
+  if (stats.error != NULL) fprintf(stderr, "  counters unavailable: %s\n", stats.error);
+
+  fprintf(stderr, "  %-12s %10s", "phase", "ms");
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    if (stats.fds[i] >= 0) fprintf(stderr, " %15s", counter_names[i]);
+  }
+  fprintf(stderr, "\n");
+
+  for (int phase = 0; phase <= PHASE_COUNT; phase++) {
+    bool is_total = phase == PHASE_COUNT;
+    uint64_t *counts = is_total ? total : stats.counts[phase];
+    uint64_t ns = is_total ? total_ns : stats.ns[phase];
+
+    fprintf(stderr, "  %-12s %10.3f", is_total ? "total" : phase_names[phase], ns / 1e6);
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+      if (stats.fds[i] < 0) continue;
+      fprintf(stderr, " %15llu", (unsigned long long) counts[i]);
+      if (!is_total) total[i] += counts[i];
+    }
+    fprintf(stderr, "\n");
+
+    if (!is_total) total_ns += ns;
+  }
+
+  fprintf(stderr, "  dispatched instructions: %llu%s\n", (unsigned long long) dispatched,
+          instrumented ? " (counted by an instrumented loop, included above)" : "");
+
+  // Per dispatch figures for the execute phase, where the loop runs
+  uint64_t *execute = stats.counts[PHASE_EXECUTE];
+  if (dispatched > 0 && stats.fds[COUNTER_CYCLES] >= 0 && stats.fds[COUNTER_INSTRUCTIONS] >= 0) {
+    fprintf(stderr, "  per dispatch: %.2f cycles, %.2f instructions, %.4f branch misses\n",
+            (double) execute[COUNTER_CYCLES] / dispatched,
+            (double) execute[COUNTER_INSTRUCTIONS] / dispatched,
+            stats.fds[COUNTER_BRANCH_MISSES] >= 0
+                ? (double) execute[COUNTER_BRANCH_MISSES] / dispatched : 0.0);
+  }
+}
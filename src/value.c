@@ -1,10 +1,18 @@
+#include <array.h>
 #include <core/error.h>
+#include <map.h>
+#include <output.h>
+#include <rope.h>
 #include <stdio.h>
 #include <string.h>
 #include <value.h>
 
 char* type_of(Value value) {
-  switch (get_type(value)) {
+  return type_name(get_type(value));
+}
+
+char* type_name(ValueType type) {
+  switch (type) {
     case TYPE_INTEGER:
       return "integer";
     case TYPE_CLOSURE: 
@@ -23,7 +31,15 @@ char* type_of(Value value) {
       return "special";
     case TYPE_MUTABLE:
       return "mutable";
-    case TYPE_UNKNOWN:
+    case TYPE_MAP:
+      return "map";
+    case TYPE_PMAP:
+      return "persistent_map";
+    case TYPE_BUILDER:
+      return "string_builder";
+    case TYPE_ARRAY:
+      return "array";
+    case TYPE_UNKNOWN: default:
       return "unknown";
   }
 }
@@ -53,7 +69,8 @@ Value equal(Value x, Value y) {
     case TYPE_FLOAT:
       return MAKE_INTEGER(x == y);
     case TYPE_STRING:
-      return MAKE_INTEGER(strcmp(GET_STRING(x), GET_STRING(y)) == 0);
+    case TYPE_ARRAY:
+      return MAKE_INTEGER(values_equal(x, y));
     case TYPE_LIST: {
       HeapValue* x_heap = GET_PTR(x);
       HeapValue* y_heap = GET_PTR(y);
@@ -65,7 +82,7 @@ Value equal(Value x, Value y) {
       Value* y_values = y_heap->as_ptr;
 
       for (int i = 0; i < x_heap->length; i++) {
-        if ((int32_t) !equal(x_values[i], y_values[i])) {
+        if (!GET_INT(equal(x_values[i], y_values[i]))) {
           return MAKE_INTEGER(0);
         }
       }
@@ -81,41 +98,105 @@ Value equal(Value x, Value y) {
 }
 
 void native_print(Value value) {
-  ValueType val_type = get_type(value);
-  switch (val_type) {
-    case TYPE_INTEGER:
-      printf("%d", (int32_t) value);
-      break;
-    case TYPE_SPECIAL:
-      printf("<special>");
-      break;
-    case TYPE_FLOAT:
-      printf("%f", GET_FLOAT(value));
-      break;
+  output_value(value);
+  output_flush();
+}
+
+// Values referenced from `v`, as a range of its payload
+static uint32_t references(HeapValue* v, Value** out) {
+  *out = v->as_ptr;
+
+  switch (v->type) {
+    case TYPE_LIST:
+    case TYPE_MUTABLE:
+    case TYPE_CLOSURE:
+      return v->length;
     case TYPE_STRING:
-      printf("%s", GET_STRING(value));
-      break;
-    case TYPE_LIST: {
-      HeapValue* list = GET_PTR(value);
-      printf("[");
-      for (int i = 0; i < list->length; i++) {
-        native_print(list->as_ptr[i]);
-        if (i < list->length - 1) {
-          printf(", ");
-        }
+      return v->tag != STRING_FLAT ? 3 : 0;
+    default:
+      // Map contents are frozen on insertion
+      return 0;
+  }
+}
+
+// Pending values of `value_release` and `value_freeze`, which walk long
+// chains without recursing
+static _Thread_local struct {
+  HeapValue** values;
+  size_t count;
+  size_t capacity;
+} pending;
+
+static void pending_push(HeapValue* v) {
+  if (pending.count == pending.capacity) {
+    pending.capacity = pending.capacity == 0 ? 64 : pending.capacity * 2;
+    pending.values = realloc(pending.values, pending.capacity * sizeof(HeapValue*));
+  }
+
+  pending.values[pending.count++] = v;
+}
+
+void value_release(HeapValue* v) {
+  size_t base = pending.count;
+  pending_push(v);
+
+  while (pending.count > base) {
+    HeapValue* current = pending.values[--pending.count];
+    size_t size = sizeof(HeapValue);
+
+    switch (current->type) {
+      case TYPE_LIST:
+      case TYPE_MUTABLE:
+      case TYPE_CLOSURE:
+        size += current->length * sizeof(Value);
+        break;
+      case TYPE_STRING:
+        size += current->tag != STRING_FLAT ? 3 * sizeof(Value) : current->length + 1;
+        break;
+      case TYPE_ARRAY:
+        size += current->length * array_element_size(current->tag);
+        break;
+      case TYPE_BUILDER: {
+        StringBuilder* builder = heap_builder(current);
+        heap_free(builder->data, builder->capacity, TYPE_BUILDER);
+        size += sizeof(StringBuilder);
+        break;
       }
-      printf("]");
-      break;
+      default:
+        // Versions of a persistent map share their nodes
+        continue;
     }
-    case TYPE_MUTABLE: {
-      printf("<mutable ");
-      native_print(GET_MUTABLE(value));
-      printf(">");
-      break;
+
+    Value* values;
+    uint32_t count = references(current, &values);
+    for (uint32_t i = 0; i < count; i++) {
+      if (!IS_PTR(values[i])) continue;
+
+      HeapValue* child = GET_PTR(values[i]);
+      if (child->refcount != 0 && --child->refcount == 0) pending_push(child);
     }
-    case TYPE_UNKNOWN: default: {
-      printf("<unknown>");
-      break;
+
+    heap_recycle(current, size, current->type);
+  }
+}
+
+void value_freeze(Value value) {
+  if (!IS_PTR(value) || GET_PTR(value)->refcount == 0) return;
+
+  size_t base = pending.count;
+  pending_push(GET_PTR(value));
+  GET_PTR(value)->refcount = 0;
+
+  while (pending.count > base) {
+    HeapValue* current = pending.values[--pending.count];
+
+    Value* values;
+    uint32_t count = references(current, &values);
+    for (uint32_t i = 0; i < count; i++) {
+      if (!IS_PTR(values[i]) || GET_PTR(values[i])->refcount == 0) continue;
+
+      GET_PTR(values[i])->refcount = 0;
+      pending_push(GET_PTR(values[i]));
     }
   }
-}
\ No newline at end of file
+}
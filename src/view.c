@@ -0,0 +1,171 @@
+#include <core/error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <value.h>
+#include <view.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static Value make_view(Value parent, const char *data, uint32_t length) {
+  if (length < VIEW_MIN_LENGTH) return MAKE_STRING(data, length);
+
+  HeapValue *view = MAKE_HEAP(TYPE_STRING, length, 3 * sizeof(Value));
+  view->tag = STRING_VIEW;
+  view->as_ptr[0] = parent;
+  view->as_ptr[1] = (Value) (uintptr_t) data;
+  view->as_ptr[2] = 0;
+
+  return MAKE_PTR(view);
+}
+
+Value string_view(Value string, uint32_t start, uint32_t length) {
+  HeapValue *node = GET_PTR(string);
+  Value parent = string;
+
+  // Ropes are viewed through their flattened copy
+  if (node->tag == STRING_ROPE) {
+    string_flatten(string);
+    parent = node->as_ptr[2];
+  } else if (node->tag == STRING_VIEW) {
+    parent = node->as_ptr[0];
+  }
+
+  // Views reference their parent without counting
+  value_freeze(parent);
+  return make_view(parent, string_bytes(string) + start, length);
+}
+
+static const char *find(const char *data, size_t length, const char *separator,
+                        size_t separator_length) {
+  const char *end = data + length;
+
+  while (data + separator_length <= end) {
+    const char *found = memchr(data, separator[0], end - data - separator_length + 1);
+    if (found == NULL) return NULL;
+    if (memcmp(found, separator, separator_length) == 0) return found;
+    data = found + 1;
+  }
+
+  return NULL;
+}
+
+Value string_split(int argc, Module *module, Value *args) {
+  ASSERT(argc == 2, "string_split expects a string and a separator");
+  (void) argc;
+  (void) module;
+  ASSERT(get_type(args[0]) == TYPE_STRING && get_type(args[1]) == TYPE_STRING,
+         "Expected strings");
+
+  Value string = args[0];
+  const char *data = string_bytes(string);
+  uint32_t length = GET_PTR(string)->length;
+  const char *separator = string_bytes(args[1]);
+  uint32_t separator_length = GET_PTR(args[1])->length;
+  if (separator_length == 0) THROW("string_split expects a non-empty separator");
+
+  size_t count = 0, capacity = 16;
+  Value *pieces = malloc(capacity * sizeof(Value));
+  uint32_t start = 0;
+
+  for (;;) {
+    const char *found = find(data + start, length - start, separator, separator_length);
+    uint32_t end = found != NULL ? found - data : length;
+
+    if (count == capacity) {
+      capacity *= 2;
+      pieces = realloc(pieces, capacity * sizeof(Value));
+    }
+    pieces[count++] = string_view(string, start, end - start);
+
+    if (found == NULL) break;
+    start = end + separator_length;
+  }
+
+  Value list = MAKE_LIST(pieces, count);
+  free(pieces);
+  return list;
+}
+
+Value substring(int argc, Module *module, Value *args) {
+  ASSERT(argc == 3, "substring expects a string, a start and a length");
+  (void) argc;
+  (void) module;
+  ASSERT(get_type(args[0]) == TYPE_STRING, "Expected a string");
+
+  int32_t start = GET_INT(args[1]);
+  int32_t length = GET_INT(args[2]);
+  uint32_t total = GET_PTR(args[0])->length;
+
+  if (start < 0 || length < 0 || (uint32_t) start > total || (uint32_t) length > total - start)
+    THROW_FMT("Substring %d+%d out of bounds of a string of length %u", start, length, total);
+
+  return string_view(args[0], start, length);
+}
+
+#ifndef _WIN32
+
+Value file_map(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "file_map expects a path");
+  (void) argc;
+  (void) module;
+  char *path = GET_STRING(args[0]);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) THROW_FMT("Could not open file: %s", path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) THROW_FMT("Could not stat file: %s", path);
+  if (st.st_size > UINT32_MAX) THROW_FMT("File too large to map: %s", path);
+
+  // Empty files cannot be mapped
+  if (st.st_size == 0) {
+    close(fd);
+    return MAKE_STRING("", 0);
+  }
+
+  char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) THROW_FMT("Could not map file: %s", path);
+
+  // Mapped strings are mostly split and scanned front to back
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  // Small files are copied, their mapping is not needed then
+  Value string = make_view(0, data, st.st_size);
+  if (st.st_size < VIEW_MIN_LENGTH) munmap(data, st.st_size);
+  return string;
+}
+
+#else
+
+// Read in full instead
+Value file_map(int argc, Module *module, Value *args) {
+  ASSERT(argc == 1, "file_map expects a path");
+  (void) argc;
+  (void) module;
+  char *path = GET_STRING(args[0]);
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) THROW_FMT("Could not open file: %s", path);
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  HeapValue *string = MAKE_HEAP(TYPE_STRING, size, size + 1);
+  char *data = (char *) string->as_ptr;
+  if (fread(data, 1, size, file) != size) THROW_FMT("Could not read file: %s", path);
+  data[size] = '\0';
+
+  fclose(file);
+  return MAKE_PTR(string);
+}
+
+#endif
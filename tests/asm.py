@@ -0,0 +1,51 @@
+"""Assembler for the flat bytecode format read by `deserialize`.
+
+Opcodes are numbered as in include/bytecode.h. Instructions are tuples of
+an opcode name and up to three operands, where the operands of the
+`*Const` instructions index the constants.
+"""
+
+import os
+import re
+import struct
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+with open(os.path.join(ROOT, "include", "bytecode.h")) as header:
+  OPCODES = {name: i for i, name in
+             enumerate(re.findall(r"^\s*OP_(\w+),", header.read(), re.M))}
+
+# Operands of `Compare` and the comparing jumps the interpreter knows
+EQUAL, AND, OR = 2, 5, 6
+
+# Operand of `Switch`
+SWITCH_INTEGER, SWITCH_TAG = range(2)
+
+# Operand of `MapNew`
+MAP_HASHED, MAP_PERSISTENT = range(2)
+
+
+def assemble(constants, libraries, code):
+  """Constants are ints, floats or strings, libraries (name, standard,
+  function count) triples."""
+  out = bytearray(struct.pack("<i", len(constants)))
+  for constant in constants:
+    if isinstance(constant, int):
+      out += struct.pack("<Bi", 0, constant)
+    elif isinstance(constant, float):
+      out += struct.pack("<Bd", 1, constant)
+    else:
+      data = constant.encode()
+      out += struct.pack("<Bi", 2, len(data)) + data
+
+  out += struct.pack("<i", len(libraries))
+  for name, standard, count in libraries:
+    data = name.encode()
+    out += struct.pack("<i", len(data)) + data + struct.pack("<ii", standard, count)
+
+  out += struct.pack("<i", len(code))
+  for op, *operands in code:
+    operands += [0] * (3 - len(operands))
+    out += struct.pack("<iiii", OPCODES[op], *operands)
+
+  return bytes(out)
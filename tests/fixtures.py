@@ -0,0 +1,303 @@
+"""Programs of the bytecode fixtures in tests/fixtures.
+
+Run `python3 tests/fixtures.py` after changing one to rewrite its .bin
+file. The expected outputs, the .out files, are written by hand.
+"""
+
+import os
+
+from asm import EQUAL, MAP_HASHED, MAP_PERSISTENT, SWITCH_INTEGER, SWITCH_TAG, assemble
+
+FIXTURES = {}
+
+# Printing goes through the test natives, loaded from PLUME_PATH
+NATIVES = ("natives", 1, 1)
+
+
+def fixture(program):
+  FIXTURES[program.__name__] = program
+  return program
+
+
+def call_print(constant, argc, library=0):
+  return [("LoadNative", constant, library, 0), ("Call", argc)]
+
+
+# Doubly recursive fibonacci through a global, which the optimizer
+# rewrites to integer instructions
+@fixture
+def fib():
+  body = [
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 2, EQUAL, 0), ("ReturnConst", 0),
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 2, EQUAL, 1), ("ReturnConst", 1),
+    ("LoadLocal", 0), ("SubConst", 1), ("CallGlobal", 0, 1),
+    ("LoadLocal", 0), ("SubConst", 2), ("CallGlobal", 0, 1),
+    ("Add",), ("Return",),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(body), 1)] + body
+  code += [("LoadConstant", 3), ("CallGlobal", 0, 1)]
+  code += [("LoadConstant", 2), ("CallGlobal", 0, 1)]
+  code += call_print(4, 2) + [("Halt",)]
+  return assemble([0, 1, 2, 20, "print"], [NATIVES], code)
+
+
+# A mutable updated in a loop, and a list summed through its slices, which
+# reference counting updates and reuses in place
+@fixture
+def ownership():
+  loop = [
+    ("LoadConstant", 0), ("MakeMutable",), ("StoreLocal", 1),
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 2, EQUAL, 0), ("JumpRel", 11),
+    ("LoadLocal", 1), ("UnMut",), ("LoadLocal", 0), ("Add",), ("LoadLocal", 1), ("Update",),
+    ("LoadLocal", 0), ("SubConst", 1), ("StoreLocal", 0), ("JumpRel", -12),
+    ("LoadLocal", 1), ("UnMut",), ("Return",),
+  ]
+  total = [
+    ("LoadLocal", 0), ("ListLength",), ("IJumpElseRelCmpConst", 3, EQUAL, 0),
+    ("LoadLocal", 1), ("Return",),
+    ("LoadLocal", 0), ("ListGet", 0), ("LoadLocal", 1), ("Add",), ("StoreLocal", 1),
+    ("LoadLocal", 0), ("Slice", 1), ("LoadLocal", 1), ("CallGlobal", 1, 2), ("Return",),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(loop), 2)] + loop
+  code += [("MakeAndStoreLambda", 1, len(total), 2)] + total
+  code += [("LoadConstant", 50), ("LoadConstant", 0), ("CallGlobal", 0, 2)]
+  code += [("LoadConstant", i) for i in range(50)] + [("MakeList", 50)]
+  code += [("LoadConstant", 0), ("CallGlobal", 1, 2)]
+  code += call_print(51, 2) + [("Halt",)]
+  return assemble(list(range(50)) + [1000, "print"], [NATIVES], code)
+
+
+# Jump tables on integers and on constructor tags, where plain lists and
+# out of range values take the default
+@fixture
+def switch():
+  def cases(scrutinee, mode):
+    return scrutinee + [
+      ("Switch", 2, mode), ("JumpRel", 3), ("JumpRel", 4), ("JumpRel", 5),
+      ("LoadConstant", 2), ("JumpRel", 5),
+      ("LoadConstant", 3), ("JumpRel", 3),
+      ("LoadConstant", 4), ("JumpRel", 1),
+    ]
+
+  def constructor(tag):
+    return [("Special",), ("LoadConstant", 6), ("LoadConstant", 0), ("MakeConstructor", 3, tag)]
+
+  code = cases([("LoadConstant", 1)], SWITCH_INTEGER)
+  code += cases([("LoadConstant", 5)], SWITCH_INTEGER)
+  code += cases(constructor(0), SWITCH_TAG)
+  code += cases(constructor(1), SWITCH_TAG)
+  code += cases([("LoadConstant", 0), ("LoadConstant", 1), ("MakeList", 2)], SWITCH_TAG)
+  code += constructor(1) + [("ConstructorName",), ("LoadConstant", 6), ("Compare", EQUAL)]
+  code += call_print(7, 6) + [("Halt",)]
+  return assemble([0, 1, 100, 200, 300, 9, "Some", "print"], [NATIVES], code)
+
+
+# Closures made by a function, which captures its arguments
+@fixture
+def closures():
+  adder = [("LoadCapture", 0), ("LoadLocal", 0), ("Mul",), ("LoadCapture", 1), ("Add",), ("Return",)]
+  make = [("LoadLocal", 0), ("LoadLocal", 1), ("MakeClosure", len(adder), 1, 2)] + adder + [("Return",)]
+  code = [("MakeAndStoreLambda", 0, len(make), 2)] + make
+  code += [("LoadConstant", 3), ("LoadConstant", 4), ("CallGlobal", 0, 2), ("StoreGlobal", 1)]
+  code += [("LoadConstant", 5), ("LoadGlobal", 1), ("Call", 1)]
+  code += [("LoadConstant", 0), ("LoadGlobal", 1), ("Call", 1)]
+  code += [("LoadConstant", 2), ("LoadConstant", 1), ("CallGlobal", 0, 2), ("StoreGlobal", 2)]
+  code += [("LoadConstant", 5), ("LoadGlobal", 2), ("Call", 1)]
+  code += call_print(6, 3) + [("Halt",)]
+  return assemble([0, 1, 2, 3, 4, 10, "print"], [NATIVES], code)
+
+
+# Both map kinds, filled up to growing past their first capacity
+@fixture
+def maps():
+  fill = [
+    ("LoadLocal", 1), ("IJumpElseRelCmpConst", 3, EQUAL, 0), ("LoadLocal", 0), ("Return",),
+    ("LoadLocal", 0), ("LoadLocal", 1), ("LoadLocal", 1), ("MapInsert",),
+    ("LoadLocal", 1), ("SubConst", 1), ("CallGlobal", 0, 2), ("Return",),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(fill), 2)] + fill
+
+  for kind in (MAP_HASHED, MAP_PERSISTENT):
+    code += [("MapNew", kind), ("LoadConstant", 4), ("LoadConstant", 5), ("MapInsert",)]
+    code += [("LoadConstant", 6), ("LoadConstant", 4), ("MapInsert",), ("StoreGlobal", 1)]
+    code += [("LoadGlobal", 1), ("LoadConstant", 6), ("MapGet",)]
+    code += [("LoadGlobal", 1), ("MapSize",)]
+    code += [("LoadGlobal", 1), ("LoadConstant", 4), ("MapRemove",), ("MapSize",)]
+    code += [("LoadGlobal", 1), ("LoadConstant", 0), ("MapGet",)]
+    code += [("MapNew", kind), ("LoadConstant", 2), ("CallGlobal", 0, 2), ("StoreGlobal", 2)]
+    code += [("LoadGlobal", 2), ("MapSize",)]
+    code += [("LoadGlobal", 2), ("LoadConstant", 3), ("MapGet",)]
+    code += [("LoadGlobal", 2), ("LoadConstant", 0), ("MapContains",)]
+    code += [("LoadGlobal", 2), ("MapEntries",), ("ListLength",)]
+    code += call_print(7, 8)
+
+  code += [("Halt",)]
+  return assemble([0, 1, 100, 57, 7, 42, "key", "print"], [NATIVES], code)
+
+
+# Concatenations long enough to be kept as ropes, compared and printed
+# without flattening, and a string builder appending them
+@fixture
+def ropes():
+  digits = "0123456789"
+  repeat = [
+    ("LoadLocal", 1), ("IJumpElseRelCmpConst", 3, EQUAL, 0), ("LoadLocal", 0), ("Return",),
+    ("LoadLocal", 0), ("LoadConstant", 3), ("Concat",),
+    ("LoadLocal", 1), ("SubConst", 1), ("CallGlobal", 0, 2), ("Return",),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(repeat), 2)] + repeat
+  code += [("LoadConstant", 4), ("LoadConstant", 5), ("Concat",)]
+  code += [("LoadConstant", 6), ("LoadConstant", 2), ("CallGlobal", 0, 2), ("StoreGlobal", 1)]
+  code += [("LoadGlobal", 1)]
+  code += [("LoadConstant", 7), ("LoadGlobal", 1), ("Concat",), ("LoadConstant", 8), ("Concat",)]
+  code += [("LoadGlobal", 1), ("LoadConstant", 9), ("Compare", EQUAL)]
+  code += [("BuilderNew", 0), ("LoadConstant", 4), ("BuilderAppend",), ("LoadGlobal", 1), ("BuilderAppend",)]
+  code += [("LoadConstant", 5), ("BuilderAppend",), ("BuilderFinish",)]
+  code += call_print(10, 5) + [("Halt",)]
+  return assemble([0, 1, 12, digits, "ab", "cd", "", "<", ">", digits * 12, "print"], [NATIVES], code)
+
+
+# Lambdas run on worker threads, over a list long enough to be split
+@fixture
+def parallel():
+  n = 200
+  builtins = ("builtin", 0, 3)
+  code = [("MakeAndStoreLambda", 0, 4, 1), ("LoadLocal", 0), ("LoadLocal", 0), ("Mul",), ("Return",)]
+  code += [("MakeAndStoreLambda", 1, 4, 2), ("LoadLocal", 0), ("LoadLocal", 1), ("Add",), ("Return",)]
+  code += [("MakeAndStoreLambda", 2, 4, 1), ("LoadLocal", 0), ("LoadConstant", 7), ("Compare", EQUAL), ("Return",)]
+  code += [("LoadConstant", i) for i in range(n)] + [("MakeList", n), ("StoreGlobal", 3)]
+  code += [("LoadGlobal", 3), ("LoadGlobal", 0), ("LoadNative", n, 0, 0), ("Call", 2)]
+  code += [("LoadGlobal", 1), ("LoadConstant", 0), ("LoadNative", n + 1, 0, 1), ("Call", 3)]
+  code += [("LoadGlobal", 3), ("LoadGlobal", 2), ("LoadNative", n + 2, 0, 2), ("Call", 2)]
+  code += call_print(n + 3, 2, library=1) + [("Halt",)]
+  names = ["parallel_map", "parallel_fold", "parallel_filter", "print"]
+  return assemble(list(range(n)) + names, [builtins, NATIVES], code)
+
+
+# Fibonacci calling itself through its memoized closure, which would not
+# finish in time without the cache
+@fixture
+def memo():
+  body = [
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 2, EQUAL, 1), ("ReturnConst", 1),
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 2, EQUAL, 2), ("ReturnConst", 2),
+    ("LoadLocal", 0), ("SubConst", 2), ("CallGlobal", 1, 1),
+    ("LoadLocal", 0), ("SubConst", 3), ("CallGlobal", 1, 1),
+    ("Add",), ("Return",),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(body), 1)] + body
+  code += [("LoadGlobal", 0), ("LoadNative", 5, 1, 0), ("Call", 1), ("StoreGlobal", 1)]
+  code += [("LoadConstant", 4), ("CallGlobal", 1, 1)]
+  code += call_print(0, 1) + [("Halt",)]
+  return assemble(["print", 0, 1, 2, 45, "memoize"], [NATIVES, ("builtin", 0, 1)], code)
+
+
+# Typed arrays of each element size through the bulk natives, with
+# integers wrapping to the element type
+@fixture
+def arrays():
+  items = [5, -3, 7, 2, 9, 100, -50, 8, 1, 0]
+  natives = ["array_from", "array_to_list", "array_sum", "array_min", "array_max",
+             "array_find", "array_add", "array_sub", "array_mul"]
+  constants = items + ["int32", "float64", "byte"] + natives + ["print", 0, 1, 9, 0.5]
+  index = {c: i for i, c in enumerate(constants) if isinstance(c, str)}
+  zero, one, nine, half = range(len(constants) - 4, len(constants))
+
+  def call(name, argc):
+    return [("LoadNative", index[name], 0, natives.index(name)), ("Call", argc)]
+
+  code = [("LoadConstant", i) for i in range(len(items))] + [("MakeList", len(items)), ("StoreGlobal", 1)]
+  for kind, name in ((2, "int32"), (3, "float64"), (4, "byte")):
+    code += [("LoadConstant", index[name]), ("LoadGlobal", 1)] + call("array_from", 2) + [("StoreGlobal", kind)]
+
+  code += [("LoadGlobal", 2)] + call("array_sum", 1)
+  code += [("LoadGlobal", 2)] + call("array_min", 1)
+  code += [("LoadGlobal", 2)] + call("array_max", 1)
+  code += [("LoadGlobal", 2), ("LoadConstant", nine)] + call("array_find", 2)
+  code += [("LoadGlobal", 2), ("LoadConstant", zero), ("GetIndex",)]
+  code += [("LoadGlobal", 2), ("ListLength",)]
+  code += [("LoadGlobal", 2), ("Slice", 7)] + call("array_to_list", 1)
+  code += [("LoadGlobal", 2), ("LoadConstant", one)] + call("array_add", 2) + call("array_to_list", 1)
+  code += [("LoadGlobal", 2), ("LoadGlobal", 2)] + call("array_mul", 2) + call("array_to_list", 1)
+  code += [("LoadGlobal", 3)] + call("array_sum", 1)
+  code += [("LoadGlobal", 3), ("LoadConstant", half)] + call("array_sub", 2) + call("array_to_list", 1)
+  code += [("LoadGlobal", 4)] + call("array_max", 1)
+  code += [("LoadGlobal", 4)] + call("array_to_list", 1)
+  code += call_print(index["print"], 13, library=1) + [("Halt",)]
+  return assemble(constants, [("builtin", 0, len(natives)), NATIVES], code)
+
+
+# Lines of a mapped file split into views, which are sliced, concatenated,
+# compared and hashed like the flat strings they equal
+@fixture
+def views():
+  first = "first line, long enough to be kept as a view"
+  third = "third line, also long enough to be a view"
+  names = ["file_map", "string_split", "substring"]
+
+  def call(name, argc):
+    return [("LoadNative", 1 + names.index(name), 0, names.index(name)), ("Call", argc)]
+
+  code = [("LoadConstant", 0)] + call("file_map", 1) + [("StoreGlobal", 1)]
+  code += [("LoadGlobal", 1), ("LoadConstant", 4)] + call("string_split", 2) + [("StoreGlobal", 2)]
+  code += [("LoadGlobal", 2), ("ListLength",)]
+  code += [("LoadGlobal", 2), ("ListGet", 0)]
+  code += [("LoadGlobal", 2), ("ListGet", 1)]
+  code += [("LoadGlobal", 2), ("ListGet", 0), ("LoadConstant", 6), ("LoadConstant", 7)] + call("substring", 3)
+  code += [("LoadGlobal", 2), ("ListGet", 0), ("LoadGlobal", 2), ("ListGet", 2), ("Concat",)]
+  code += [("MapNew", MAP_HASHED), ("LoadGlobal", 2), ("ListGet", 2), ("LoadConstant", 8), ("MapInsert",)]
+  code += [("LoadConstant", 10), ("MapGet",)]
+  code += [("LoadGlobal", 2), ("ListGet", 0), ("LoadConstant", 9), ("Compare", EQUAL)]
+  code += call_print(5, 7, library=1) + [("Halt",)]
+  constants = ["lines.txt"] + names + ["\n", "print", 12, 32, 7, first, third]
+  return assemble(constants, [("builtin", 0, len(names)), NATIVES], code)
+
+
+# Small functions called from a loop, which are inlined, next to constant
+# arithmetic and a branch on a constant, which are folded
+@fixture
+def inlining():
+  add = [("LoadLocal", 0), ("LoadLocal", 1), ("Add",), ("Return",)]
+  increment = [("LoadLocal", 0), ("AddConst", 1), ("Return",)]
+  three = [("LoadConstant", 3), ("Return",)]
+  loop = [
+    ("LoadConstant", 2), ("LoadConstant", 3), ("Mul",), ("StoreLocal", 2),
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 3, EQUAL, 0), ("LoadLocal", 1), ("Return",),
+    ("LoadConstant", 0), ("JumpElseRel", 3), ("LoadConstant", 1), ("Return",),
+    ("LoadLocal", 1), ("LoadLocal", 0), ("CallGlobal", 1, 1), ("CallGlobal", 0, 2),
+    ("LoadLocal", 2), ("Add",), ("CallGlobal", 2, 0), ("Add",), ("StoreLocal", 1),
+    ("LoadLocal", 0), ("SubConst", 1), ("StoreLocal", 0), ("JumpRel", -20),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(add), 2)] + add
+  code += [("MakeAndStoreLambda", 1, len(increment), 1)] + increment
+  code += [("MakeAndStoreLambda", 2, len(three), 0)] + three
+  code += [("MakeAndStoreLambda", 3, len(loop), 3)] + loop
+  code += [("LoadConstant", 5), ("LoadConstant", 0), ("LoadConstant", 0), ("CallGlobal", 3, 3)]
+  code += call_print(4, 1) + [("Halt",)]
+  return assemble([0, 1, 2, 3, "print", 1000], [NATIVES], code)
+
+
+# Integer constants on both sides of the 16-bit immediates of the compact
+# encoding, in every instruction that takes one
+@fixture
+def immediates():
+  pick = [
+    ("LoadLocal", 0), ("IJumpElseRelCmpConst", 2, EQUAL, 5), ("ReturnConst", 5),
+    ("ReturnConst", 3),
+  ]
+  code = [("MakeAndStoreLambda", 0, len(pick), 1)] + pick
+  code += [("LoadConstant", 1), ("AddConst", 0)]
+  code += [("LoadConstant", 2), ("SubConst", 0)]
+  code += [("LoadConstant", 4), ("AddConst", 1)]
+  code += [("LoadConstant", 1), ("MulConst", 2)]
+  code += [("LoadConstant", 5), ("CallGlobal", 0, 1)]
+  code += [("LoadConstant", 0), ("CallGlobal", 0, 1)]
+  code += call_print(6, 6) + [("Halt",)]
+  return assemble([1, 32767, 32768, -32768, -32769, 40000, "print"], [NATIVES], code)
+
+
+if __name__ == "__main__":
+  directory = os.path.join(os.path.dirname(os.path.abspath(__file__)), "fixtures")
+  for name, program in FIXTURES.items():
+    with open(os.path.join(directory, name + ".bin"), "wb") as out:
+      out.write(program())
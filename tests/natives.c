@@ -0,0 +1,68 @@
+#include <module.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <value.h>
+
+// Natives of the test fixtures, loaded as the standard library `natives`.
+// The VM exports no symbols, so values are read through the inline
+// accessors of value.h only.
+
+// Ropes are walked down to their leaves instead of being flattened, as
+// `string_flatten` lives in the VM
+static void print_string(Value string) {
+  HeapValue* node = GET_PTR(string);
+
+  if (node->tag == STRING_FLAT) {
+    fwrite(node->as_ptr, 1, node->length, stdout);
+  } else if (node->tag == STRING_VIEW) {
+    fwrite((const char*) (uintptr_t) node->as_ptr[1], 1, node->length, stdout);
+  } else if (node->as_ptr[2] != 0) {
+    print_string(node->as_ptr[2]);
+  } else {
+    print_string(node->as_ptr[0]);
+    print_string(node->as_ptr[1]);
+  }
+}
+
+static void print_value(Value value) {
+  switch (get_type(value)) {
+    case TYPE_INTEGER:
+      printf("%d", (int32_t) GET_INT(value));
+      break;
+    case TYPE_FLOAT:
+      printf("%g", GET_FLOAT(value));
+      break;
+    case TYPE_STRING:
+      print_string(value);
+      break;
+    case TYPE_SPECIAL:
+      printf("unit");
+      break;
+    case TYPE_LIST: {
+      HeapValue* list = GET_PTR(value);
+      printf("[");
+      for (uint32_t i = 0; i < list->length; i++) {
+        if (i > 0) printf(", ");
+        print_value(list->as_ptr[i]);
+      }
+      printf("]");
+      break;
+    }
+    default:
+      printf("<%d>", get_type(value));
+      break;
+  }
+}
+
+// Prints each argument on its own line
+Value print(int argc, Module* module, Value* args) {
+  (void) module;
+
+  for (int i = 0; i < argc; i++) {
+    print_value(args[i]);
+    printf("\n");
+  }
+
+  fflush(stdout);
+  return kNull;
+}
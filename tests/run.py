@@ -0,0 +1,166 @@
+"""Runs bytecode fixtures under every VM mode and compares their output.
+
+usage: run.py <vm> <natives library> <fixture>...
+
+Each tests/fixtures/<name>.bin must print exactly <name>.out in every
+mode, so that modes which only change how a program runs are checked to
+agree with each other.
+"""
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+FIXTURES = os.path.join(os.path.dirname(os.path.abspath(__file__)), "fixtures")
+
+
+class Context:
+  def __init__(self, vm, directory):
+    self.vm = vm
+    self.directory = directory
+    self.cache = os.path.join(directory, "cache")
+    self.env = dict(os.environ, PLUME_PATH=directory, PLUME_CACHE_DIR=self.cache)
+    self.errors = ""
+
+  # Reports of the VM go to stderr, kept in `errors`
+  def run(self, *args):
+    result = subprocess.run([self.vm] + list(args), cwd=FIXTURES, env=self.env,
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=60)
+    self.errors = result.stderr.decode()
+    if result.returncode != 0:
+      raise RuntimeError("exited with %d: %s" % (result.returncode, self.errors.strip()))
+    return result.stdout.decode()
+
+
+# Modes return the output of the program at `path`
+def checked(context, path):
+  return context.run("--no-cache", "--checked", path)
+
+
+def unchecked(context, path):
+  return context.run("--no-cache", "--unchecked", path)
+
+
+def unoptimized(context, path):
+  return context.run("--no-cache", "--no-optimize", "--unchecked", path)
+
+
+def refcounted(context, path):
+  return context.run("--no-cache", "--refcount", "--checked", path)
+
+
+def arena(context, path):
+  return context.run("--no-cache", "--arena", "--unchecked", path)
+
+
+# Runs the program rewritten in the sectioned format, which must convert
+# to the same bytes again
+def converted(context, path):
+  first = os.path.join(context.directory, "converted.plb")
+  second = os.path.join(context.directory, "reconverted.plb")
+  context.run("--convert=" + first, "--unchecked", path)
+  context.run("--convert=" + second, first)
+
+  with open(first, "rb") as a, open(second, "rb") as b:
+    if a.read() != b.read():
+      raise RuntimeError("converting %s again changed it" % path)
+
+  return context.run("--no-cache", first)
+
+
+# Runs the program again from the cache image its first run wrote. Images
+# are keyed by the encoding options, so an unoptimized run writes its own.
+def cached(context, path):
+  shutil.rmtree(context.cache, ignore_errors=True)
+  miss = context.run("--unchecked", path)
+
+  if len(os.listdir(context.cache)) != 1:
+    raise RuntimeError("no cache image written for %s" % path)
+
+  hit = context.run("--unchecked", path)
+  if hit != miss:
+    raise RuntimeError("printed %r before being cached" % miss)
+
+  if context.run("--no-optimize", "--unchecked", path) != hit or len(os.listdir(context.cache)) != 2:
+    raise RuntimeError("unoptimized run of %s did not write its own image" % path)
+
+  return hit
+
+
+# Runs the program with its code laid out by the counts of a first run
+def laid_out(context, path):
+  profile = os.path.join(context.directory, "program.layout")
+  first = context.run("--no-cache", "--unchecked", "--layout-profile=" + profile, path)
+  second = context.run("--no-cache", "--unchecked", "--layout=" + profile, path)
+
+  if second != first:
+    raise RuntimeError("printed %r before being laid out" % first)
+
+  return second
+
+
+def counted(context, path):
+  output = context.run("--no-cache", "--unchecked", "--stats", path)
+  if "dispatched instructions" not in context.errors:
+    raise RuntimeError("no counter report: %s" % context.errors.strip())
+  return output
+
+
+def allocations(context, path):
+  output = context.run("--no-cache", "--unchecked", "--profile=alloc", path)
+  if "Allocation profile" not in context.errors:
+    raise RuntimeError("no allocation report: %s" % context.errors.strip())
+  return output
+
+
+# Short runs may take no sample, but the profile is written in any case
+def sampled(context, path):
+  profile = os.path.join(context.directory, "profile.folded")
+  if os.path.exists(profile):
+    os.remove(profile)
+
+  output = context.run("--no-cache", "--unchecked", "--profile=sample", "--profile-output=" + profile, path)
+  with open(profile) as folded:
+    for line in folded:
+      stack, _, count = line.rstrip("\n").rpartition(" ")
+      if not stack or not count.isdigit():
+        raise RuntimeError("malformed profile line %r" % line)
+
+  return output
+
+
+MODES = [checked, unchecked, unoptimized, refcounted, arena, converted, cached, laid_out, counted,
+         allocations, sampled]
+
+
+def main():
+  vm, natives, names = os.path.abspath(sys.argv[1]), sys.argv[2], sys.argv[3:]
+  failed = 0
+
+  with tempfile.TemporaryDirectory() as directory:
+    # Standard libraries are looked up by their bare name, which Windows
+    # completes with .dll
+    shutil.copy(natives, os.path.join(directory, "natives.dll" if os.name == "nt" else "natives"))
+    context = Context(vm, directory)
+
+    for name in names:
+      with open(os.path.join(FIXTURES, name + ".out")) as out:
+        expected = out.read()
+
+      for mode in MODES:
+        try:
+          output = mode(context, name + ".bin")
+        except (RuntimeError, subprocess.TimeoutExpired) as error:
+          output = "error: %s\n" % error
+
+        if output != expected:
+          failed += 1
+          print("%s (%s): expected\n%sgot\n%s" % (name, mode.__name__, expected, output))
+
+  sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+  main()
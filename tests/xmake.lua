@@ -0,0 +1,31 @@
+-- xmake test
+-- Runs the bytecode fixtures through tests/run.py, which needs python3
+
+target("plume-test-natives")
+  add_rules("mode.release")
+  add_files("natives.c")
+  add_includedirs("../include")
+  set_kind("shared")
+  set_default(false)
+
+target("plume-test")
+  add_deps("plume-vm", "plume-test-natives")
+  set_kind("phony")
+  set_default(false)
+
+  for _, file in ipairs(os.files(path.join(os.scriptdir(), "fixtures", "*.bin"))) do
+    add_tests(path.basename(file))
+  end
+
+  on_test(function (target, opt)
+    local vm = target:dep("plume-vm"):targetfile()
+    local natives = target:dep("plume-test-natives"):targetfile()
+    local runner = path.join(target:scriptdir(), "run.py")
+
+    return try {
+      function ()
+        os.execv("python3", {runner, vm, natives, opt.name})
+        return true
+      end
+    } or false
+  end)
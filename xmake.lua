@@ -2,9 +2,19 @@ if is_plat("windows") then
   set_toolchains("clang-cl")
 else 
   set_toolchains("clang")
+  add_syslinks("pthread")
 end
 
+-- xmake f --tail-calls=y
+option("tail-calls")
+  set_default(false)
+  set_showmenu(true)
+  set_description("Chain opcode handlers with musttail instead of computed goto")
+  add_defines("PLUME_TAIL_CALLS=1")
+option_end()
+
 target("plume-vm")
+  add_options("tail-calls")
   add_rules("mode.release")
   add_files("src/**.c")
   add_includedirs("include")
@@ -13,6 +23,7 @@ target("plume-vm")
   set_optimize("fastest")
 
 target("plume-vm-test")
+  add_options("tail-calls")
   add_rules("mode.debug", "mode.profile")
   add_files("src/**.c")
   add_includedirs("include")
@@ -22,3 +33,25 @@ target("plume-vm-test")
   add_cxflags("-pg")
   add_ldflags("-pg")
   set_optimize("fastest")
+
+-- Everything but the VM entry point, linked into programs built by plume-aot
+target("plume-runtime")
+  add_options("tail-calls")
+  add_rules("mode.release")
+  add_files("src/**.c")
+  remove_files("src/main.c")
+  add_includedirs("include", { public = true })
+  set_kind("static")
+  set_targetdir("bin")
+  set_optimize("fastest")
+
+target("plume-aot")
+  add_rules("mode.release")
+  add_deps("plume-runtime")
+  add_files("aot/**.c")
+  add_includedirs("aot")
+  set_kind("binary")
+  set_targetdir("bin")
+  set_optimize("fastest")
+
+includes("tests")